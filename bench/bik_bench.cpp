@@ -0,0 +1,502 @@
+// bik_bench: throughput benchmarks for backup, restore and listing.
+//
+// Generates synthetic project trees in a temp directory, times
+// ZipUtils::createZip / extractZip, the native archive format and
+// BackupManager::listBackups /
+// loadBackup over several runs, and prints one JSON document (files/s,
+// MB/s, percentiles, peak RSS) so results can be compared between versions.
+
+#include "core/BackupManager.h"
+#include "core/Common.h"
+#include "core/NativeArchive.h"
+#include "core/ParallelCompressor.h"
+#include "core/ZipUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Backups created per workload before listing them
+const int kBackups = 8;
+
+struct BenchConfig {
+    unsigned repeat = 5;
+    double scale = 1.0;
+    unsigned jobs = 0;
+    fs::path workDir;
+    std::string outPath;
+    std::vector<std::string> only;      // workload names; empty runs all
+    bool keep = false;
+};
+
+struct Workload {
+    std::string name;
+    std::string description;
+    fs::path root;
+    size_t files = 0;
+    uint64_t bytes = 0;
+};
+
+struct Result {
+    std::string benchmark;
+    std::string workload;
+    size_t files = 0;           // per run
+    uint64_t bytes = 0;         // per run
+    std::vector<double> ms;     // one sample per run
+    long peakRssKb = 0;         // peak while the benchmark ran (see reset_peak_rss)
+    bool ok = true;
+};
+
+// Deterministic data, so every version benchmarks the same trees
+class Random {
+public:
+    explicit Random(uint64_t seed) : m_state(seed ? seed : 1) {}
+
+    uint64_t next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return m_state;
+    }
+
+    uint64_t range(uint64_t lo, uint64_t hi) {
+        return lo + next() % (hi - lo + 1);
+    }
+
+private:
+    uint64_t m_state;
+};
+
+const char* const kWords[] = {
+    "int", "return", "const", "std::string", "void", "if", "else", "for", "while", "class",
+    "namespace", "bik", "include", "struct", "auto", "size_t", "true", "false", "nullptr", "template",
+};
+
+// Source-like text (deflates well) or random bytes (does not)
+void write_file(const fs::path& path, uint64_t size, bool compressible, Random& rng, Workload& w) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    std::string block;
+    block.reserve(1 << 16);
+    uint64_t left = size;
+    while (left > 0) {
+        block.clear();
+        while (block.size() < std::min<uint64_t>(left, 1 << 16)) {
+            if (compressible) {
+                block += kWords[rng.next() % (sizeof(kWords) / sizeof(kWords[0]))];
+                block += (rng.next() % 8 == 0) ? '\n' : ' ';
+            } else {
+                uint64_t v = rng.next();
+                block.append(reinterpret_cast<const char*>(&v), sizeof(v));
+            }
+        }
+        block.resize(static_cast<size_t>(std::min<uint64_t>(left, block.size())));
+        out.write(block.data(), static_cast<std::streamsize>(block.size()));
+        left -= block.size();
+    }
+    w.files++;
+    w.bytes += size;
+}
+
+size_t scaled(size_t n, double scale) {
+    return std::max<size_t>(1, static_cast<size_t>(n * scale));
+}
+
+Workload make_tiny(const fs::path& root, double scale) {
+    Workload w{"tiny", "many small source files in 100 directories", root};
+    Random rng(1);
+    size_t files = scaled(20000, scale);
+    for (size_t i = 0; i < files; i++) {
+        fs::path dir = root / ("dir" + std::to_string(i % 100));
+        if (i < 100) fs::create_directories(dir);
+        write_file(dir / ("file" + std::to_string(i) + ".cpp"), rng.range(64, 4096), rng.next() % 5 != 0, rng, w);
+    }
+    return w;
+}
+
+Workload make_huge(const fs::path& root, double scale) {
+    Workload w{"huge", "four large files, half compressible", root};
+    Random rng(2);
+    fs::create_directories(root);
+    uint64_t size = static_cast<uint64_t>(32.0 * scale * (1 << 20));
+    for (int i = 0; i < 4; i++) {
+        write_file(root / ("blob" + std::to_string(i) + ".bin"), size, i % 2 == 0, rng, w);
+    }
+    return w;
+}
+
+Workload make_mixed(const fs::path& root, double scale) {
+    Workload w{"mixed", "medium files, compressible and incompressible", root};
+    Random rng(3);
+    size_t files = scaled(1000, scale);
+    for (size_t i = 0; i < files; i++) {
+        fs::path dir = root / ("pkg" + std::to_string(i % 20)) / ("mod" + std::to_string(i % 7));
+        fs::create_directories(dir);
+        bool text = rng.next() % 2 == 0;
+        write_file(dir / ("item" + std::to_string(i) + (text ? ".txt" : ".dat")), rng.range(1024, 256 * 1024), text,
+                   rng, w);
+    }
+    return w;
+}
+
+Workload make_deep(const fs::path& root, double scale) {
+    Workload w{"deep", "200 directory chains, 32 levels deep", root};
+    Random rng(4);
+    size_t chains = scaled(200, scale);
+    for (size_t c = 0; c < chains; c++) {
+        fs::path dir = root / ("chain" + std::to_string(c));
+        for (int level = 0; level < 32; level++) {
+            dir /= "level" + std::to_string(level);
+            fs::create_directories(dir);
+            write_file(dir / "node.h", rng.range(64, 1024), true, rng, w);
+        }
+    }
+    return w;
+}
+
+Workload make_wide(const fs::path& root, double scale) {
+    Workload w{"wide", "one directory holding every file", root};
+    Random rng(5);
+    fs::create_directories(root);
+    size_t files = scaled(20000, scale);
+    for (size_t i = 0; i < files; i++) {
+        write_file(root / ("entry" + std::to_string(i) + ".json"), 256, true, rng, w);
+    }
+    return w;
+}
+
+// Start a new peak RSS measurement. Linux lets the high-water mark be reset
+// to the current RSS; elsewhere the peak stays the process lifetime's, so a
+// benchmark also reports whatever an earlier, larger one reached.
+void reset_peak_rss() {
+#if defined(__linux__)
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+long peak_rss_kb() {
+#if defined(__linux__)
+    // VmHWM follows the reset above; ru_maxrss does not
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::atol(line.c_str() + 6);
+    }
+#endif
+#ifndef _WIN32
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+// bik reports progress on stdout; keep it out of the JSON
+class QuietStdout {
+public:
+    QuietStdout() : m_saved(std::cout.rdbuf(m_sink.rdbuf())) {}
+    ~QuietStdout() { std::cout.rdbuf(m_saved); }
+
+private:
+    std::ostringstream m_sink;
+    std::streambuf* m_saved;
+};
+
+template <typename Prepare, typename Body>
+Result run_timed(const std::string& benchmark, const Workload& w, unsigned repeat, Prepare prepare, Body body) {
+    Result r;
+    r.benchmark = benchmark;
+    r.workload = w.name;
+    r.files = w.files;
+    r.bytes = w.bytes;
+    reset_peak_rss();
+    for (unsigned i = 0; i < repeat && r.ok; i++) {
+        prepare();
+        QuietStdout quiet;
+        auto start = Clock::now();
+        r.ok = body();
+        r.ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    r.peakRssKb = peak_rss_kb();
+    return r;
+}
+
+// Linear interpolation between the closest ranks
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    double pos = p / 100.0 * static_cast<double>(samples.size() - 1);
+    size_t lo = static_cast<size_t>(pos);
+    size_t hi = std::min(lo + 1, samples.size() - 1);
+    return samples[lo] + (samples[hi] - samples[lo]) * (pos - static_cast<double>(lo));
+}
+
+void remove_contents(const fs::path& dir) {
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        if (entry.path().filename() != ".bik") fs::remove_all(entry.path());
+    }
+}
+
+void bench_workload(const BenchConfig& config, const Workload& w, std::vector<Result>& results) {
+    fs::path scratch = config.workDir / ("scratch-" + w.name);
+    fs::create_directories(scratch);
+    fs::path zipPath = scratch / "archive.zip";
+    fs::path extractDir = scratch / "extract";
+
+    ZipOptions zipOptions;
+    zipOptions.jobs = config.jobs;
+    results.push_back(run_timed("createZip", w, config.repeat,
+        [&] { fs::remove(zipPath); },
+        [&] { return ZipUtils::createZip(w.root.string(), zipPath.string(), zipOptions); }));
+
+    ExtractOptions extractOptions;
+    extractOptions.jobs = config.jobs;
+    results.push_back(run_timed("extractZip", w, config.repeat,
+        [&] { fs::remove_all(extractDir); },
+        [&] { return ZipUtils::extractZip(zipPath.string(), extractDir.string(), extractOptions); }));
+    fs::remove_all(extractDir);
+
+    // Same tree through the native format
+    fs::path nativePath = scratch / "archive.bika";
+    NativeArchiveWriter nativeWriter;
+    results.push_back(run_timed("createNative", w, config.repeat,
+        [&] { fs::remove(nativePath); },
+        [&] { return nativeWriter.write(w.root.string(), nativePath.string(), zipOptions); }));
+    results.push_back(run_timed("extractNative", w, config.repeat,
+        [&] { fs::remove_all(extractDir); },
+        [&] {
+            NativeArchiveReader reader;
+            return reader.open(nativePath.string()) && reader.extract(extractDir.string(), extractOptions);
+        }));
+    fs::remove_all(extractDir);
+
+    // BackupManager works on the project in the current directory
+    fs::path backups = scratch / "backups";
+    fs::path previousDir = fs::current_path();
+    fs::current_path(w.root);
+    {
+        QuietStdout quiet;
+        BackupManager init;
+        init.initProject(backups.string(), w.root.string(), "zip");
+        BackupOptions backupOptions;
+        backupOptions.jobs = config.jobs;
+        for (int i = 0; i < kBackups; i++) {
+            BackupManager manager;
+            manager.createBackup("", backupOptions);
+        }
+    }
+
+    // Listing reads the catalog; repeat it enough to be measurable
+    Workload listing = w;
+    listing.files = 0;
+    listing.bytes = 0;
+    results.push_back(run_timed("listBackups", listing, config.repeat * 20,
+        [] {},
+        [] {
+            BackupManager manager;
+            return manager.listBackups().size() == static_cast<size_t>(kBackups);
+        }));
+
+    RestoreOptions restoreOptions;
+    restoreOptions.jobs = config.jobs;
+    restoreOptions.assumeYes = true;
+    auto loadLast = [&] {
+        BackupManager manager;
+        return manager.loadLastBackup(restoreOptions);
+    };
+    // Tree already matches the backup: only verification work
+    results.push_back(run_timed("loadBackup.unchanged", w, config.repeat, [] {}, loadLast));
+    // Tree gone: everything is extracted again
+    results.push_back(run_timed("loadBackup.empty", w, config.repeat, [&] { remove_contents(w.root); }, loadLast));
+
+    fs::current_path(previousDir);
+    if (!config.keep) fs::remove_all(scratch);
+}
+
+void write_json(std::ostream& out, const BenchConfig& config, const std::vector<Workload>& workloads,
+                const std::vector<Result>& results) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n";
+    out << "  \"tool\": \"bik_bench\",\n";
+    out << "  \"version\": \"" << BIK_VERSION << "\",\n";
+#if defined(BIK_HAVE_LIBZIP)
+    out << "  \"backend\": \"libzip\",\n";
+#else
+    out << "  \"backend\": \"minizip\",\n";
+#endif
+    out << "  \"zstd\": " << (ParallelCompressor::supportsZstd() ? "true" : "false") << ",\n";
+    out << "  \"threads\": " << (config.jobs == 0 ? ParallelCompressor::defaultJobs() : config.jobs) << ",\n";
+    out << "  \"repeat\": " << config.repeat << ",\n";
+    out << "  \"scale\": " << config.scale << ",\n";
+    out << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n";
+
+    out << "  \"workloads\": [\n";
+    for (size_t i = 0; i < workloads.size(); i++) {
+        const Workload& w = workloads[i];
+        out << "    {\"name\": " << json_string(w.name) << ", \"description\": " << json_string(w.description)
+            << ", \"files\": " << w.files << ", \"bytes\": " << w.bytes << "}"
+            << (i + 1 < workloads.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double median = percentile(r.ms, 50);
+        double seconds = median / 1000.0;
+        double mean = 0;
+        for (double ms : r.ms) mean += ms;
+        if (!r.ms.empty()) mean /= static_cast<double>(r.ms.size());
+
+        out << "    {\"benchmark\": " << json_string(r.benchmark) << ", \"workload\": " << json_string(r.workload)
+            << ", \"ok\": " << (r.ok ? "true" : "false") << ", \"runs\": " << r.ms.size()
+            << ", \"files\": " << r.files << ", \"bytes\": " << r.bytes << ",\n";
+        out << "     \"ms\": {\"min\": " << percentile(r.ms, 0) << ", \"p50\": " << median
+            << ", \"p90\": " << percentile(r.ms, 90) << ", \"p99\": " << percentile(r.ms, 99)
+            << ", \"max\": " << percentile(r.ms, 100) << ", \"mean\": " << mean << "},\n";
+        out << "     \"files_per_s\": " << (seconds > 0 ? r.files / seconds : 0)
+            << ", \"mb_per_s\": " << (seconds > 0 ? r.bytes / (1024.0 * 1024.0) / seconds : 0)
+            << ", \"ops_per_s\": " << (seconds > 0 ? 1.0 / seconds : 0)
+            << ", \"peak_rss_kb\": " << r.peakRssKb << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+void print_usage() {
+    std::cerr << "Usage: bik_bench [options]\n\n";
+    std::cerr << "  --repeat <n>        Runs per benchmark (default 5)\n";
+    std::cerr << "  --scale <x>         Multiply file counts and sizes (default 1.0)\n";
+    std::cerr << "  --only <a,b,...>    Workloads: tiny, huge, mixed, deep, wide (default all)\n";
+    std::cerr << "  -j <n>              Threads for compression and extraction (default all cores)\n";
+    std::cerr << "  --dir <path>        Where to generate trees (default: system temp)\n";
+    std::cerr << "  --out <file>        Write the JSON report to <file> instead of stdout\n";
+    std::cerr << "  --keep              Leave the generated trees and archives behind\n";
+}
+
+bool parse_args(int argc, char* argv[], BenchConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--repeat" && hasValue) {
+                config.repeat = static_cast<unsigned>(std::max(1, std::stoi(argv[++i])));
+            } else if (arg == "--scale" && hasValue) {
+                config.scale = std::stod(argv[++i]);
+            } else if (arg == "-j" && hasValue) {
+                config.jobs = static_cast<unsigned>(std::max(0, std::stoi(argv[++i])));
+            } else if (arg == "--dir" && hasValue) {
+                config.workDir = fs::absolute(argv[++i]);
+            } else if (arg == "--out" && hasValue) {
+                config.outPath = argv[++i];
+            } else if (arg == "--only" && hasValue) {
+                std::stringstream list(argv[++i]);
+                std::string name;
+                while (std::getline(list, name, ',')) {
+                    if (!name.empty()) config.only.push_back(name);
+                }
+            } else if (arg == "--keep") {
+                config.keep = true;
+            } else {
+                return false;
+            }
+        } catch (...) {
+            return false;
+        }
+    }
+    return config.scale > 0;
+}
+
+} // namespace
+
+} // namespace bik
+
+int main(int argc, char* argv[]) {
+    using namespace bik;
+
+    BenchConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage();
+        return 2;
+    }
+    if (config.workDir.empty()) {
+#ifndef _WIN32
+        long id = static_cast<long>(::getpid());
+#else
+        long id = static_cast<long>(std::time(nullptr));
+#endif
+        config.workDir = fs::temp_directory_path() / ("bik-bench-" + std::to_string(id));
+    }
+
+    struct Generator {
+        const char* name;
+        Workload (*make)(const fs::path&, double);
+    };
+    const Generator generators[] = {
+        {"tiny", make_tiny}, {"huge", make_huge}, {"mixed", make_mixed}, {"deep", make_deep}, {"wide", make_wide},
+    };
+
+    std::vector<Workload> workloads;
+    std::vector<Result> results;
+    try {
+        for (const auto& g : generators) {
+            if (!config.only.empty() && std::find(config.only.begin(), config.only.end(), g.name) == config.only.end()) {
+                continue;
+            }
+            std::cerr << "Generating " << g.name << "..." << std::endl;
+            Workload w = g.make(config.workDir / g.name / "project", config.scale);
+            std::cerr << "Benchmarking " << g.name << " (" << w.files << " files, " << w.bytes / (1024 * 1024)
+                      << " MB)..." << std::endl;
+            bench_workload(config, w, results);
+            workloads.push_back(w);
+            if (!config.keep) fs::remove_all(config.workDir / g.name);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "bik_bench: " << e.what() << std::endl;
+        if (!config.keep) fs::remove_all(config.workDir);
+        return 1;
+    }
+    if (!config.keep) fs::remove_all(config.workDir);
+
+    if (config.outPath.empty()) {
+        write_json(std::cout, config, workloads, results);
+    } else {
+        std::ofstream out(config.outPath, std::ios::trunc);
+        write_json(out, config, workloads, results);
+        if (!out) {
+            std::cerr << "bik_bench: cannot write " << config.outPath << std::endl;
+            return 1;
+        }
+    }
+
+    for (const auto& r : results) {
+        if (!r.ok) return 1;
+    }
+    return 0;
+}
@@ -1,14 +1,27 @@
 #include "cli/CommandHandler.h"
 #include "core/BackupManager.h"
+#include "core/ParallelCompressor.h"
+#include "core/Stats.h"
+#include "core/TreeWatcher.h"
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <filesystem>
+#include <fstream>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
 namespace bik {
 
-CommandHandler::CommandHandler() {
+CommandHandler::CommandHandler() : m_stats(false) {
 }
 
 CommandHandler::~CommandHandler() {
@@ -25,6 +38,17 @@ int CommandHandler::execute(int argc, char* argv[]) {
         args.push_back(argv[i]);
     }
     
+    if (!takeStatsOptions(args)) {
+        return 1;
+    }
+    int result = dispatch(args);
+    if (!reportStats()) {
+        return result == 0 ? 1 : result;
+    }
+    return result;
+}
+
+int CommandHandler::dispatch(const std::vector<std::string>& args) {
     std::string command = args[0];
     
     if (command == "project") {
@@ -37,6 +61,16 @@ int CommandHandler::execute(int argc, char* argv[]) {
         return handleWipeOldCommand(args);
     } else if (command == "load") {
         return handleLoadCommand(args);
+    } else if (command == "restore") {
+        return handleRestoreCommand(args);
+    } else if (command == "watch") {
+        return handleWatchCommand(args);
+    } else if (command == "dict") {
+        return handleDictCommand(args);
+    } else if (command == "verify") {
+        return handleVerifyCommand(args);
+    } else if (command == "diff") {
+        return handleDiffCommand(args);
     } else if (command == "--version" || command == "-v") {
         printVersion();
         return 0;
@@ -50,45 +84,129 @@ int CommandHandler::execute(int argc, char* argv[]) {
     }
 }
 
+bool CommandHandler::takeStatsOptions(std::vector<std::string>& args) {
+    // Accepted with any command; removed before the command parses its arguments
+    std::vector<std::string> rest;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--stats") {
+            m_stats = true;
+        } else if (args[i] == "--stats-json" || args[i] == "--trace") {
+            if (i + 1 >= args.size()) {
+                std::cerr << "Error: " << args[i] << " expects a file name\n";
+                return false;
+            }
+            (args[i] == "--trace" ? m_tracePath : m_statsJsonPath) = args[i + 1];
+            i++;
+        } else {
+            rest.push_back(args[i]);
+        }
+    }
+    if (rest.empty()) {
+        printUsage();
+        return false;
+    }
+    args = rest;
+    if (m_stats || !m_statsJsonPath.empty() || !m_tracePath.empty()) {
+        Stats::enable(!m_tracePath.empty());
+    }
+    return true;
+}
+
+bool CommandHandler::reportStats() const {
+    bool ok = true;
+    if (m_stats) {
+        Stats::print(std::cerr);
+    }
+    if (!m_statsJsonPath.empty()) {
+        std::ofstream out(m_statsJsonPath, std::ios::trunc);
+        Stats::writeJson(out);
+        if (!out) {
+            std::cerr << "Error: Failed to write " << m_statsJsonPath << "\n";
+            ok = false;
+        }
+    }
+    if (!m_tracePath.empty() && !Stats::writeTrace(m_tracePath)) {
+        std::cerr << "Error: Failed to write " << m_tracePath << "\n";
+        ok = false;
+    }
+    return ok;
+}
+
 void CommandHandler::printUsage() const {
     std::cout << "Bik - Simple Backup Manager v1.0.0\n\n";
     std::cout << "Usage: bik <command> [options]\n\n";
     std::cout << "Commands:\n";
     std::cout << "  project -b <backup_dir> [-n <name>]  Initialize project with backup directory\n";
-    std::cout << "  backup [-n <name>]                    Create a new backup\n";
+    std::cout << "          [-f zip|native|link|dedup]    Repository format (default zip)\n";
+    std::cout << "          [--dict]                      Train a zstd dictionary for small files\n";
+    std::cout << "  backup [-n <name>] [-full] [-j <n>]   Create a new backup (incremental unless -full,\n";
+    std::cout << "                                        <n> compression threads, default all cores)\n";
+    std::cout << "         [--codec deflate|zstd]         Codec, remembered as the project default\n";
+    std::cout << "         [--level <n>] [--long]         Codec level; zstd long-distance matching\n";
+    std::cout << "         [--stdout]                     Stream a full backup to stdout instead\n";
     std::cout << "  clean                                 Delete all backups\n";
     std::cout << "  wipeold                               Delete all backups except the most recent\n";
-    std::cout << "  load [-last]                          Load a backup (interactive or last)\n";
+    std::cout << "  load [-last] [-y] [-j <n>]            Load a backup (interactive or last)\n";
+    std::cout << "       [--stdin]                        Restore from a backup stream on stdin\n";
+    std::cout << "  restore <backup> <path|glob>...       Restore only matching files from a backup\n";
+    std::cout << "          [--to <dir>] [-j <n>]         (into <dir> instead of the project)\n";
+    std::cout << "  verify [<backup>|--all] [-j <n>]      Check a backup (default: the latest) or all of\n";
+    std::cout << "                                        them against their stored checksums\n";
+    std::cout << "  diff [<a> [<b>]] [--stat]             Files added, removed and modified from backup <a>\n";
+    std::cout << "                                        (default: the latest) to <b> or the project\n";
+    std::cout << "  watch                                 Record changes so backups skip the tree scan\n";
+    std::cout << "                                        (runs until Ctrl+C; Linux only)\n";
+    std::cout << "  dict [--off]                          (Re)train the small-file zstd dictionary used\n";
+    std::cout << "                                        by native backups, or stop using it\n";
     std::cout << "  --help, -h                            Show this help message\n";
     std::cout << "  --version, -v                         Show version information\n";
+    std::cout << "\nOptions for any command:\n";
+    std::cout << "  --stats                               Print phase timings, file and byte counts\n";
+    std::cout << "  --stats-json <file>                   Write the same statistics as JSON\n";
+    std::cout << "  --trace <file>                        Write a Chrome trace (chrome://tracing, Perfetto)\n";
+    std::cout << "                                        with a span per compressed or extracted file\n";
     std::cout << "\nExamples:\n";
     std::cout << "  bik project -b /path/to/backups\n";
     std::cout << "  bik project -b C:\\Backups -n my-project\n";
+    std::cout << "  bik project -b /path/to/backups -f dedup\n";
+    std::cout << "  bik project -b /path/to/backups -f native\n";
+    std::cout << "  bik project -b /path/to/backups -f native --dict\n";
     std::cout << "  bik backup\n";
     std::cout << "  bik backup -n working-version-1\n";
+    std::cout << "  bik backup -j 8\n";
+    std::cout << "  bik backup --codec zstd --level 9\n";
+    std::cout << "  bik backup --stats --trace backup-trace.json\n";
     std::cout << "  bik load\n";
     std::cout << "  bik load -last\n";
+    std::cout << "  bik backup --stdout | ssh host 'cat > project.bikstream'\n";
+    std::cout << "  ssh host 'cat project.bikstream' | bik load --stdin\n";
+    std::cout << "  bik restore my-project-backup-3 config/app.yaml\n";
+    std::cout << "  bik restore my-project-backup-3 'src/**/*.h' --to /tmp/headers\n";
+    std::cout << "  bik verify --all\n";
+    std::cout << "  bik diff\n";
+    std::cout << "  bik diff my-project-backup-41 my-project-backup-42 --stat\n";
 }
 
 void CommandHandler::printVersion() const {
-    std::cout << "Bik v1.0.0\n";
+    std::cout << "Bik v" << BIK_VERSION << "\n";
     std::cout << "Simple and reliable backup manager for code projects\n";
 }
 
 int CommandHandler::handleProjectCommand(const std::vector<std::string>& args) {
     std::string backupDir = findArgValue(args, "-b");
     std::string name = findArgValue(args, "-n");
+    std::string format = findArgValue(args, "-f");
     
     if (backupDir.empty()) {
         std::cerr << "Error: -b <backup_dir> is required\n";
-        std::cerr << "Usage: bik project -b <backup_dir> [-n <name>]\n";
+        std::cerr << "Usage: bik project -b <backup_dir> [-n <name>] [-f zip|native|link|dedup] [--dict]\n";
         return 1;
     }
     
     BackupManager manager;
     std::string projectDir = fs::current_path().string();
     
-    if (!manager.initProject(backupDir, projectDir)) {
+    if (!manager.initProject(backupDir, projectDir, format.empty() ? "zip" : format)) {
         return 1;
     }
     
@@ -96,6 +214,10 @@ int CommandHandler::handleProjectCommand(const std::vector<std::string>& args) {
     std::cout << "Project directory: " << manager.getProjectDir() << "\n";
     std::cout << "Backup directory: " << manager.getBackupDir() << "\n";
     
+    if (hasFlag(args, "--dict") && !manager.trainDictionary()) {
+        return 1;
+    }
+    
     // Create initial backup if name is provided
     if (!name.empty()) {
         std::cout << "\nCreating initial backup...\n";
@@ -110,13 +232,47 @@ int CommandHandler::handleProjectCommand(const std::vector<std::string>& args) {
 int CommandHandler::handleBackupCommand(const std::vector<std::string>& args) {
     std::string name = findArgValue(args, "-n");
     
+    BackupOptions options;
+    options.full = hasFlag(args, "-full");
+    options.codec = findArgValue(args, "--codec");
+    options.longDistance = hasFlag(args, "--long");
+    if (!parseJobs(args, options.jobs)) {
+        return 1;
+    }
+    std::string level = findArgValue(args, "--level");
+    if (!level.empty()) {
+        try {
+            options.level = std::stoi(level);
+        } catch (...) {
+            std::cerr << "Error: --level expects a number\n";
+            return 1;
+        }
+    }
+    
     BackupManager manager;
     if (!manager.isInitialized()) {
         std::cerr << "Error: Project not initialized. Run 'bik project -b <backup_dir>' first.\n";
         return 1;
     }
     
-    if (manager.createBackup(name)) {
+    if (hasFlag(args, "--stdout")) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#else
+        if (isatty(STDOUT_FILENO)) {
+            std::cerr << "Error: refusing to write a backup stream to a terminal; pipe or redirect it\n";
+            return 1;
+        }
+#endif
+        // The stream owns the real stdout; anything else printed goes to stderr
+        std::ostream data(std::cout.rdbuf());
+        std::streambuf* saved = std::cout.rdbuf(std::cerr.rdbuf());
+        bool ok = manager.createBackupStream(data, options);
+        std::cout.rdbuf(saved);
+        return ok ? 0 : 1;
+    }
+    
+    if (manager.createBackup(name, options)) {
         return 0;
     }
     return 1;
@@ -148,6 +304,43 @@ int CommandHandler::handleWipeOldCommand(const std::vector<std::string>& args) {
     return 1;
 }
 
+int CommandHandler::handleWatchCommand(const std::vector<std::string>& args) {
+    if (args.size() > 1) {
+        std::cerr << "Error: Unexpected argument: " << args[1] << "\n";
+        std::cerr << "Usage: bik watch\n";
+        return 1;
+    }
+    
+    BackupManager manager;
+    if (!manager.isInitialized()) {
+        std::cerr << "Error: Project not initialized.\n";
+        return 1;
+    }
+    
+    TreeWatcher watcher(manager.getProjectDir());
+    if (watcher.run()) {
+        return 0;
+    }
+    return 1;
+}
+
+int CommandHandler::handleDictCommand(const std::vector<std::string>& args) {
+    BackupManager manager;
+    if (!manager.isInitialized()) {
+        std::cerr << "Error: Project not initialized.\n";
+        return 1;
+    }
+    
+    if (hasFlag(args, "--off")) {
+        if (!manager.dropDictionary()) {
+            return 1;
+        }
+        std::cout << "Backups no longer use a zstd dictionary\n";
+        return 0;
+    }
+    return manager.trainDictionary() ? 0 : 1;
+}
+
 int CommandHandler::handleLoadCommand(const std::vector<std::string>& args) {
     BackupManager manager;
     if (!manager.isInitialized()) {
@@ -157,8 +350,24 @@ int CommandHandler::handleLoadCommand(const std::vector<std::string>& args) {
     
     bool loadLast = hasFlag(args, "-last");
     
+    RestoreOptions options;
+    if (!parseJobs(args, options.jobs)) {
+        return 1;
+    }
+    options.assumeYes = hasFlag(args, "-y");
+    
+    if (hasFlag(args, "--stdin")) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        if (manager.loadBackupStream(std::cin, options)) {
+            return 0;
+        }
+        return 1;
+    }
+    
     if (loadLast) {
-        if (manager.loadLastBackup()) {
+        if (manager.loadLastBackup(options)) {
             return 0;
         }
         return 1;
@@ -172,7 +381,7 @@ int CommandHandler::handleLoadCommand(const std::vector<std::string>& args) {
     }
     
     std::cout << "\nAvailable backups:\n";
-    std::cout << std::string(80, '-') << "\n";
+    std::cout << std::string(100, '-') << "\n";
     
     for (size_t i = 0; i < backups.size(); i++) {
         std::time_t t = backups[i].timestamp;
@@ -185,10 +394,17 @@ int CommandHandler::handleLoadCommand(const std::vector<std::string>& args) {
         std::cout << std::setw(3) << (i + 1) << ". " 
                   << std::setw(30) << std::left << backups[i].name
                   << " | " << timeStr
-                  << " | " << std::fixed << std::setprecision(2) << sizeMB << " MB\n";
+                  << " | " << std::fixed << std::setprecision(2) << sizeMB << " MB"
+                  << " | " << backups[i].fileCount << " files";
+        if (backups[i].originalSize > 0) {
+            std::cout << " (" << std::setprecision(0)
+                      << 100.0 * static_cast<double>(backups[i].size) / static_cast<double>(backups[i].originalSize)
+                      << "%)";
+        }
+        std::cout << "\n";
     }
     
-    std::cout << std::string(80, '-') << "\n";
+    std::cout << std::string(100, '-') << "\n";
     std::cout << "Enter backup number to load (0 to cancel): ";
     
     int choice;
@@ -200,12 +416,103 @@ int CommandHandler::handleLoadCommand(const std::vector<std::string>& args) {
         return 0;
     }
     
-    if (manager.loadBackup(backups[choice - 1].name)) {
+    if (manager.loadBackup(backups[choice - 1].name, options)) {
         return 0;
     }
     return 1;
 }
 
+int CommandHandler::handleRestoreCommand(const std::vector<std::string>& args) {
+    // restore <backup> <pattern>... with options anywhere after the backup name
+    std::string backup;
+    std::vector<std::string> patterns;
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i] == "--to" || args[i] == "-j") {
+            i++;
+        } else if (backup.empty()) {
+            backup = args[i];
+        } else {
+            patterns.push_back(args[i]);
+        }
+    }
+    
+    if (backup.empty() || patterns.empty()) {
+        std::cerr << "Error: a backup name and at least one path or glob are required\n";
+        std::cerr << "Usage: bik restore <backup> <path|glob>... [--to <dir>] [-j <n>]\n";
+        return 1;
+    }
+    
+    RestoreOptions options;
+    if (!parseJobs(args, options.jobs)) {
+        return 1;
+    }
+    
+    BackupManager manager;
+    if (!manager.isInitialized()) {
+        std::cerr << "Error: Project not initialized.\n";
+        return 1;
+    }
+    
+    if (manager.restoreFiles(backup, patterns, findArgValue(args, "--to"), options)) {
+        return 0;
+    }
+    return 1;
+}
+
+int CommandHandler::handleVerifyCommand(const std::vector<std::string>& args) {
+    // verify [<backup>|--all] [-j <n>]
+    std::string backup;
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i] == "-j") {
+            i++;
+        } else if (args[i] != "--all" && backup.empty()) {
+            backup = args[i];
+        }
+    }
+    bool all = hasFlag(args, "--all");
+    if (all && !backup.empty()) {
+        std::cerr << "Error: give a backup name or --all, not both\n";
+        std::cerr << "Usage: bik verify [<backup>|--all] [-j <n>]\n";
+        return 1;
+    }
+    
+    RestoreOptions options;
+    if (!parseJobs(args, options.jobs)) {
+        return 1;
+    }
+    
+    BackupManager manager;
+    if (!manager.isInitialized()) {
+        std::cerr << "Error: Project not initialized.\n";
+        return 1;
+    }
+    
+    bool ok = all ? manager.verifyAllBackups(options) : manager.verifyBackup(backup, options);
+    return ok ? 0 : 1;
+}
+
+int CommandHandler::handleDiffCommand(const std::vector<std::string>& args) {
+    // diff [<a> [<b>]] [--stat]
+    std::vector<std::string> names;
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i] != "--stat") names.push_back(args[i]);
+    }
+    if (names.size() > 2) {
+        std::cerr << "Error: at most two backups can be compared\n";
+        std::cerr << "Usage: bik diff [<a> [<b>]] [--stat]\n";
+        return 1;
+    }
+    
+    BackupManager manager;
+    if (!manager.isInitialized()) {
+        std::cerr << "Error: Project not initialized.\n";
+        return 1;
+    }
+    
+    std::string from = names.empty() ? "" : names[0];
+    std::string to = names.size() < 2 ? "" : names[1];
+    return manager.diffBackups(from, to, hasFlag(args, "--stat")) ? 0 : 1;
+}
 
 std::string CommandHandler::findArgValue(const std::vector<std::string>& args, 
                                          const std::string& flag) const {
@@ -227,4 +534,28 @@ bool CommandHandler::hasFlag(const std::vector<std::string>& args,
     return false;
 }
 
+bool CommandHandler::parseJobs(const std::vector<std::string>& args, unsigned& jobs) const {
+    std::string value = findArgValue(args, "-j");
+    if (value.empty()) {
+        return true;
+    }
+    // stoul takes "-1" as ULONG_MAX, so digits are checked first
+    if (value.find_first_not_of("0123456789") != std::string::npos) {
+        std::cerr << "Error: -j expects a number of threads\n";
+        return false;
+    }
+    unsigned long n = 0;
+    try {
+        n = std::stoul(value);
+    } catch (...) {
+        n = ParallelCompressor::kMaxJobs;     // out of range: as many as allowed
+    }
+    if (n < 1) {
+        std::cerr << "Error: -j expects at least 1 thread\n";
+        return false;
+    }
+    jobs = static_cast<unsigned>(std::min<unsigned long>(n, ParallelCompressor::kMaxJobs));
+    return true;
+}
+
 } // namespace bik
@@ -15,6 +15,11 @@ public:
     int execute(int argc, char* argv[]);
 
 private:
+    int dispatch(const std::vector<std::string>& args);
+    // Pull --stats, --stats-json and --trace out of args and enable collection
+    bool takeStatsOptions(std::vector<std::string>& args);
+    bool reportStats() const;
+
     void printUsage() const;
     void printVersion() const;
     
@@ -23,11 +28,21 @@ private:
     int handleCleanCommand(const std::vector<std::string>& args);
     int handleWipeOldCommand(const std::vector<std::string>& args);
     int handleLoadCommand(const std::vector<std::string>& args);
+    int handleRestoreCommand(const std::vector<std::string>& args);
+    int handleWatchCommand(const std::vector<std::string>& args);
+    int handleDictCommand(const std::vector<std::string>& args);
+    int handleVerifyCommand(const std::vector<std::string>& args);
+    int handleDiffCommand(const std::vector<std::string>& args);
     
     std::string findArgValue(const std::vector<std::string>& args, 
                             const std::string& flag) const;
     bool hasFlag(const std::vector<std::string>& args, 
                 const std::string& flag) const;
+    bool parseJobs(const std::vector<std::string>& args, unsigned& jobs) const;
+
+    bool m_stats;
+    std::string m_statsJsonPath;
+    std::string m_tracePath;
 };
 
 } // namespace bik
@@ -0,0 +1,85 @@
+#include "core/Archive.h"
+#include "core/LinkSnapshot.h"
+#include "core/NativeArchive.h"
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+// The zip backend selected at build time (libzip or minizip)
+class ZipArchiveWriter : public ArchiveWriter {
+public:
+    bool write(const std::string& sourceDir, const std::string& path, const ZipOptions& options) override {
+        return ZipUtils::createZip(sourceDir, path, options);
+    }
+
+    const char* extension() const override {
+        return ".zip";
+    }
+};
+
+class ZipArchiveReader : public ArchiveReader {
+public:
+    explicit ZipArchiveReader(const std::string& path) : m_path(path) {}
+
+    bool list(std::vector<ZipEntryInfo>& entries) override {
+        return ZipUtils::listEntries(m_path, entries);
+    }
+
+    bool extract(const std::string& destDir, const ExtractOptions& options) override {
+        return ZipUtils::extractZip(m_path, destDir, options);
+    }
+
+    bool verify(unsigned jobs, VerifyReport& report) override {
+        return ZipUtils::verifyZip(m_path, jobs, report);
+    }
+
+private:
+    std::string m_path;
+};
+
+} // namespace
+
+const std::vector<ArchiveFormat>& archiveFormats() {
+    static const std::vector<ArchiveFormat> formats = {
+        {"zip", ".zip"},
+        {"native", ".bika"},
+        {"link", ".bikd"},
+    };
+    return formats;
+}
+
+std::string archiveFormatFor(const std::string& extension) {
+    for (const auto& f : archiveFormats()) {
+        if (extension == f.extension) return f.name;
+    }
+    return "";
+}
+
+std::unique_ptr<ArchiveWriter> ArchiveWriter::create(const std::string& format) {
+    if (format == "zip") return std::unique_ptr<ArchiveWriter>(new ZipArchiveWriter());
+    if (format == "native") return std::unique_ptr<ArchiveWriter>(new NativeArchiveWriter());
+    if (format == "link") return std::unique_ptr<ArchiveWriter>(new LinkSnapshotWriter());
+    return nullptr;
+}
+
+std::unique_ptr<ArchiveReader> ArchiveReader::open(const std::string& path) {
+    std::string format = archiveFormatFor(fs::path(path).extension().string());
+    if (format == "zip") {
+        return std::unique_ptr<ArchiveReader>(new ZipArchiveReader(path));
+    }
+    if (format == "native") {
+        std::unique_ptr<NativeArchiveReader> reader(new NativeArchiveReader());
+        if (reader->open(path)) return reader;
+    }
+    if (format == "link") {
+        std::unique_ptr<LinkSnapshotReader> reader(new LinkSnapshotReader());
+        if (reader->open(path)) return reader;
+    }
+    return nullptr;
+}
+
+} // namespace bik
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "core/ZipUtils.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bik {
+
+// Writes one backup archive. BackupManager picks the writer from the
+// project's backup_format (.bik/config.txt), so formats are chosen at run
+// time; the zip backend compiled in (libzip or minizip) is one of them.
+class ArchiveWriter {
+public:
+    virtual ~ArchiveWriter() = default;
+
+    // Archive every file under sourceDir into path. options.baseZipPath must
+    // be an archive of this format to have unchanged entries copied from it.
+    virtual bool write(const std::string& sourceDir, const std::string& path, const ZipOptions& options) = 0;
+
+    // Extension of the archives this writer produces, with the dot
+    virtual const char* extension() const = 0;
+
+    // Writer for a backup_format value ("zip", "native", "link"); null if unknown
+    static std::unique_ptr<ArchiveWriter> create(const std::string& format);
+};
+
+// Reads one backup archive, whatever format wrote it
+class ArchiveReader {
+public:
+    virtual ~ArchiveReader() = default;
+
+    // Entry metadata, without decompressing any data
+    virtual bool list(std::vector<ZipEntryInfo>& entries) = 0;
+
+    // Extract the archive (or options.only) into destDir
+    virtual bool extract(const std::string& destDir, const ExtractOptions& options) = 0;
+
+    // Read every entry back on jobs threads (0 = all cores) and check it
+    // against the checksums stored at backup time, without writing anything.
+    // Damaged entries go to report.corrupt; false if there are any or the
+    // archive cannot be read at all.
+    virtual bool verify(unsigned jobs, VerifyReport& report) = 0;
+
+    // Other archives this one cannot be extracted without (the bases of its
+    // delta entries), as paths
+    virtual std::vector<std::string> dependencies() { return {}; }
+
+    // Reader for the archive at path, chosen by its extension; null if no
+    // format handles it or the archive cannot be opened
+    static std::unique_ptr<ArchiveReader> open(const std::string& path);
+};
+
+// Archive formats: backup_format value and file extension
+struct ArchiveFormat {
+    const char* name;
+    const char* extension;
+};
+
+// Every archive format this build reads and writes
+const std::vector<ArchiveFormat>& archiveFormats();
+
+// Format name for an archive file extension (".zip" -> "zip"); empty if none
+std::string archiveFormatFor(const std::string& extension);
+
+} // namespace bik
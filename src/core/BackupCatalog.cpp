@@ -0,0 +1,191 @@
+#include "core/BackupCatalog.h"
+#include "core/Archive.h"
+#include "core/ChunkStore.h"
+#include "core/LinkSnapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+const char* const BackupCatalog::kFileName = "catalog.txt";
+
+BackupCatalog::BackupCatalog(const std::string& backupDir) : m_backupDir(backupDir) {
+}
+
+bool BackupCatalog::load() {
+    std::ifstream file(fs::path(m_backupDir) / kFileName);
+    if (!file.is_open()) {
+        return rebuild();
+    }
+
+    m_backups.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        // created \t format \t size \t original \t files \t name
+        std::istringstream fields(line);
+        BackupInfo info;
+        long long created = 0;
+        if (!(fields >> created >> info.format >> info.size >> info.originalSize >> info.fileCount)) {
+            continue;
+        }
+        fields.get();
+        std::getline(fields, info.name);
+        if (info.name.empty()) continue;
+        info.timestamp = static_cast<std::time_t>(created);
+        info.path = pathFor(info.name, info.format);
+        m_backups.push_back(info);
+    }
+    return true;
+}
+
+bool BackupCatalog::save() const {
+    fs::path path = fs::path(m_backupDir) / kFileName;
+    std::string tmpPath = path.string() + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        file << "# Bik Backup Catalog\n";
+        for (const auto& b : m_backups) {
+            file << static_cast<long long>(b.timestamp) << '\t' << b.format << '\t' << b.size << '\t'
+                 << b.originalSize << '\t' << b.fileCount << '\t' << b.name << '\n';
+        }
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+void BackupCatalog::add(const BackupInfo& info) {
+    remove(info.name);
+    BackupInfo entry = info;
+    if (entry.path.empty()) entry.path = pathFor(entry.name, entry.format);
+    m_backups.insert(m_backups.begin(), entry);
+}
+
+void BackupCatalog::remove(const std::string& name) {
+    m_backups.erase(std::remove_if(m_backups.begin(), m_backups.end(),
+                                   [&](const BackupInfo& b) { return b.name == name; }),
+                    m_backups.end());
+}
+
+void BackupCatalog::clear() {
+    m_backups.clear();
+}
+
+const std::vector<BackupInfo>& BackupCatalog::backups() const {
+    return m_backups;
+}
+
+int BackupCatalog::nextNumber(const std::string& baseName) const {
+    int maxNum = -1;
+    std::string prefix = baseName + "-backup-";
+    for (const auto& b : m_backups) {
+        if (b.name.compare(0, prefix.size(), prefix) != 0) continue;
+        try {
+            maxNum = std::max(maxNum, std::stoi(b.name.substr(prefix.size())));
+        } catch (...) {
+            // Not a number, skip
+        }
+    }
+    return maxNum + 1;
+}
+
+bool BackupCatalog::describe(BackupInfo& info) {
+    info.originalSize = 0;
+    info.fileCount = 0;
+    if (info.format == "dedup") {
+        std::vector<ManifestEntry> entries;
+        if (!ChunkStore::loadManifest(info.path, entries)) return false;
+        for (const auto& e : entries) {
+            info.originalSize += e.size;
+        }
+        info.fileCount = entries.size();
+        return true;
+    }
+
+    std::unique_ptr<ArchiveReader> reader = ArchiveReader::open(info.path);
+    std::vector<ZipEntryInfo> entries;
+    if (!reader || !reader->list(entries)) return false;
+    for (const auto& e : entries) {
+        if (e.name.empty() || e.name.back() == '/') continue;
+        info.originalSize += e.size;
+        info.fileCount++;
+    }
+    return true;
+}
+
+bool BackupCatalog::rebuild() {
+    m_backups.clear();
+    if (!fs::exists(m_backupDir)) {
+        return true;
+    }
+
+    try {
+        for (const auto& entry : fs::directory_iterator(m_backupDir)) {
+            std::string ext = entry.path().extension().string();
+            std::string format = ext == ChunkStore::kManifestExtension ? "dedup" : archiveFormatFor(ext);
+            if (format.empty() || entry.is_directory() != (format == "link")) continue;
+
+            BackupInfo info;
+            info.name = entry.path().stem().string();
+            info.path = entry.path().string();
+            info.format = format;
+
+            auto ftime = fs::last_write_time(entry.path());
+            auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+                ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+            info.timestamp = std::chrono::system_clock::to_time_t(sctp);
+
+            // A manifest's own size says nothing about the data it references
+            info.size = info.format == "dedup" ? ChunkStore::manifestStoredBytes(info.path)
+                      : info.format == "link" ? LinkSnapshotReader::storedBytes(info.path)
+                      : fs::file_size(entry.path());
+            describe(info);
+            m_backups.push_back(info);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error scanning backups: " << e.what() << std::endl;
+        return false;
+    }
+
+    std::stable_sort(m_backups.begin(), m_backups.end(),
+                     [](const BackupInfo& a, const BackupInfo& b) {
+                         return a.timestamp > b.timestamp;
+                     });
+    if (!save()) {
+        std::cerr << "Warning: Failed to write backup catalog" << std::endl;
+    }
+    return true;
+}
+
+std::string BackupCatalog::pathFor(const std::string& name, const std::string& format) const {
+    const char* ext = ChunkStore::kManifestExtension;
+    if (format != "dedup") {
+        ext = ".zip";
+        for (const auto& f : archiveFormats()) {
+            if (format == f.name) ext = f.extension;
+        }
+    }
+    return (fs::path(m_backupDir) / (name + ext)).string();
+}
+
+} // namespace bik
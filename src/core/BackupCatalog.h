@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace bik {
+
+struct BackupInfo {
+    std::string name;
+    std::string path;
+    std::string format;         // "zip", "native", "link" or "dedup"
+    std::time_t timestamp;
+    size_t size;                // bytes the backup added to the backup directory
+    uint64_t originalSize = 0;  // bytes of the files it holds
+    uint64_t fileCount = 0;
+};
+
+// Catalog of the backups in a backup directory, kept in
+// <backupDir>/catalog.txt so listing and auto-naming read one small file
+// instead of scanning and stat-ing every archive. bik updates it whenever it
+// creates or deletes a backup; a missing catalog is rebuilt from a scan.
+class BackupCatalog {
+public:
+    explicit BackupCatalog(const std::string& backupDir);
+
+    // Read the catalog, rebuilding (and saving) it if it is missing
+    bool load();
+    // Rewrite the catalog atomically
+    bool save() const;
+
+    // Add or replace the entry for info.name as the newest backup
+    void add(const BackupInfo& info);
+    void remove(const std::string& name);
+    void clear();
+
+    // Newest first
+    const std::vector<BackupInfo>& backups() const;
+
+    // Next N for an auto-generated <baseName>-backup-N name
+    int nextNumber(const std::string& baseName) const;
+
+    // Fill originalSize and fileCount of info from the backup file itself
+    static bool describe(BackupInfo& info);
+
+    static const char* const kFileName;
+
+private:
+    bool rebuild();
+    std::string pathFor(const std::string& name, const std::string& format) const;
+
+    std::string m_backupDir;
+    std::vector<BackupInfo> m_backups;
+};
+
+} // namespace bik
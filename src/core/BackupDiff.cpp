@@ -0,0 +1,213 @@
+#include "core/BackupDiff.h"
+#include "core/Archive.h"
+#include "core/ChunkStore.h"
+#include "core/DirWalker.h"
+#include "core/FileIndex.h"
+#include "core/IgnoreMatcher.h"
+#include "core/Stats.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <system_error>
+#include <unordered_map>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+// One file as a backup records it
+struct Recorded {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    uint32_t crc = 0;
+    bool hasCrc = false;                // dedup manifests have chunk hashes instead
+    std::vector<std::string> chunks;
+};
+
+using Listing = std::unordered_map<std::string, Recorded>;
+
+bool is_manifest(const std::string& path) {
+    return fs::path(path).extension() == ChunkStore::kManifestExtension;
+}
+
+bool load_listing(const std::string& path, Listing& files) {
+    if (is_manifest(path)) {
+        std::vector<ManifestEntry> entries;
+        if (!ChunkStore::loadManifest(path, entries)) {
+            std::cerr << "Error: cannot read manifest " << path << std::endl;
+            return false;
+        }
+        for (auto& e : entries) {
+            Recorded r;
+            r.size = e.size;
+            r.mtimeNs = e.mtimeNs;
+            r.chunks = std::move(e.chunks);
+            files[e.path] = std::move(r);
+        }
+        return true;
+    }
+
+    std::unique_ptr<ArchiveReader> reader = ArchiveReader::open(path);
+    std::vector<ZipEntryInfo> entries;
+    if (!reader || !reader->list(entries)) {
+        std::cerr << "Error: Cannot read backup: " << path << std::endl;
+        return false;
+    }
+    for (const auto& e : entries) {
+        // Zip directory entries hold no file
+        if (e.name.empty() || e.name.back() == '/') continue;
+        Recorded r;
+        r.size = e.size;
+        r.mtimeNs = e.mtimeNs;
+        r.crc = e.crc;
+        r.hasCrc = true;
+        files[e.name] = std::move(r);
+    }
+    return true;
+}
+
+// Same contents, as far as the two records can tell
+bool same_contents(const Recorded& a, const Recorded& b) {
+    if (a.size != b.size) return false;
+    if (a.hasCrc && b.hasCrc) return a.crc == b.crc;
+    if (!a.hasCrc && !b.hasCrc) return a.chunks == b.chunks;
+    // A CRC against chunk hashes (dedup against another format): only the
+    // mtime is left to go by
+    return a.mtimeNs == b.mtimeNs;
+}
+
+void add_modified(BackupDiffResult& result, const std::string& path, uint64_t oldSize, uint64_t newSize) {
+    result.modified.push_back(path);
+    result.modifiedOldBytes += oldSize;
+    result.modifiedNewBytes += newSize;
+}
+
+// Whatever is left in before was removed
+void finish(const Listing& before, BackupDiffResult& result) {
+    for (const auto& f : before) {
+        result.removed.push_back(f.first);
+        result.removedBytes += f.second.size;
+    }
+    std::sort(result.added.begin(), result.added.end());
+    std::sort(result.removed.begin(), result.removed.end());
+    std::sort(result.modified.begin(), result.modified.end());
+}
+
+} // namespace
+
+bool BackupDiff::compare(const std::string& fromPath, const std::string& toPath, BackupDiffResult& result) {
+    Stats::Phase phase("diff");
+    Listing before;
+    Listing after;
+    if (!load_listing(fromPath, before) || !load_listing(toPath, after)) return false;
+
+    for (const auto& f : after) {
+        auto it = before.find(f.first);
+        if (it == before.end()) {
+            result.added.push_back(f.first);
+            result.addedBytes += f.second.size;
+            continue;
+        }
+        if (same_contents(it->second, f.second)) result.unchanged++;
+        else add_modified(result, f.first, it->second.size, f.second.size);
+        before.erase(it);
+    }
+    finish(before, result);
+    return true;
+}
+
+bool BackupDiff::compareWorkingTree(const std::string& backupPath, const std::string& projectDir,
+                                    IgnoreMatcher* ignore, const FileIndex* index, BackupDiffResult& result) {
+    Stats::Phase phase("diff");
+    Listing recorded;
+    if (!load_listing(backupPath, recorded)) return false;
+
+    // dedup backups store a symlink to a file as the file; the others keep the link
+    bool dedup = is_manifest(backupPath);
+    bool indexApplies = false;
+    if (index && !index->archive().empty()) {
+        std::error_code ec1, ec2;
+        indexApplies = fs::weakly_canonical(index->archive(), ec1) == fs::weakly_canonical(backupPath, ec2)
+            && !ec1 && !ec2;
+    }
+
+    fs::path source = fs::absolute(projectDir);
+    bool ok = true;
+    DirWalker walker(source.string());
+    bool walked = walker.walk([&](const std::string& rel, DirWalker::Type type) {
+        if (rel == ".bik" || (ignore && !ignore->admit(source.string(), rel, type == DirWalker::Type::Directory))) {
+            return DirWalker::Visit::Skip;
+        }
+        std::string abs = walker.absolutePath(rel);
+        bool link = type == DirWalker::Type::Symlink && !dedup;
+        if (type != DirWalker::Type::File && !link
+            && !(type == DirWalker::Type::Symlink && fs::is_regular_file(abs))) {
+            return DirWalker::Visit::Continue;
+        }
+
+        // A link's data is its target, as the archive formats store it
+        FileIndexEntry current;
+        current.path = rel;
+        uint32_t linkCrc = 0;
+        if (link) {
+            std::error_code linkEc;
+            std::string target = fs::read_symlink(abs, linkEc).string();
+            if (linkEc) {
+                std::cerr << "Error: cannot read " << abs << std::endl;
+                ok = false;
+                return DirWalker::Visit::Stop;
+            }
+            current.size = target.size();
+            linkCrc = static_cast<uint32_t>(
+                crc32(0L, reinterpret_cast<const Bytef*>(target.data()), static_cast<uInt>(target.size())));
+        } else if (!FileIndex::statFile(abs, current)) {
+            std::cerr << "Error: cannot read " << abs << std::endl;
+            ok = false;
+            return DirWalker::Visit::Stop;
+        }
+
+        auto it = recorded.find(rel);
+        if (it == recorded.end()) {
+            result.added.push_back(rel);
+            result.addedBytes += current.size;
+            return DirWalker::Visit::Continue;
+        }
+        const Recorded& old = it->second;
+        bool same;
+        if (current.size != old.size) {
+            same = false;
+        } else if (link) {
+            same = old.hasCrc && old.crc == linkCrc;
+        } else if (current.mtimeNs == old.mtimeNs) {
+            same = true;
+        } else if (indexApplies && old.hasCrc && index->find(rel) && index->isUnchanged(current)) {
+            same = index->find(rel)->crc == old.crc;
+        } else {
+            // Same size, other mtime: only the contents can tell
+            Stats::Span span("hash", rel);
+            Stats::add(Stats::Counter::BytesRead, current.size);
+            result.hashed++;
+            if (old.hasCrc) {
+                uint32_t crc = 0;
+                same = ZipUtils::fileCrc32(abs, crc) && crc == old.crc;
+            } else {
+                std::vector<std::string> chunks;
+                same = ChunkStore::hashFile(abs, chunks) && chunks == old.chunks;
+            }
+        }
+        if (same) result.unchanged++;
+        else add_modified(result, rel, old.size, current.size);
+        recorded.erase(it);
+        return DirWalker::Visit::Continue;
+    });
+    if (!walked || !ok) return false;
+
+    finish(recorded, result);
+    return true;
+}
+
+} // namespace bik
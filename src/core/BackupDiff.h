@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bik {
+
+class FileIndex;
+class IgnoreMatcher;
+
+// Paths that differ between two backups, or between a backup and the
+// project directory; each list is sorted
+struct BackupDiffResult {
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    std::vector<std::string> modified;
+    uint64_t addedBytes = 0;
+    uint64_t removedBytes = 0;
+    uint64_t modifiedOldBytes = 0;
+    uint64_t modifiedNewBytes = 0;
+    size_t unchanged = 0;
+    size_t hashed = 0;          // working-tree files whose contents had to be read
+};
+
+// Compares backups by metadata alone. Every format records each file's path,
+// size and mtime, plus its CRC32 (zip central directory, native index, link
+// manifest) or its chunk hashes (dedup manifest), where they can be read
+// without decompressing any data. A file counts as modified when its
+// contents differ, not merely its mtime.
+class BackupDiff {
+public:
+    // Diff two backups, given as archive or manifest paths
+    static bool compare(const std::string& fromPath, const std::string& toPath, BackupDiffResult& result);
+
+    // Diff a backup with the files under projectDir. Files whose size and
+    // mtime match the backup are taken as unchanged without being read; a
+    // file of the same size with another mtime is hashed, unless index
+    // describes this backup and the file's stat still matches it.
+    static bool compareWorkingTree(const std::string& backupPath, const std::string& projectDir,
+                                   IgnoreMatcher* ignore, const FileIndex* index, BackupDiffResult& result);
+};
+
+} // namespace bik
@@ -1,24 +1,69 @@
 #include "core/BackupManager.h"
+#include "core/Archive.h"
+#include "core/BackupDiff.h"
+#include "core/ChangeJournal.h"
+#include "core/ChunkStore.h"
+#include "core/DirWalker.h"
+#include "core/FileIndex.h"
+#include "core/FileMeta.h"
+#include "core/FileWriter.h"
+#include "core/Glob.h"
+#include "core/IgnoreMatcher.h"
+#include "core/LinkSnapshot.h"
+#include "core/ParallelCompressor.h"
 #include "core/ProjectConfig.h"
+#include "core/Stats.h"
+#include "core/StreamArchive.h"
 #include "core/ZipUtils.h"
+#include "core/ZstdDictionary.h"
 #include <filesystem>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iomanip>
+#include <memory>
+#include <set>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace fs = std::filesystem;
 
 namespace bik {
 
-BackupManager::BackupManager() : m_initialized(false) {
+// Backups are either archives (zip, native, link snapshot directories) or
+// chunk store manifests
+static bool isBackupFile(const fs::path& path) {
+    return !archiveFormatFor(path.extension().string()).empty()
+        || path.extension() == ChunkStore::kManifestExtension;
+}
+
+// "12.3 MB in 0.4 s (30.8 MB/s)"
+static std::string describeThroughput(uint64_t bytes, double seconds) {
+    double mb = bytes / (1024.0 * 1024.0);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << mb << " MB in " << std::setprecision(2) << seconds << " s";
+    if (seconds > 0) out << " (" << std::setprecision(1) << mb / seconds << " MB/s)";
+    return out.str();
+}
+
+BackupManager::BackupManager()
+    : m_format("zip"), m_codec(Codec::Deflate), m_level(0), m_longDistance(false),
+      m_deltaMinSize(0), m_deltaMaxChain(8), m_dictionaryId(0), m_initialized(false) {
     loadConfig();
 }
 
 BackupManager::~BackupManager() {
 }
 
-bool BackupManager::initProject(const std::string& backupDir, const std::string& projectDir) {
+bool BackupManager::initProject(const std::string& backupDir, const std::string& projectDir,
+                                const std::string& format) {
+    if (format != "dedup" && !ArchiveWriter::create(format)) {
+        std::cerr << "Error: Unknown backup format: " << format << " (expected zip, native, link or dedup)" << std::endl;
+        return false;
+    }
+    
     try {
         // Resolve paths
         fs::path projPath = fs::absolute(projectDir);
@@ -37,6 +82,7 @@ bool BackupManager::initProject(const std::string& backupDir, const std::string&
         m_projectDir = projPath.string();
         m_backupDir = backupPath.string();
         m_projectName = projPath.filename().string();
+        m_format = format;
         m_initialized = true;
         
         return saveConfig();
@@ -46,25 +92,178 @@ bool BackupManager::initProject(const std::string& backupDir, const std::string&
     }
 }
 
-bool BackupManager::createBackup(const std::string& name) {
+// An explicit codec or level is used for this backup; changed is set when it
+// should become the project default, which keepCodecOptions does only once
+// the backup worked (the backend may not support the codec at all)
+bool BackupManager::applyCodecOptions(const BackupOptions& options, bool& changed) {
+    changed = false;
+    if (options.codec.empty() && options.level == 0 && !options.longDistance) {
+        return true;
+    }
+    Codec codec = m_codec;
+    if (!options.codec.empty()) {
+        if (!parseCodec(options.codec, codec)) {
+            std::cerr << "Error: Unknown codec: " << options.codec << " (expected deflate or zstd)" << std::endl;
+            return false;
+        }
+        // Naming the codec resets long-distance matching unless asked for again
+        m_longDistance = options.longDistance;
+        if (codec != m_codec && options.level == 0) m_level = 0;
+    } else if (options.longDistance) {
+        m_longDistance = true;
+    }
+    if (options.level != 0 && !codecLevelValid(codec, options.level)) {
+        std::cerr << "Error: Level " << options.level << " is out of range for " << codecName(codec)
+                  << (codec == Codec::Zstd ? " (1-22)" : " (1-9)") << std::endl;
+        return false;
+    }
+    m_codec = codec;
+    if (options.level != 0) m_level = options.level;
+    changed = true;
+    return true;
+}
+
+void BackupManager::keepCodecOptions() {
+    if (!saveConfig()) {
+        std::cerr << "Warning: Could not save the codec options as the project default" << std::endl;
+    }
+}
+
+bool BackupManager::createBackup(const std::string& name, const BackupOptions& options) {
     if (!m_initialized) {
         std::cerr << "Error: Project not initialized. Use 'bik project -b <backup_dir>' first." << std::endl;
         return false;
     }
     
+    bool codecChanged = false;
+    if (!applyCodecOptions(options, codecChanged)) {
+        return false;
+    }
+    
     try {
+        Stats::Phase phase("backup");
         std::string backupName = name.empty() ? generateBackupName(m_projectName) : name;
-        fs::path zipPath = fs::path(m_backupDir) / (backupName + ".zip");
+        
+        if (m_format == "dedup") {
+            fs::path manifestPath = fs::path(m_backupDir) / (backupName + ChunkStore::kManifestExtension);
+            
+            std::cout << "Creating backup: " << backupName << std::endl;
+            std::cout << "Source: " << m_projectDir << std::endl;
+            std::cout << "Destination: " << manifestPath << std::endl;
+            
+            // Files unchanged since the newest snapshot reuse its chunk lists
+            std::string previous;
+            if (!options.full) {
+                for (const auto& info : listBackups()) {
+                    if (info.format == "dedup") { previous = info.path; break; }
+                }
+            }
+            
+            // With `bik watch` running, only the paths it recorded are looked at
+            ChangeJournal journal(m_projectDir);
+            ChangeSet changes;
+            bool useJournal = journal.consume(previous, changes);
+            if (useJournal) {
+                std::cout << "Change journal: " << changes.size() << " changed path(s)" << std::endl;
+            }
+            
+            IgnoreMatcher ignore;
+            ignore.enterDirectory(m_projectDir, "");
+            ChunkStore store(m_backupDir);
+            if (!store.createSnapshot(m_projectDir, manifestPath.string(), previous, &ignore,
+                                      useJournal ? &changes : nullptr)) {
+                journal.markRescan();
+                std::cerr << "Error: Failed to create backup" << std::endl;
+                return false;
+            }
+            journal.commit(manifestPath.string());
+            
+            BackupInfo info;
+            info.name = backupName;
+            info.path = manifestPath.string();
+            info.format = "dedup";
+            BackupCatalog::describe(info);
+            recordBackup(info);
+            if (codecChanged) keepCodecOptions();
+            std::cout << "Backup created successfully!" << std::endl;
+            return true;
+        }
+        
+        std::unique_ptr<ArchiveWriter> writer = ArchiveWriter::create(m_format);
+        if (!writer) {
+            std::cerr << "Error: Unknown backup format: " << m_format << std::endl;
+            return false;
+        }
+        fs::path archivePath = fs::path(m_backupDir) / (backupName + writer->extension());
         
         std::cout << "Creating backup: " << backupName << std::endl;
         std::cout << "Source: " << m_projectDir << std::endl;
-        std::cout << "Destination: " << zipPath << std::endl;
+        std::cout << "Destination: " << archivePath << std::endl;
+        
+        // Unchanged files are copied from the archive the index describes,
+        // as long as it is in the format being written
+        FileIndex index;
+        IgnoreMatcher ignore;
+        ignore.enterDirectory(m_projectDir, "");
+        ZipOptions zipOptions;
+        zipOptions.index = &index;
+        zipOptions.ignore = &ignore;
+        zipOptions.jobs = options.jobs;
+        zipOptions.policy = &m_policy;
+        zipOptions.codec = m_codec;
+        zipOptions.level = m_level;
+        zipOptions.longDistance = m_longDistance;
+        zipOptions.deltaMinSize = m_deltaMinSize;
+        zipOptions.deltaMaxChain = m_deltaMaxChain;
+        std::string dictionary;
+        if (m_dictionaryId != 0 && m_format == "native") {
+            if (!ParallelCompressor::supportsZstd()) {
+                std::cerr << "Warning: bik was built without libzstd; not using the zstd dictionary" << std::endl;
+            } else if (!ZstdDictionary::load(m_backupDir, m_dictionaryId, dictionary)) {
+                std::cerr << "Warning: zstd dictionary " << ZstdDictionary::pathFor(m_backupDir, m_dictionaryId)
+                          << " is missing; run 'bik dict' to train a new one" << std::endl;
+            } else {
+                zipOptions.dictionary = &dictionary;
+            }
+        }
+        if (!options.full && index.load(getIndexPath()) && fs::exists(index.archive())
+            && fs::path(index.archive()).extension() == writer->extension()) {
+            zipOptions.baseZipPath = index.archive();
+        }
         
-        if (!ZipUtils::createZip(m_projectDir, zipPath.string())) {
+        // With `bik watch` running, only the paths it recorded are looked at
+        ChangeJournal journal(m_projectDir);
+        ChangeSet changes;
+        if (journal.consume(zipOptions.baseZipPath, changes)) {
+            std::cout << "Change journal: " << changes.size() << " changed path(s)" << std::endl;
+            zipOptions.changes = &changes;
+        }
+        
+        if (!writer->write(m_projectDir, archivePath.string(), zipOptions)) {
+            journal.markRescan();
             std::cerr << "Error: Failed to create backup" << std::endl;
             return false;
         }
+        journal.commit(index.archive());
+        
+        {
+            Stats::Phase indexPhase("index.save");
+            if (!index.save(getIndexPath())) {
+                std::cerr << "Warning: Failed to save file index" << std::endl;
+            }
+        }
         
+        // The new index already knows every file the archive holds
+        BackupInfo info;
+        info.name = backupName;
+        info.path = archivePath.string();
+        info.format = m_format;
+        for (const auto& pair : index.entries()) {
+            info.originalSize += pair.second.size;
+            info.fileCount++;
+        }
+        recordBackup(info);
+        if (codecChanged) keepCodecOptions();
         std::cout << "Backup created successfully!" << std::endl;
         return true;
     } catch (const std::exception& e) {
@@ -73,100 +272,391 @@ bool BackupManager::createBackup(const std::string& name) {
     }
 }
 
-std::vector<BackupInfo> BackupManager::listBackups() const {
-    std::vector<BackupInfo> backups;
+bool BackupManager::createBackupStream(std::ostream& out, const BackupOptions& options) {
+    if (!m_initialized) {
+        std::cerr << "Error: Project not initialized. Use 'bik project -b <backup_dir>' first." << std::endl;
+        return false;
+    }
     
-    if (!m_initialized || !fs::exists(m_backupDir)) {
-        return backups;
+    bool codecChanged = false;
+    if (!applyCodecOptions(options, codecChanged)) {
+        return false;
     }
     
     try {
-        for (const auto& entry : fs::directory_iterator(m_backupDir)) {
-            if (entry.is_regular_file() && entry.path().extension() == ".zip") {
-                BackupInfo info;
-                info.name = entry.path().stem().string();
-                info.path = entry.path().string();
-                
-                auto ftime = fs::last_write_time(entry.path());
-                auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-                    ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
-                info.timestamp = std::chrono::system_clock::to_time_t(sctp);
-                
-                info.size = fs::file_size(entry.path());
-                backups.push_back(info);
-            }
-        }
+        Stats::Phase phase("backup");
+        // stdout carries the data; progress goes to stderr
+        std::cerr << "Streaming backup of " << m_projectDir << std::endl;
         
-        // Sort by timestamp (newest first)
-        std::sort(backups.begin(), backups.end(), 
-                 [](const BackupInfo& a, const BackupInfo& b) {
-                     return a.timestamp > b.timestamp;
-                 });
+        // Always a full backup: the previous one is wherever the stream went
+        IgnoreMatcher ignore;
+        ignore.enterDirectory(m_projectDir, "");
+        StreamOptions streamOptions;
+        streamOptions.jobs = options.jobs;
+        streamOptions.policy = &m_policy;
+        streamOptions.codec = m_codec;
+        streamOptions.level = m_level;
+        streamOptions.longDistance = m_longDistance;
+        streamOptions.ignore = &ignore;
+        streamOptions.spillDir = (fs::path(m_projectDir) / ".bik").string();
+        if (!StreamArchive::write(m_projectDir, out, streamOptions)) {
+            std::cerr << "Error: Failed to create backup" << std::endl;
+            return false;
+        }
+        if (codecChanged) keepCodecOptions();
+        std::cerr << "Backup streamed successfully!" << std::endl;
+        return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error listing backups: " << e.what() << std::endl;
+        std::cerr << "Error creating backup: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+std::vector<BackupInfo> BackupManager::listBackups() const {
+    if (!m_initialized || !fs::exists(m_backupDir)) {
+        return std::vector<BackupInfo>();
     }
     
-    return backups;
+    BackupCatalog catalog(m_backupDir);
+    catalog.load();
+    return catalog.backups();
 }
 
-bool BackupManager::loadBackup(const std::string& name) {
+bool BackupManager::loadBackup(const std::string& name, const RestoreOptions& options) {
     if (!m_initialized) {
         std::cerr << "Error: Project not initialized." << std::endl;
         return false;
     }
     
     try {
-        fs::path zipPath = fs::path(m_backupDir) / (name + ".zip");
+        std::string backupPath = findBackupPath(name);
         
-        if (!fs::exists(zipPath)) {
+        if (backupPath.empty()) {
             std::cerr << "Error: Backup not found: " << name << std::endl;
             return false;
         }
         
         std::cout << "Loading backup: " << name << std::endl;
         std::cout << "This will replace current directory contents." << std::endl;
-        std::cout << "Continue? (y/n): ";
+        if (!options.assumeYes) {
+            std::cout << "Continue? (y/n): ";
+            
+            std::string response;
+            std::getline(std::cin, response);
+            
+            if (response != "y" && response != "Y") {
+                std::cout << "Cancelled." << std::endl;
+                return false;
+            }
+        }
         
-        std::string response;
-        std::getline(std::cin, response);
+        Stats::Phase phase("restore");
         
-        if (response != "y" && response != "Y") {
-            std::cout << "Cancelled." << std::endl;
+        // Archives are restored in place, touching only what differs
+        bool restored = fs::path(backupPath).extension() != ChunkStore::kManifestExtension
+            ? restoreArchiveInPlace(backupPath, options)
+            : restoreViaTemp(backupPath, options);
+        if (!restored) {
+            std::cerr << "Error: Failed to extract backup" << std::endl;
             return false;
         }
         
-        // Create temporary directory
-        fs::path tempDir = fs::temp_directory_path() / ("bik_restore_" + std::to_string(std::time(nullptr)));
-        fs::create_directories(tempDir);
+        // One durability barrier for the whole restore
+        Stats::Phase syncPhase("sync");
+        if (!FileWriter::syncFilesystem(m_projectDir)) {
+            std::cerr << "Warning: Failed to flush restored files to disk" << std::endl;
+        }
         
-        // Extract to temp
-        if (!ZipUtils::extractZip(zipPath.string(), tempDir.string())) {
-            std::cerr << "Error: Failed to extract backup" << std::endl;
-            fs::remove_all(tempDir);
+        std::cout << "Backup loaded successfully!" << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading backup: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool BackupManager::restoreViaTemp(const std::string& backupPath, const RestoreOptions& options) {
+    // Stage inside .bik so the tree lands on the project's filesystem and
+    // can be moved into place with renames instead of a second full copy
+    fs::path tempDir = fs::path(m_projectDir) / ".bik" / ("restore-" + std::to_string(std::time(nullptr)));
+    fs::create_directories(tempDir);
+    
+    // Extract to temp
+    if (!extractBackup(backupPath, tempDir.string(), options)) {
+        fs::remove_all(tempDir);
+        return false;
+    }
+    
+    // Remove current directory contents (except .bik config, and ignored
+    // top-level entries the backup does not replace)
+    IgnoreMatcher ignore;
+    ignore.enterDirectory(m_projectDir, "");
+    {
+        Stats::Phase phase("restore.clear");
+        for (const auto& entry : fs::directory_iterator(m_projectDir)) {
+            std::string name = entry.path().filename().string();
+            if (name == ".bik") continue;
+            if (ignore.ignored(name, entry.is_directory() && !entry.is_symlink()) && !fs::exists(tempDir / name)) {
+                continue;
+            }
+            fs::remove_all(entry.path());
+        }
+    }
+    
+    // Move from temp to project dir
+    Stats::Phase phase("restore.move");
+    bool ok = true;
+    for (const auto& entry : fs::directory_iterator(tempDir)) {
+        if (!moveIntoPlace(entry.path(), fs::path(m_projectDir) / entry.path().filename())) {
+            std::cerr << "Error: Failed to move " << entry.path() << " into the project" << std::endl;
+            ok = false;
+        }
+    }
+    
+    // Clean up temp
+    fs::remove_all(tempDir);
+    return ok;
+}
+
+bool BackupManager::moveIntoPlace(const fs::path& from, const fs::path& to) {
+    std::error_code ec;
+    fs::rename(from, to, ec);
+    if (!ec) {
+        return true;
+    }
+    
+    // Different filesystem (.bik mounted elsewhere): copy file by file,
+    // letting the kernel clone or copy the data
+    if (fs::is_symlink(from) || !fs::is_directory(from)) {
+        FileMeta meta;
+        if (!FileMeta::read(from.string(), meta)) return false;
+        if (meta.symlink) {
+            fs::create_symlink(meta.linkTarget, to, ec);
+            return !ec;
+        }
+        if (!FileWriter::copyFile(from.string(), to.string())) return false;
+        meta.apply(to.string());
+        return true;
+    }
+    fs::create_directories(to, ec);
+    bool ok = !ec;
+    for (const auto& entry : fs::directory_iterator(from)) {
+        ok = moveIntoPlace(entry.path(), to / entry.path().filename()) && ok;
+    }
+    return ok;
+}
+
+bool BackupManager::restoreArchiveInPlace(const std::string& archivePath, const RestoreOptions& options) {
+    std::unique_ptr<ArchiveReader> reader = ArchiveReader::open(archivePath);
+    std::vector<ZipEntryInfo> entries;
+    if (!reader || !reader->list(entries)) {
+        return false;
+    }
+    
+    // Files the archive wants, and every directory they live in
+    std::unordered_map<std::string, const ZipEntryInfo*> wanted;
+    std::unordered_set<std::string> neededDirs;
+    for (const auto& e : entries) {
+        if (e.name.empty() || e.name.back() == '/') continue;
+        wanted[e.name] = &e;
+        for (fs::path dir = fs::path(e.name).parent_path(); !dir.empty(); dir = dir.parent_path()) {
+            if (!neededDirs.insert(dir.generic_string()).second) break;
+        }
+    }
+    
+    // The stat index lets files untouched since the last backup skip hashing
+    FileIndex index;
+    index.load(getIndexPath());
+    
+    // Ignored paths the archive does not hold (build output, dependencies)
+    // are neither compared nor deleted
+    IgnoreMatcher ignore;
+    ignore.enterDirectory(m_projectDir, "");
+    
+    std::vector<std::string> extra;
+    std::unordered_set<std::string> unchanged;
+    bool indexDirty = false;
+    
+    DirWalker walker(m_projectDir);
+    bool walked;
+    {
+        Stats::Phase phase("restore.compare");
+        walked = walker.walk([&](const std::string& rel, DirWalker::Type type) {
+            if (rel == ".bik") {
+                return DirWalker::Visit::Skip;
+            }
+            std::string path = walker.absolutePath(rel);
+        
+            if (type == DirWalker::Type::Directory) {
+                if (!neededDirs.count(rel)) {
+                    if (!ignore.ignored(rel, true)) extra.push_back(path);
+                    return DirWalker::Visit::Skip;
+                }
+                ignore.enterDirectory(path, rel);
+                return DirWalker::Visit::Continue;
+            }
+        
+            auto w = wanted.find(rel);
+            if (w == wanted.end()) {
+                if (!ignore.ignored(rel, false)) extra.push_back(path);
+                return DirWalker::Visit::Continue;
+            }
+            if (type != DirWalker::Type::File) return DirWalker::Visit::Continue;
+        
+            const ZipEntryInfo& want = *w->second;
+            FileIndexEntry current;
+            current.path = rel;
+            Stats::add(Stats::Counter::FilesScanned);
+            if (!FileIndex::statFile(path, current) || current.size != want.size) return DirWalker::Visit::Continue;
+        
+            const FileIndexEntry* indexed = index.find(rel);
+            uint32_t crc = 0;
+            if (index.isUnchanged(current)) {
+                crc = indexed->crc;
+            } else if (!ZipUtils::fileCrc32(path, crc)) {
+                return DirWalker::Visit::Continue;
+            }
+            if (crc == want.crc) {
+                unchanged.insert(rel);
+            
+                // Same content: only bring mode and mtime back in line
+                FileMeta meta;
+                if (want.mode != 0) meta.setMode(want.mode);
+                meta.mtimeNs = want.mtimeNs;
+                FileMeta have;
+                if (FileMeta::read(path, have)
+                    && ((meta.mtimeNs != 0 && have.mtimeNs != meta.mtimeNs)
+                        || (meta.mode != 0 && (have.mode & 07777) != (meta.mode & 07777)))) {
+                    meta.apply(path);
+                    if (FileIndex::statFile(path, current)) {
+                        current.crc = crc;
+                        index.set(current);
+                        indexDirty = true;
+                    }
+                }
+            }
+            return DirWalker::Visit::Continue;
+        });
+    }
+    if (!walked) {
+        return false;
+    }
+    
+    {
+        Stats::Phase phase("restore.remove");
+        for (const auto& path : extra) {
+            fs::remove_all(path);
+        }
+    }
+    
+    std::unordered_set<std::string> changed;
+    for (const auto& pair : wanted) {
+        if (!unchanged.count(pair.first)) changed.insert(pair.first);
+    }
+    
+    if (!changed.empty()) {
+        ExtractOptions extractOptions;
+        extractOptions.jobs = options.jobs;
+        extractOptions.only = &changed;
+        extractOptions.replaceAtomically = true;
+        if (!reader->extract(m_projectDir, extractOptions)) {
             return false;
         }
         
-        // Remove current directory contents (except .bik config)
-        for (const auto& entry : fs::directory_iterator(m_projectDir)) {
-            if (entry.path().filename() != ".bik") {
-                fs::remove_all(entry.path());
+        // Rewritten files now match the archive; record them so the next
+        // backup and restore can trust their stat again
+        for (const auto& rel : changed) {
+            FileIndexEntry restored;
+            restored.path = rel;
+            if (FileIndex::statFile(walker.absolutePath(rel), restored)) {
+                restored.crc = wanted[rel]->crc;
+                index.set(restored);
             }
         }
+        indexDirty = true;
+    }
+    if (indexDirty) {
+        Stats::Phase phase("index.save");
+        index.save(getIndexPath());
+    }
+    
+    std::cout << "Restored " << changed.size() << " file(s), removed " << extra.size()
+              << " path(s), kept " << unchanged.size() << " unchanged file(s)" << std::endl;
+    return true;
+}
+
+bool BackupManager::loadLastBackup(const RestoreOptions& options) {
+    auto backups = listBackups();
+    if (backups.empty()) {
+        std::cerr << "Error: No backups found" << std::endl;
+        return false;
+    }
+    
+    return loadBackup(backups[0].name, options);
+}
+
+bool BackupManager::loadBackupStream(std::istream& in, const RestoreOptions& options) {
+    if (!m_initialized) {
+        std::cerr << "Error: Project not initialized." << std::endl;
+        return false;
+    }
+    
+    try {
+        Stats::Phase phase("restore");
+        // stdin carries the data, so there is no confirmation prompt
+        std::cerr << "Restoring " << m_projectDir << " from the backup stream" << std::endl;
         
-        // Copy from temp to project dir
-        for (const auto& entry : fs::directory_iterator(tempDir)) {
-            fs::path dest = fs::path(m_projectDir) / entry.path().filename();
-            if (entry.is_directory()) {
-                fs::copy(entry.path(), dest, fs::copy_options::recursive);
-            } else {
-                fs::copy(entry.path(), dest);
+        ExtractOptions extractOptions;
+        extractOptions.jobs = options.jobs;
+        extractOptions.replaceAtomically = true;
+        std::unordered_set<std::string> names;
+        if (!StreamArchive::extract(in, m_projectDir, extractOptions, &names)) {
+            std::cerr << "Error: Failed to restore from the stream; nothing was removed" << std::endl;
+            return false;
+        }
+        
+        // The stream is complete: drop what it does not hold (except .bik
+        // and ignored paths), as a restore from the backup directory would
+        std::unordered_set<std::string> neededDirs;
+        for (const auto& name : names) {
+            for (fs::path dir = fs::path(name).parent_path(); !dir.empty(); dir = dir.parent_path()) {
+                if (!neededDirs.insert(dir.generic_string()).second) break;
+            }
+        }
+        IgnoreMatcher ignore;
+        ignore.enterDirectory(m_projectDir, "");
+        std::vector<std::string> extra;
+        DirWalker walker(m_projectDir);
+        walker.walk([&](const std::string& rel, DirWalker::Type type) {
+            if (rel == ".bik") {
+                return DirWalker::Visit::Skip;
+            }
+            if (type == DirWalker::Type::Directory) {
+                if (!neededDirs.count(rel)) {
+                    if (!ignore.ignored(rel, true)) extra.push_back(walker.absolutePath(rel));
+                    return DirWalker::Visit::Skip;
+                }
+                ignore.enterDirectory(walker.absolutePath(rel), rel);
+                return DirWalker::Visit::Continue;
+            }
+            if (!names.count(rel) && !ignore.ignored(rel, false)) {
+                extra.push_back(walker.absolutePath(rel));
+            }
+            return DirWalker::Visit::Continue;
+        });
+        {
+            Stats::Phase removePhase("restore.remove");
+            for (const auto& path : extra) {
+                fs::remove_all(path);
             }
         }
         
-        // Clean up temp
-        fs::remove_all(tempDir);
+        Stats::Phase syncPhase("sync");
+        if (!FileWriter::syncFilesystem(m_projectDir)) {
+            std::cerr << "Warning: Failed to flush restored files to disk" << std::endl;
+        }
         
-        std::cout << "Backup loaded successfully!" << std::endl;
+        std::cerr << "Restored " << names.size() << " path(s), removed " << extra.size() << " path(s)" << std::endl;
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Error loading backup: " << e.what() << std::endl;
@@ -174,14 +664,91 @@ bool BackupManager::loadBackup(const std::string& name) {
     }
 }
 
-bool BackupManager::loadLastBackup() {
-    auto backups = listBackups();
-    if (backups.empty()) {
-        std::cerr << "Error: No backups found" << std::endl;
+bool BackupManager::restoreFiles(const std::string& name, const std::vector<std::string>& patterns,
+                                 const std::string& destDir, const RestoreOptions& options) {
+    if (!m_initialized) {
+        std::cerr << "Error: Project not initialized." << std::endl;
         return false;
     }
     
-    return loadBackup(backups[0].name);
+    try {
+        std::string backupPath = findBackupPath(name);
+        if (backupPath.empty()) {
+            std::cerr << "Error: Backup not found: " << name << std::endl;
+            return false;
+        }
+        std::unique_ptr<ArchiveReader> reader;
+        if (fs::path(backupPath).extension() != ChunkStore::kManifestExtension) {
+            reader = ArchiveReader::open(backupPath);
+            if (!reader) {
+                std::cerr << "Error: Cannot read backup: " << backupPath << std::endl;
+                return false;
+            }
+        }
+        
+        // Only the archive index / manifest is read to pick the entries
+        std::vector<std::string> names;
+        if (reader) {
+            std::vector<ZipEntryInfo> entries;
+            if (!reader->list(entries)) {
+                std::cerr << "Error: Cannot read backup: " << backupPath << std::endl;
+                return false;
+            }
+            for (const auto& e : entries) {
+                if (!e.name.empty() && e.name.back() != '/') names.push_back(e.name);
+            }
+        } else {
+            std::vector<ManifestEntry> entries;
+            if (!ChunkStore::loadManifest(backupPath, entries)) {
+                std::cerr << "Error: Cannot read backup: " << backupPath << std::endl;
+                return false;
+            }
+            for (const auto& e : entries) {
+                names.push_back(e.path);
+            }
+        }
+        
+        std::unordered_set<std::string> selected;
+        for (const auto& pattern : patterns) {
+            size_t before = selected.size();
+            for (const auto& n : names) {
+                if (pathSelected(pattern, n)) selected.insert(n);
+            }
+            if (selected.size() == before) {
+                std::cerr << "Warning: Nothing in " << name << " matches " << pattern << std::endl;
+            }
+        }
+        if (selected.empty()) {
+            std::cerr << "Error: No files to restore" << std::endl;
+            return false;
+        }
+        
+        fs::path dest = destDir.empty() ? fs::path(m_projectDir) : fs::absolute(destDir);
+        bool restored;
+        if (reader) {
+            ExtractOptions extractOptions;
+            extractOptions.jobs = options.jobs;
+            extractOptions.only = &selected;
+            extractOptions.replaceAtomically = true;
+            restored = reader->extract(dest.string(), extractOptions);
+        } else {
+            ChunkStore store(m_backupDir);
+            restored = store.restoreSnapshot(backupPath, dest.string(), &selected);
+        }
+        if (!restored) {
+            std::cerr << "Error: Failed to restore files" << std::endl;
+            return false;
+        }
+        if (!FileWriter::syncFilesystem(dest.string())) {
+            std::cerr << "Warning: Failed to flush restored files to disk" << std::endl;
+        }
+        
+        std::cout << "Restored " << selected.size() << " file(s) from " << name << " to " << dest << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error restoring files: " << e.what() << std::endl;
+        return false;
+    }
 }
 
 bool BackupManager::cleanAllBackups() {
@@ -202,12 +769,21 @@ bool BackupManager::cleanAllBackups() {
         
         int count = 0;
         for (const auto& entry : fs::directory_iterator(m_backupDir)) {
-            if (entry.is_regular_file() && entry.path().extension() == ".zip") {
-                fs::remove(entry.path());
+            if ((entry.is_regular_file() || entry.is_directory()) && isBackupFile(entry.path())) {
+                fs::remove_all(entry.path());
                 count++;
             }
         }
         
+        // No manifests are left, so the whole chunk store is garbage
+        ChunkStore store(m_backupDir);
+        store.destroy();
+        
+        BackupCatalog catalog(m_backupDir);
+        if (!catalog.save()) {
+            std::cerr << "Warning: Failed to update backup catalog" << std::endl;
+        }
+        
         std::cout << "Deleted " << count << " backup(s)." << std::endl;
         return true;
     } catch (const std::exception& e) {
@@ -216,6 +792,189 @@ bool BackupManager::cleanAllBackups() {
     }
 }
 
+bool BackupManager::verifyBackup(const std::string& name, const RestoreOptions& options) {
+    if (!m_initialized) {
+        std::cerr << "Error: Project not initialized." << std::endl;
+        return false;
+    }
+    
+    std::string backupName = name;
+    if (backupName.empty()) {
+        auto backups = listBackups();
+        if (backups.empty()) {
+            std::cerr << "Error: No backups found" << std::endl;
+            return false;
+        }
+        backupName = backups[0].name;
+    }
+    std::string backupPath = findBackupPath(backupName);
+    if (backupPath.empty()) {
+        std::cerr << "Error: Backup not found: " << backupName << std::endl;
+        return false;
+    }
+    VerifyReport total;
+    return verifyBackupAt(backupName, backupPath, options, total);
+}
+
+bool BackupManager::verifyAllBackups(const RestoreOptions& options) {
+    if (!m_initialized) {
+        std::cerr << "Error: Project not initialized." << std::endl;
+        return false;
+    }
+    
+    auto backups = listBackups();
+    if (backups.empty()) {
+        std::cerr << "Error: No backups found" << std::endl;
+        return false;
+    }
+    
+    // Backups are verified one after another, each on every core
+    auto start = std::chrono::steady_clock::now();
+    VerifyReport total;
+    size_t failed = 0;
+    for (const auto& backup : backups) {
+        std::string backupPath = findBackupPath(backup.name);
+        if (backupPath.empty()) {
+            std::cout << "MISSING  " << backup.name << std::endl;
+            failed++;
+        } else if (!verifyBackupAt(backup.name, backupPath, options, total)) {
+            failed++;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Verified " << backups.size() << " backup(s), " << total.entries << " file(s), "
+              << describeThroughput(total.bytes, seconds) << std::endl;
+    if (failed > 0) {
+        std::cerr << "Error: " << failed << " backup(s) failed verification" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool BackupManager::verifyBackupAt(const std::string& name, const std::string& path, const RestoreOptions& options,
+                                   VerifyReport& total) {
+    auto start = std::chrono::steady_clock::now();
+    VerifyReport report;
+    bool intact = false;
+    try {
+        if (fs::path(path).extension() == ChunkStore::kManifestExtension) {
+            ChunkStore store(m_backupDir);
+            intact = store.verifySnapshot(path, options.jobs, report);
+        } else {
+            std::unique_ptr<ArchiveReader> reader = ArchiveReader::open(path);
+            intact = reader && reader->verify(options.jobs, report);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error verifying " << name << ": " << e.what() << std::endl;
+        intact = false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    total.entries += report.entries;
+    total.bytes += report.bytes;
+    total.corrupt.insert(total.corrupt.end(), report.corrupt.begin(), report.corrupt.end());
+    if (!intact && report.corrupt.empty()) {
+        std::cout << "UNREADABLE " << name << ": " << path << std::endl;
+        return false;
+    }
+    std::cout << (intact ? "OK       " : "CORRUPT  ") << name << ": " << report.entries << " file(s), "
+              << describeThroughput(report.bytes, seconds) << std::endl;
+    for (const auto& entry : report.corrupt) {
+        std::cout << "  corrupt: " << entry << std::endl;
+    }
+    return intact;
+}
+
+bool BackupManager::diffBackups(const std::string& from, const std::string& to, bool stat) {
+    if (!m_initialized) {
+        std::cerr << "Error: Project not initialized." << std::endl;
+        return false;
+    }
+    
+    std::string fromName = from;
+    if (fromName.empty()) {
+        auto backups = listBackups();
+        if (backups.empty()) {
+            std::cerr << "Error: No backups found" << std::endl;
+            return false;
+        }
+        fromName = backups[0].name;
+    }
+    std::string fromPath = findBackupPath(fromName);
+    std::string toPath = to.empty() ? "" : findBackupPath(to);
+    if (fromPath.empty() || (!to.empty() && toPath.empty())) {
+        std::cerr << "Error: Backup not found: " << (fromPath.empty() ? fromName : to) << std::endl;
+        return false;
+    }
+    
+    BackupDiffResult result;
+    try {
+        if (to.empty()) {
+            IgnoreMatcher ignore;
+            ignore.enterDirectory(m_projectDir, "");
+            FileIndex index;
+            index.load(getIndexPath());
+            if (!BackupDiff::compareWorkingTree(fromPath, m_projectDir, &ignore, &index, result)) {
+                return false;
+            }
+        } else if (!BackupDiff::compare(fromPath, toPath, result)) {
+            return false;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error comparing backups: " << e.what() << std::endl;
+        return false;
+    }
+    
+    for (const auto& path : result.added) std::cout << "A  " << path << "\n";
+    for (const auto& path : result.removed) std::cout << "D  " << path << "\n";
+    for (const auto& path : result.modified) std::cout << "M  " << path << "\n";
+    if (stat) {
+        double mb = 1024.0 * 1024.0;
+        std::cout << std::fixed << std::setprecision(1)
+                  << result.added.size() << " added (" << result.addedBytes / mb << " MB), "
+                  << result.removed.size() << " removed (" << result.removedBytes / mb << " MB), "
+                  << result.modified.size() << " modified (" << result.modifiedOldBytes / mb << " MB -> "
+                  << result.modifiedNewBytes / mb << " MB), " << result.unchanged << " unchanged";
+        if (result.hashed > 0) std::cout << "; " << result.hashed << " file(s) hashed";
+        std::cout << "\n";
+    } else if (result.added.empty() && result.removed.empty() && result.modified.empty()) {
+        std::cout << "No differences\n";
+    }
+    std::cout.flush();
+    return true;
+}
+
+bool BackupManager::trainDictionary() {
+    if (!m_initialized) {
+        std::cerr << "Error: Project not initialized." << std::endl;
+        return false;
+    }
+    
+    IgnoreMatcher ignore;
+    ignore.enterDirectory(m_projectDir, "");
+    uint32_t id = 0;
+    if (!ZstdDictionary::train(m_projectDir, m_backupDir, &ignore, id)) {
+        return false;
+    }
+    m_dictionaryId = id;
+    if (!saveConfig()) {
+        return false;
+    }
+    if (m_format != "native") {
+        std::cout << "Note: the dictionary is used by native backups only (bik project -f native)" << std::endl;
+    }
+    return true;
+}
+
+bool BackupManager::dropDictionary() {
+    if (!m_initialized) {
+        std::cerr << "Error: Project not initialized." << std::endl;
+        return false;
+    }
+    m_dictionaryId = 0;
+    return saveConfig();
+}
+
 bool BackupManager::wipeOldBackups() {
     if (!m_initialized) {
         std::cerr << "Error: Project not initialized." << std::endl;
@@ -224,12 +983,30 @@ bool BackupManager::wipeOldBackups() {
     
     try {
         auto backups = listBackups();
-        if (backups.size() <= 1) {
+        
+        // Keep the newest, and the archives its delta entries are rebuilt from
+        std::set<fs::path> kept;
+        std::vector<std::string> pending;
+        if (!backups.empty()) pending.push_back(backups[0].path);
+        while (!pending.empty()) {
+            fs::path path = fs::absolute(pending.back()).lexically_normal();
+            pending.pop_back();
+            if (!kept.insert(path).second) continue;
+            std::unique_ptr<ArchiveReader> reader = ArchiveReader::open(path.string());
+            if (reader) {
+                for (const auto& base : reader->dependencies()) pending.push_back(base);
+            }
+        }
+        std::vector<BackupInfo> old;
+        for (const auto& backup : backups) {
+            if (!kept.count(fs::absolute(backup.path).lexically_normal())) old.push_back(backup);
+        }
+        if (old.empty()) {
             std::cout << "No old backups to delete." << std::endl;
             return true;
         }
         
-        std::cout << "This will delete " << (backups.size() - 1) << " old backup(s). Continue? (y/n): ";
+        std::cout << "This will delete " << old.size() << " old backup(s). Continue? (y/n): ";
         std::string response;
         std::getline(std::cin, response);
         
@@ -238,13 +1015,34 @@ bool BackupManager::wipeOldBackups() {
             return false;
         }
         
-        // Keep the first one (newest), delete the rest
-        for (size_t i = 1; i < backups.size(); i++) {
-            fs::remove(backups[i].path);
+        bool removedSnapshots = false;
+        for (const auto& backup : old) {
+            fs::remove_all(backup.path);
+            removedSnapshots = removedSnapshots || backup.format == "dedup";
+        }
+        
+        BackupCatalog catalog(m_backupDir);
+        for (const auto& backup : backups) {
+            if (kept.count(fs::absolute(backup.path).lexically_normal())) catalog.add(backup);
+        }
+        if (!catalog.save()) {
+            std::cerr << "Warning: Failed to update backup catalog" << std::endl;
+        }
+        
+        // Reclaim chunks only the deleted snapshots referenced
+        if (removedSnapshots) {
+            ChunkStore store(m_backupDir);
+            if (!store.collectGarbage()) {
+                std::cerr << "Warning: Chunk garbage collection failed" << std::endl;
+            }
         }
         
-        std::cout << "Deleted " << (backups.size() - 1) << " old backup(s)." << std::endl;
+        std::cout << "Deleted " << old.size() << " old backup(s)." << std::endl;
         std::cout << "Kept: " << backups[0].name << std::endl;
+        if (backups.size() - old.size() > 1) {
+            std::cout << "Also kept " << (backups.size() - old.size() - 1)
+                      << " backup(s) it holds deltas against" << std::endl;
+        }
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Error wiping old backups: " << e.what() << std::endl;
@@ -266,35 +1064,62 @@ bool BackupManager::isInitialized() const {
 
 std::string BackupManager::generateBackupName(const std::string& baseName) const {
     // Find the next available backup number
-    int maxNum = -1;
+    BackupCatalog catalog(m_backupDir);
+    catalog.load();
+    return baseName + "-backup-" + std::to_string(catalog.nextNumber(baseName));
+}
+
+void BackupManager::recordBackup(BackupInfo info) {
+    info.timestamp = std::time(nullptr);
+    // A manifest's own size says nothing about the data it references, and
+    // a snapshot directory takes up only what it did not link
+    info.size = info.format == "dedup" ? ChunkStore::manifestStoredBytes(info.path)
+              : info.format == "link" ? LinkSnapshotReader::storedBytes(info.path)
+              : fs::file_size(info.path);
     
-    if (fs::exists(m_backupDir)) {
-        for (const auto& entry : fs::directory_iterator(m_backupDir)) {
-            if (entry.is_regular_file() && entry.path().extension() == ".zip") {
-                std::string name = entry.path().stem().string();
-                
-                // Check if it matches pattern: baseName-backup-N
-                std::string prefix = baseName + "-backup-";
-                if (name.find(prefix) == 0) {
-                    std::string numStr = name.substr(prefix.length());
-                    try {
-                        int num = std::stoi(numStr);
-                        maxNum = std::max(maxNum, num);
-                    } catch (...) {
-                        // Not a number, skip
-                    }
-                }
-            }
+    BackupCatalog catalog(m_backupDir);
+    catalog.load();
+    catalog.add(info);
+    if (!catalog.save()) {
+        std::cerr << "Warning: Failed to update backup catalog" << std::endl;
+    }
+}
+
+std::string BackupManager::findBackupPath(const std::string& name) const {
+    for (const auto& format : archiveFormats()) {
+        fs::path path = fs::path(m_backupDir) / (name + format.extension);
+        if (fs::exists(path)) {
+            return path.string();
         }
     }
-    
-    return baseName + "-backup-" + std::to_string(maxNum + 1);
+    fs::path manifest = fs::path(m_backupDir) / (name + ChunkStore::kManifestExtension);
+    return fs::exists(manifest) ? manifest.string() : "";
+}
+
+bool BackupManager::extractBackup(const std::string& path, const std::string& destDir,
+                                  const RestoreOptions& options) {
+    if (fs::path(path).extension() == ChunkStore::kManifestExtension) {
+        ChunkStore store(m_backupDir);
+        return store.restoreSnapshot(path, destDir);
+    }
+    std::unique_ptr<ArchiveReader> reader = ArchiveReader::open(path);
+    if (!reader) {
+        std::cerr << "Error: Cannot read backup: " << path << std::endl;
+        return false;
+    }
+    ExtractOptions extractOptions;
+    extractOptions.jobs = options.jobs;
+    return reader->extract(destDir, extractOptions);
 }
 
 std::string BackupManager::getConfigPath() const {
     return fs::path(fs::current_path()) / ".bik" / "config.txt";
 }
 
+std::string BackupManager::getIndexPath() const {
+    return (fs::path(m_projectDir) / ".bik" / "index.txt").string();
+}
+
 bool BackupManager::loadConfig() {
     try {
         std::string configPath = getConfigPath();
@@ -310,6 +1135,16 @@ bool BackupManager::loadConfig() {
         m_projectDir = config.get("project_dir");
         m_backupDir = config.get("backup_dir");
         m_projectName = config.get("project_name");
+        m_format = config.get("backup_format", "zip");
+        m_policy.configure(config);
+        if (!parseCodec(config.get("codec", "deflate"), m_codec)) {
+            m_codec = Codec::Deflate;
+        }
+        m_level = std::atoi(config.get("codec_level", "0").c_str());
+        m_longDistance = config.get("codec_long") == "true";
+        m_deltaMinSize = std::strtoull(config.get("delta_min_size", "0").c_str(), nullptr, 10);
+        m_deltaMaxChain = static_cast<unsigned>(std::strtoul(config.get("delta_max_chain", "8").c_str(), nullptr, 10));
+        m_dictionaryId = static_cast<uint32_t>(std::strtoul(config.get("zstd_dictionary", "0").c_str(), nullptr, 10));
         
         m_initialized = !m_projectDir.empty() && !m_backupDir.empty();
         return m_initialized;
@@ -325,12 +1160,19 @@ bool BackupManager::saveConfig() {
             fs::create_directories(configDir);
         }
         
+        // Keep settings edited by hand, such as the compress_* policy keys
+        std::string configPath = (configDir / "config.txt").string();
         ProjectConfig config;
+        config.load(configPath);
         config.set("project_dir", m_projectDir);
         config.set("backup_dir", m_backupDir);
         config.set("project_name", m_projectName);
+        config.set("backup_format", m_format);
+        config.set("codec", codecName(m_codec));
+        config.set("codec_level", std::to_string(m_level));
+        config.set("codec_long", m_longDistance ? "true" : "false");
+        config.set("zstd_dictionary", std::to_string(m_dictionaryId));
         
-        std::string configPath = (configDir / "config.txt").string();
         return config.save(configPath);
     } catch (const std::exception& e) {
         std::cerr << "Error saving config: " << e.what() << std::endl;
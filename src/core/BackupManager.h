@@ -1,16 +1,29 @@
 #pragma once
 
+#include "core/BackupCatalog.h"
+#include "core/CompressionPolicy.h"
+#include <filesystem>
+#include <istream>
+#include <ostream>
 #include <string>
 #include <vector>
 #include <ctime>
 
 namespace bik {
 
-struct BackupInfo {
-    std::string name;
-    std::string path;
-    std::time_t timestamp;
-    size_t size;
+struct VerifyReport;
+
+struct BackupOptions {
+    bool full = false;      // recompress everything instead of reusing the previous backup
+    unsigned jobs = 0;      // compression threads (0 = all cores)
+    std::string codec;      // "deflate" or "zstd"; empty keeps the project default
+    int level = 0;          // codec level; 0 keeps the project default
+    bool longDistance = false; // zstd long-distance matching (with codec)
+};
+
+struct RestoreOptions {
+    unsigned jobs = 0;      // extraction threads (0 = all cores)
+    bool assumeYes = false; // load without asking before replacing the working tree
 };
 
 class BackupManager {
@@ -18,20 +31,47 @@ public:
     BackupManager();
     ~BackupManager();
 
-    // Initialize a project with backup directory
-    bool initProject(const std::string& backupDir, const std::string& projectDir);
+    // Initialize a project with backup directory and repository format
+    // ("zip" or "native" for one archive per backup, "dedup" for the chunk store)
+    bool initProject(const std::string& backupDir, const std::string& projectDir,
+                     const std::string& format = "zip");
     
-    // Create a backup
-    bool createBackup(const std::string& name = "");
+    // Create a backup (incremental against the previous one unless options.full is set)
+    bool createBackup(const std::string& name = "", const BackupOptions& options = BackupOptions());
+    
+    // Write a full backup to out in the stream format; nothing is kept in the backup directory
+    bool createBackupStream(std::ostream& out, const BackupOptions& options = BackupOptions());
     
     // List all backups
     std::vector<BackupInfo> listBackups() const;
     
     // Load a specific backup
-    bool loadBackup(const std::string& name);
+    bool loadBackup(const std::string& name, const RestoreOptions& options = RestoreOptions());
     
     // Load the most recent backup
-    bool loadLastBackup();
+    bool loadLastBackup(const RestoreOptions& options = RestoreOptions());
+    
+    // Restore the project from a backup stream while it is read. Paths the
+    // stream does not hold are removed only once it has arrived complete.
+    bool loadBackupStream(std::istream& in, const RestoreOptions& options = RestoreOptions());
+    
+    // Restore only the files matching patterns (paths or globs) from a backup
+    // into destDir (the project directory when empty), leaving everything else alone
+    bool restoreFiles(const std::string& name, const std::vector<std::string>& patterns,
+                      const std::string& destDir = "", const RestoreOptions& options = RestoreOptions());
+    
+    // Read a backup back on every core and check each file against the
+    // checksums stored when it was made, without touching the project
+    // (the most recent backup when name is empty)
+    bool verifyBackup(const std::string& name, const RestoreOptions& options = RestoreOptions());
+    
+    // Verify every backup in the backup directory, newest first
+    bool verifyAllBackups(const RestoreOptions& options = RestoreOptions());
+    
+    // Print the files added, removed and modified from backup `from` (the
+    // most recent when empty) to backup `to`, or to the project directory
+    // when `to` is empty, from metadata alone; stat adds a summary
+    bool diffBackups(const std::string& from, const std::string& to, bool stat);
     
     // Clean all backups
     bool cleanAllBackups();
@@ -39,6 +79,13 @@ public:
     // Wipe old backups (keep only the most recent)
     bool wipeOldBackups();
     
+    // Train a zstd dictionary on the project's small files and compress
+    // them with it from the next native backup on
+    bool trainDictionary();
+    
+    // Stop using the dictionary; existing backups keep reading theirs
+    bool dropDictionary();
+    
     // Get current project directory
     std::string getProjectDir() const;
     
@@ -49,14 +96,35 @@ public:
     bool isInitialized() const;
 
 private:
+    bool applyCodecOptions(const BackupOptions& options, bool& changed);
+    void keepCodecOptions();
     std::string generateBackupName(const std::string& baseName) const;
+    void recordBackup(BackupInfo info);
+    std::string findBackupPath(const std::string& name) const;
+    bool extractBackup(const std::string& path, const std::string& destDir,
+                       const RestoreOptions& options);
+    bool restoreViaTemp(const std::string& backupPath, const RestoreOptions& options);
+    bool restoreArchiveInPlace(const std::string& archivePath, const RestoreOptions& options);
+    // Verify one backup, print its result and add it to total
+    bool verifyBackupAt(const std::string& name, const std::string& path, const RestoreOptions& options,
+                        VerifyReport& total);
+    static bool moveIntoPlace(const std::filesystem::path& from, const std::filesystem::path& to);
     std::string getConfigPath() const;
+    std::string getIndexPath() const;
     bool loadConfig();
     bool saveConfig();
     
     std::string m_projectDir;
     std::string m_backupDir;
     std::string m_projectName;
+    std::string m_format;
+    CompressionPolicy m_policy;
+    Codec m_codec;
+    int m_level;
+    bool m_longDistance;
+    uint64_t m_deltaMinSize;
+    unsigned m_deltaMaxChain;
+    uint32_t m_dictionaryId;    // trained zstd dictionary, 0 for none
     bool m_initialized;
 };
 
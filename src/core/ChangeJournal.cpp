@@ -0,0 +1,251 @@
+#include "core/ChangeJournal.h"
+#include "core/IgnoreMatcher.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <system_error>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+// Whether path or a directory above it is in set
+bool self_or_parent_in(const std::unordered_set<std::string>& set, const std::string& path, bool self) {
+    if (set.empty()) return false;
+    if (self && set.count(path)) return true;
+    for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        if (set.count(path.substr(0, slash))) return true;
+    }
+    return false;
+}
+
+// How long a backup waits for the watcher to answer a sync request
+const auto kSyncTimeout = std::chrono::seconds(2);
+
+// Write text to path by renaming a temp file over it, so a reader never sees
+// half of it and a watcher sees one IN_MOVED_TO
+bool replace_file(const std::string& path, const std::string& text) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        file << text << "\n";
+        if (!file) return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
+
+std::string read_line(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+} // namespace
+
+const char* const ChangeJournal::kSyncFileName = "journal-sync.txt";
+
+bool ChangeSet::touches(const std::string& path) const {
+    return files.count(path) || self_or_parent_in(removed, path, true) || self_or_parent_in(trees, path, true);
+}
+
+bool ChangeSet::underTree(const std::string& path) const {
+    return self_or_parent_in(trees, path, false);
+}
+
+size_t ChangeSet::size() const {
+    return files.size() + trees.size() + removed.size();
+}
+
+bool ChangeSet::visit(const std::string& root, IgnoreMatcher* ignore, const DirWalker::Visitor& visitor) const {
+    // Paths inside a new directory are covered by scanning that directory
+    std::set<std::string> ordered;
+    for (const auto& path : files) {
+        if (!underTree(path)) ordered.insert(path);
+    }
+    for (const auto& path : trees) {
+        if (!underTree(path)) ordered.insert(path);
+    }
+
+    for (const auto& rel : ordered) {
+        std::string abs = root + "/" + rel;
+        std::error_code ec;
+        fs::file_status status = fs::symlink_status(abs, ec);
+        if (ec || !fs::exists(status)) {
+            // Gone again before the backup
+            continue;
+        }
+        DirWalker::Type type = DirWalker::Type::Other;
+        if (fs::is_symlink(status)) {
+            type = DirWalker::Type::Symlink;
+        } else if (fs::is_directory(status)) {
+            type = DirWalker::Type::Directory;
+        } else if (fs::is_regular_file(status)) {
+            type = DirWalker::Type::File;
+        }
+        size_t slash = rel.rfind('/');
+        if (ignore && slash != std::string::npos && !ignore->admitPath(root, rel.substr(0, slash), true)) {
+            continue;
+        }
+
+        DirWalker::Visit next = visitor(rel, type);
+        if (next == DirWalker::Visit::Stop) {
+            return false;
+        }
+        if (next == DirWalker::Visit::Continue && type == DirWalker::Type::Directory) {
+            DirWalker walker(abs);
+            bool ok = walker.walk([&](const std::string& below, DirWalker::Type belowType) {
+                return visitor(rel + "/" + below, belowType);
+            });
+            if (!ok) return false;
+        }
+    }
+    return true;
+}
+
+ChangeJournal::ChangeJournal(const std::string& projectDir) {
+    fs::path dir = fs::path(projectDir) / ".bik";
+    m_journalPath = (dir / "journal.txt").string();
+    m_basePath = (dir / "journal-base.txt").string();
+    m_pidPath = (dir / "watch.pid").string();
+    m_syncPath = (dir / kSyncFileName).string();
+    m_ackPath = (dir / "journal-ack.txt").string();
+}
+
+bool ChangeJournal::append(const std::vector<std::string>& lines) {
+    if (lines.empty()) return true;
+    std::string text;
+    for (const auto& line : lines) {
+        text += line;
+        text += '\n';
+    }
+#ifndef _WIN32
+    // Reopened each time: after a backup renames the journal away, the next
+    // batch lands in a new file
+    int fd = ::open(m_journalPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    // O_APPEND: a single write is never interleaved with another appender
+    bool ok = ::write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size());
+    if (::close(fd) != 0) ok = false;
+    return ok;
+#else
+    std::ofstream file(m_journalPath, std::ios::app | std::ios::binary);
+    file << text;
+    return static_cast<bool>(file);
+#endif
+}
+
+bool ChangeJournal::markRescan() {
+    return append({"R"});
+}
+
+bool ChangeJournal::writePid() {
+#ifndef _WIN32
+    std::ofstream file(m_pidPath, std::ios::trunc);
+    file << ::getpid() << "\n";
+    return static_cast<bool>(file);
+#else
+    return false;
+#endif
+}
+
+void ChangeJournal::removePid() {
+    std::error_code ec;
+    fs::remove(m_pidPath, ec);
+}
+
+bool ChangeJournal::acknowledgeSync() {
+    std::string token = read_line(m_syncPath);
+    return token.empty() || replace_file(m_ackPath, token);
+}
+
+bool ChangeJournal::watcherRunning() const {
+#ifndef _WIN32
+    std::ifstream file(m_pidPath);
+    long pid = 0;
+    if (!(file >> pid) || pid <= 0) return false;
+    return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#else
+    return false;
+#endif
+}
+
+bool ChangeJournal::syncWatcher() {
+    // Unique per request, so an answer to an earlier one does not count
+    std::string token = std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+#ifndef _WIN32
+    token += "-" + std::to_string(::getpid());
+#endif
+    if (!replace_file(m_syncPath, token)) return false;
+
+    auto deadline = std::chrono::steady_clock::now() + kSyncTimeout;
+    while (read_line(m_ackPath) != token) {
+        if (std::chrono::steady_clock::now() >= deadline || !watcherRunning()) {
+            std::cerr << "Warning: the watcher did not answer; scanning the whole tree" << std::endl;
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+bool ChangeJournal::consume(const std::string& basePath, ChangeSet& changes) {
+    changes = ChangeSet();
+
+    bool usable = watcherRunning() && !basePath.empty();
+    if (usable) {
+        usable = read_line(m_basePath) == basePath;
+    }
+    // Before the journal is taken, so the changes the watcher still held
+    // are in it
+    if (usable) {
+        usable = syncWatcher();
+    }
+
+    // Take whatever was recorded so far, even when it turns out unusable:
+    // the full scan that follows covers those changes too
+    std::string taken = m_journalPath + ".taken";
+    std::error_code ec;
+    fs::remove(taken, ec);
+    fs::rename(m_journalPath, taken, ec);
+    bool haveJournal = !ec;
+
+    if (usable && haveJournal) {
+        std::ifstream file(taken);
+        std::string line;
+        while (usable && std::getline(file, line)) {
+            if (line.empty()) continue;
+            std::string path = line.size() > 2 ? line.substr(2) : std::string();
+            switch (line[0]) {
+            case 'F': changes.files.insert(path); break;
+            case 'T': changes.trees.insert(path); break;
+            case 'D': changes.removed.insert(path); break;
+            default: usable = false; break;     // R, or a line we do not know
+            }
+        }
+    }
+    fs::remove(taken, ec);
+    if (!usable) changes = ChangeSet();
+    return usable;
+}
+
+void ChangeJournal::commit(const std::string& backupPath) {
+    replace_file(m_basePath, backupPath);
+}
+
+} // namespace bik
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "core/DirWalker.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace bik {
+
+class IgnoreMatcher;
+
+// Paths touched since the previous backup, all relative and '/'-separated
+struct ChangeSet {
+    std::unordered_set<std::string> files;      // created, modified or re-attributed
+    std::unordered_set<std::string> trees;      // directories that appeared; scanned whole
+    std::unordered_set<std::string> removed;    // deleted or moved away (files or directories)
+
+    // Whether the previous backup's entry for path may be stale: the path
+    // itself, or a directory above it, was touched
+    bool touches(const std::string& path) const;
+    // Whether a directory above path is in trees (so a scan of it covers path)
+    bool underTree(const std::string& path) const;
+
+    size_t size() const;
+
+    // Visit the changed files and everything below the new directories that
+    // still exist under root, in path order. .bikignore files above each path
+    // are loaded into ignore first; the visitor applies the rules itself.
+    bool visit(const std::string& root, IgnoreMatcher* ignore, const DirWalker::Visitor& visitor) const;
+};
+
+// Change journal kept by `bik watch` in .bik/journal.txt and consumed by the
+// next backup. One line per change:
+//   F <path>   file created or modified     T <path>   directory appeared
+//   D <path>   path deleted or moved away   R          everything must be rescanned
+// The watcher appends with a fresh open for every batch, so a backup takes
+// the journal by renaming it and later events start a new file.
+//
+// The watcher batches changes before writing them, so a backup first asks it
+// to catch up: it writes a token to .bik/journal-sync.txt, which the watcher
+// sees through its own inotify queue, behind every change made before the
+// request. The watcher flushes and echoes the token to .bik/journal-ack.txt.
+class ChangeJournal {
+public:
+    explicit ChangeJournal(const std::string& projectDir);
+
+    // Name of the sync request file in .bik
+    static const char* const kSyncFileName;
+
+    // Watcher side
+    bool append(const std::vector<std::string>& lines);
+    bool markRescan();
+    bool writePid();
+    void removePid();
+    // Answer the latest sync request; everything seen before it is flushed
+    bool acknowledgeSync();
+
+    // Whether a watcher process is alive for this project
+    bool watcherRunning() const;
+
+    // Take the journal. True if changes hold every change made since the
+    // backup at basePath, false if a full scan is needed (no live watcher,
+    // one that does not answer the sync request, a rescan request, or a
+    // journal relative to another backup).
+    bool consume(const std::string& basePath, ChangeSet& changes);
+
+    // The backup at backupPath covers everything up to consume(); the next
+    // journal is relative to it
+    void commit(const std::string& backupPath);
+
+private:
+    // Have the watcher flush everything it has seen so far
+    bool syncWatcher();
+
+    std::string m_journalPath;
+    std::string m_basePath;     // file naming the backup the journal is relative to
+    std::string m_pidPath;
+    std::string m_syncPath;     // token written by a backup
+    std::string m_ackPath;      // token echoed by the watcher once flushed
+};
+
+} // namespace bik
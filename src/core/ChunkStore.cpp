@@ -0,0 +1,707 @@
+#include "core/ChunkStore.h"
+#include "core/ChangeJournal.h"
+#include "core/DirWalker.h"
+#include "core/FileIndex.h"
+#include "core/FileMeta.h"
+#include "core/FileWriter.h"
+#include "core/Hash.h"
+#include "core/IgnoreMatcher.h"
+#include "core/Stats.h"
+#include "core/ZipUtils.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+// FastCDC parameters: 2 KiB minimum, 8 KiB average, 64 KiB maximum chunk
+const size_t kMinChunk = 2 * 1024;
+const size_t kAvgChunk = 8 * 1024;
+const size_t kMaxChunk = 64 * 1024;
+
+// Normalized chunking: a stricter mask below the average size and a looser
+// one above it. The masks use the high bits of the gear hash, which depend
+// on the last 64 bytes rather than just the most recent one.
+const uint64_t kMaskSmall = ~0ULL << (64 - 15);
+const uint64_t kMaskLarge = ~0ULL << (64 - 11);
+
+// Start a new pack once the current one reaches this size
+const uint64_t kPackTarget = 64ULL * 1024 * 1024;
+
+// Repack a pack during GC once this fraction of its bytes is garbage
+const double kRepackThreshold = 0.5;
+
+struct GearTable {
+    uint64_t values[256];
+    GearTable() {
+        // splitmix64 keeps the table deterministic across builds
+        uint64_t x = 0x62696b2d63646331ULL;
+        for (auto& v : values) {
+            x += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = x;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            v = z ^ (z >> 31);
+        }
+    }
+};
+
+const GearTable kGear;
+
+std::string join_chunks(const std::vector<std::string>& chunks) {
+    std::string out;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (i) out += ',';
+        out += chunks[i];
+    }
+    return out;
+}
+
+} // namespace
+
+ChunkStore::ChunkStore(const std::string& backupDir)
+    : m_backupDir(backupDir),
+      m_storeDir((fs::path(backupDir) / ".bikstore").string()),
+      m_nextPack(0),
+      m_indexLoaded(false),
+      m_packId(0),
+      m_packSize(0) {
+}
+
+ChunkStore::~ChunkStore() {
+    closePack();
+}
+
+size_t ChunkStore::findChunkBoundary(const uint8_t* data, size_t len) {
+    if (len <= kMinChunk) {
+        return len;
+    }
+    size_t normal = std::min(kAvgChunk, len);
+    size_t limit = std::min(kMaxChunk, len);
+
+    uint64_t fp = 0;
+    size_t i = kMinChunk;
+    for (; i < normal; i++) {
+        fp = (fp << 1) + kGear.values[data[i]];
+        if (!(fp & kMaskSmall)) return i;
+    }
+    for (; i < limit; i++) {
+        fp = (fp << 1) + kGear.values[data[i]];
+        if (!(fp & kMaskLarge)) return i;
+    }
+    return limit;
+}
+
+std::string ChunkStore::packPath(uint32_t pack) const {
+    return (fs::path(m_storeDir) / "packs" / ("pack-" + std::to_string(pack) + ".dat")).string();
+}
+
+bool ChunkStore::loadIndex() {
+    if (m_indexLoaded) return true;
+    m_index.clear();
+    m_nextPack = 0;
+
+    std::ifstream file(fs::path(m_storeDir) / "chunks.idx");
+    if (file.is_open()) {
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            if (line.rfind("next_pack=", 0) == 0) {
+                m_nextPack = static_cast<uint32_t>(std::stoul(line.substr(10)));
+                continue;
+            }
+            // hash pack offset stored raw compressed
+            std::istringstream fields(line);
+            std::string hash;
+            ChunkLocation loc;
+            int compressed = 0;
+            if (fields >> hash >> loc.pack >> loc.offset >> loc.storedSize >> loc.rawSize >> compressed) {
+                loc.compressed = compressed != 0;
+                m_index[hash] = loc;
+            }
+        }
+    }
+    m_indexLoaded = true;
+    return true;
+}
+
+bool ChunkStore::saveIndex() const {
+    std::error_code ec;
+    fs::create_directories(m_storeDir, ec);
+    fs::path path = fs::path(m_storeDir) / "chunks.idx";
+    fs::path tmpPath = path.string() + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (!file.is_open()) return false;
+        file << "# Bik Chunk Index\n";
+        file << "next_pack=" << m_nextPack << "\n";
+        for (const auto& pair : m_index) {
+            const ChunkLocation& loc = pair.second;
+            file << pair.first << ' ' << loc.pack << ' ' << loc.offset << ' ' << loc.storedSize
+                 << ' ' << loc.rawSize << ' ' << (loc.compressed ? 1 : 0) << '\n';
+        }
+        if (!file) return false;
+    }
+    fs::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+bool ChunkStore::openPackForAppend() {
+    if (m_pack.is_open() && m_packSize < kPackTarget) return true;
+    closePack();
+
+    std::error_code ec;
+    fs::create_directories(fs::path(m_storeDir) / "packs", ec);
+    m_packId = m_nextPack++;
+    m_packSize = 0;
+    m_pack.open(packPath(m_packId), std::ios::binary | std::ios::trunc);
+    return m_pack.is_open();
+}
+
+void ChunkStore::closePack() {
+    if (m_pack.is_open()) {
+        m_pack.close();
+    }
+}
+
+bool ChunkStore::storeChunk(const uint8_t* data, size_t len, std::string& hash, uint64_t& added) {
+    hash = Sha256::hex(data, len);
+    if (m_index.count(hash)) {
+        return true;
+    }
+
+    if (!openPackForAppend()) {
+        std::cerr << "Error: cannot open pack file in " << m_storeDir << std::endl;
+        return false;
+    }
+
+    uLongf bound = compressBound(static_cast<uLong>(len));
+    std::vector<uint8_t> packed(bound);
+    bool compressed = compress2(packed.data(), &bound, data, static_cast<uLong>(len), Z_DEFAULT_COMPRESSION) == Z_OK
+                      && bound < len;
+
+    const uint8_t* payload = compressed ? packed.data() : data;
+    size_t payloadLen = compressed ? static_cast<size_t>(bound) : len;
+
+    ChunkLocation loc;
+    loc.pack = m_packId;
+    loc.offset = m_packSize;
+    loc.storedSize = static_cast<uint32_t>(payloadLen);
+    loc.rawSize = static_cast<uint32_t>(len);
+    loc.compressed = compressed;
+
+    m_pack.write(reinterpret_cast<const char*>(payload), static_cast<std::streamsize>(payloadLen));
+    if (!m_pack) return false;
+    m_packSize += payloadLen;
+    added += payloadLen;
+
+    m_index[hash] = loc;
+    return true;
+}
+
+bool ChunkStore::readChunk(const std::string& hash, std::vector<uint8_t>& out) {
+    return readChunk(hash, out, m_readers);
+}
+
+bool ChunkStore::readChunk(const std::string& hash, std::vector<uint8_t>& out, PackReaders& readers) {
+    auto it = m_index.find(hash);
+    if (it == m_index.end()) {
+        std::cerr << "Error: missing chunk " << hash << std::endl;
+        return false;
+    }
+    const ChunkLocation& loc = it->second;
+
+    auto& reader = readers[loc.pack];
+    if (!reader) {
+        reader.reset(new std::ifstream(packPath(loc.pack), std::ios::binary));
+    }
+    if (!reader->is_open()) return false;
+
+    std::vector<uint8_t> stored(loc.storedSize);
+    reader->clear();
+    reader->seekg(static_cast<std::streamoff>(loc.offset));
+    reader->read(reinterpret_cast<char*>(stored.data()), loc.storedSize);
+    if (reader->gcount() != static_cast<std::streamsize>(loc.storedSize)) return false;
+
+    if (!loc.compressed) {
+        out.swap(stored);
+        return true;
+    }
+    out.resize(loc.rawSize);
+    uLongf rawLen = loc.rawSize;
+    if (uncompress(out.data(), &rawLen, stored.data(), loc.storedSize) != Z_OK || rawLen != loc.rawSize) {
+        std::cerr << "Error: corrupt chunk " << hash << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ChunkStore::chunkFile(const std::string& absPath, ManifestEntry& entry, uint64_t& added) {
+    entry.chunks.clear();
+    return splitFile(absPath, [&](const uint8_t* data, size_t len) {
+        std::string hash;
+        if (!storeChunk(data, len, hash, added)) return false;
+        entry.chunks.push_back(hash);
+        return true;
+    });
+}
+
+bool ChunkStore::hashFile(const std::string& path, std::vector<std::string>& chunks) {
+    chunks.clear();
+    return splitFile(path, [&](const uint8_t* data, size_t len) {
+        chunks.push_back(Sha256::hex(data, len));
+        return true;
+    });
+}
+
+bool ChunkStore::splitFile(const std::string& absPath,
+                           const std::function<bool(const uint8_t*, size_t)>& onChunk) {
+    std::ifstream ifs(absPath, std::ios::binary);
+    if (!ifs) return false;
+
+    // Keep at least one maximal chunk buffered so boundaries never depend on read sizes
+    std::vector<uint8_t> buf(16 * kMaxChunk);
+    size_t have = 0;
+    bool eof = false;
+
+    while (true) {
+        if (!eof && have < buf.size()) {
+            ifs.read(reinterpret_cast<char*>(buf.data() + have), static_cast<std::streamsize>(buf.size() - have));
+            have += static_cast<size_t>(ifs.gcount());
+            if (!ifs) eof = true;
+        }
+        if (have == 0) break;
+
+        size_t pos = 0;
+        while (have - pos >= kMaxChunk || (eof && pos < have)) {
+            size_t len = findChunkBoundary(buf.data() + pos, have - pos);
+            if (!onChunk(buf.data() + pos, len)) return false;
+            pos += len;
+        }
+        std::copy(buf.begin() + pos, buf.begin() + have, buf.begin());
+        have -= pos;
+        if (eof && have == 0) break;
+    }
+    return true;
+}
+
+bool ChunkStore::createSnapshot(const std::string& sourceDir, const std::string& manifestPath,
+                                const std::string& previousManifest, IgnoreMatcher* ignore,
+                                const ChangeSet* changes) {
+    fs::path source = fs::absolute(sourceDir);
+    if (!fs::exists(source)) {
+        std::cerr << "Source directory does not exist: " << source << std::endl;
+        return false;
+    }
+    if (!loadIndex()) return false;
+
+    std::unordered_map<std::string, ManifestEntry> previous;
+    if (!previousManifest.empty()) {
+        std::vector<ManifestEntry> prevEntries;
+        if (loadManifest(previousManifest, prevEntries)) {
+            for (auto& e : prevEntries) previous[e.path] = std::move(e);
+        }
+    }
+
+    std::vector<ManifestEntry> entries;
+    uint64_t added = 0;
+    size_t reused = 0;
+    uint64_t sourceBytes = 0;
+    bool ok = true;
+
+    try {
+        Stats::Phase phase("scan");
+        DirWalker walker(source.string());
+        auto addPath = [&](const std::string& rel, DirWalker::Type type) {
+            if (rel == ".bik") return DirWalker::Visit::Skip;
+            if (ignore && !ignore->admit(source.string(), rel, type == DirWalker::Type::Directory)) {
+                return DirWalker::Visit::Skip;
+            }
+            std::string path = walker.absolutePath(rel);
+            // Symlinks to files are stored as the file they point to
+            if (type != DirWalker::Type::File && !(type == DirWalker::Type::Symlink && fs::is_regular_file(path))) {
+                return DirWalker::Visit::Continue;
+            }
+
+            FileIndexEntry st;
+            if (!FileIndex::statFile(path, st)) { ok = false; return DirWalker::Visit::Stop; }
+            sourceBytes += st.size;
+            Stats::add(Stats::Counter::FilesScanned);
+            Stats::file(rel, st.size);
+
+            ManifestEntry me;
+            me.path = rel;
+            me.size = st.size;
+            me.mtimeNs = st.mtimeNs;
+            me.inode = st.inode;
+
+            auto prev = previous.find(me.path);
+            if (prev != previous.end() && prev->second.size == me.size && prev->second.mtimeNs == me.mtimeNs
+                && prev->second.inode == me.inode) {
+                bool present = true;
+                for (const auto& h : prev->second.chunks) {
+                    if (!m_index.count(h)) { present = false; break; }
+                }
+                if (present) {
+                    me.chunks = prev->second.chunks;
+                    entries.push_back(std::move(me));
+                    reused++;
+                    return DirWalker::Visit::Continue;
+                }
+            }
+
+            Stats::Span span("chunk", rel);
+            Stats::add(Stats::Counter::FilesCompressed);
+            Stats::add(Stats::Counter::BytesRead, st.size);
+            if (!chunkFile(path, me, added)) {
+                std::cerr << "Error: failed to chunk " << path << std::endl;
+                ok = false;
+                return DirWalker::Visit::Stop;
+            }
+            entries.push_back(std::move(me));
+            return DirWalker::Visit::Continue;
+        };
+
+        if (changes && !previous.empty()) {
+            // Journal from `bik watch`: files nothing touched keep their
+            // chunk lists without being looked at
+            ChangeSet dirty = *changes;
+            for (auto& pair : previous) {
+                if (changes->touches(pair.first)) continue;
+                bool present = true;
+                for (const auto& h : pair.second.chunks) {
+                    if (!m_index.count(h)) { present = false; break; }
+                }
+                if (!present) {
+                    dirty.files.insert(pair.first);
+                    continue;
+                }
+                entries.push_back(pair.second);
+                sourceBytes += pair.second.size;
+                reused++;
+            }
+            std::sort(entries.begin(), entries.end(),
+                      [](const ManifestEntry& a, const ManifestEntry& b) { return a.path < b.path; });
+            if (!dirty.visit(source.string(), ignore, addPath)) ok = false;
+        } else if (!walker.walk(addPath)) {
+            ok = false;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error while chunking: " << e.what() << std::endl;
+        ok = false;
+    }
+
+    closePack();
+    // Chunks written so far stay in the index even on failure; GC reclaims them
+    if (!saveIndex()) {
+        std::cerr << "Error: failed to save chunk index" << std::endl;
+        return false;
+    }
+    if (!ok) return false;
+
+    if (!saveManifest(manifestPath, entries, added)) {
+        std::cerr << "Error: failed to write manifest " << manifestPath << std::endl;
+        return false;
+    }
+
+    Stats::add(Stats::Counter::FilesReused, reused);
+    Stats::add(Stats::Counter::BytesWritten, added);
+    Stats::add(Stats::Counter::BytesIn, sourceBytes);
+    Stats::add(Stats::Counter::BytesOut, added);
+    std::cout << "Stored " << added << " new byte(s), reused " << reused << " unchanged file(s)" << std::endl;
+    return true;
+}
+
+bool ChunkStore::restoreSnapshot(const std::string& manifestPath, const std::string& destDir,
+                                 const std::unordered_set<std::string>* only) {
+    Stats::Phase phase("extract");
+    std::vector<ManifestEntry> entries;
+    if (!loadManifest(manifestPath, entries)) {
+        std::cerr << "Error: cannot read manifest " << manifestPath << std::endl;
+        return false;
+    }
+    if (!loadIndex()) return false;
+
+    fs::path dest = fs::absolute(destDir);
+    std::vector<uint8_t> chunk;
+    for (const auto& e : entries) {
+        if (only && !only->count(e.path)) continue;
+        Stats::Span span("extract", e.path);
+        Stats::add(Stats::Counter::FilesRestored);
+        fs::path outPath = dest / fs::path(e.path);
+        fs::path staged = only ? fs::path(outPath.string() + ".bik-tmp") : outPath;
+        std::error_code ec;
+        fs::create_directories(outPath.parent_path(), ec);
+
+        FileWriter out;
+        if (!out.open(staged.string(), e.size)) return false;
+        bool ok = true;
+        for (const auto& h : e.chunks) {
+            if (!readChunk(h, chunk)
+                || !out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size())) {
+                ok = false;
+                break;
+            }
+        }
+        if (!out.close() || !ok) {
+            if (only) fs::remove(staged, ec);
+            return false;
+        }
+
+        // Manifests carry the mtime only; the mode is left to the umask
+        FileMeta meta;
+        meta.mtimeNs = e.mtimeNs;
+        meta.apply(staged.string());
+        if (only) {
+            fs::rename(staged, outPath, ec);
+            if (ec) return false;
+        }
+    }
+    m_readers.clear();
+    return true;
+}
+
+bool ChunkStore::verifySnapshot(const std::string& manifestPath, unsigned jobs, VerifyReport& report) {
+    Stats::Phase phase("verify");
+    std::vector<ManifestEntry> entries;
+    if (!loadManifest(manifestPath, entries)) {
+        std::cerr << "Error: cannot read manifest " << manifestPath << std::endl;
+        return false;
+    }
+    if (!loadIndex()) return false;
+
+    // Each distinct chunk is read and hashed once, however many files share it
+    std::vector<std::string> chunks;
+    std::unordered_map<std::string, size_t> slots;
+    for (const auto& e : entries) {
+        for (const auto& h : e.chunks) {
+            if (slots.emplace(h, chunks.size()).second) chunks.push_back(h);
+        }
+    }
+    std::vector<char> chunkBad(chunks.size(), 0);
+    std::vector<uint64_t> chunkSizes(chunks.size(), 0);
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(chunks.size(), 1)));
+    std::atomic<size_t> next(0);
+    auto worker = [&] {
+        // The index is only read here; each worker opens its own packs
+        PackReaders readers;
+        std::vector<uint8_t> data;
+        for (size_t k = next++; k < chunks.size(); k = next++) {
+            if (!readChunk(chunks[k], data, readers) || Sha256::hex(data.data(), data.size()) != chunks[k]) {
+                chunkBad[k] = 1;
+                continue;
+            }
+            chunkSizes[k] = data.size();
+            Stats::add(Stats::Counter::BytesRead, data.size());
+        }
+    };
+    if (jobs <= 1) {
+        worker();
+    } else {
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < jobs; i++) threads.emplace_back(worker);
+        for (auto& t : threads) t.join();
+    }
+
+    for (const auto& e : entries) {
+        report.entries++;
+        bool ok = true;
+        uint64_t size = 0;
+        for (const auto& h : e.chunks) {
+            size_t k = slots[h];
+            ok = ok && !chunkBad[k];
+            size += chunkSizes[k];
+        }
+        if (ok && size == e.size) report.bytes += e.size;
+        else report.corrupt.push_back(e.path);
+    }
+    return report.corrupt.empty();
+}
+
+bool ChunkStore::collectGarbage() {
+    if (!loadIndex()) return false;
+    closePack();
+    m_readers.clear();
+
+    // Mark
+    std::unordered_set<std::string> live;
+    try {
+        for (const auto& entry : fs::directory_iterator(m_backupDir)) {
+            if (entry.is_regular_file() && entry.path().extension() == kManifestExtension) {
+                std::vector<ManifestEntry> entries;
+                if (!loadManifest(entry.path().string(), entries)) {
+                    // Never sweep against an unreadable manifest
+                    std::cerr << "Error: cannot read manifest " << entry.path() << std::endl;
+                    return false;
+                }
+                for (const auto& e : entries) {
+                    live.insert(e.chunks.begin(), e.chunks.end());
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error scanning manifests: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Sweep the index and account live bytes per pack
+    std::unordered_map<uint32_t, uint64_t> liveBytes;
+    size_t removed = 0;
+    for (auto it = m_index.begin(); it != m_index.end();) {
+        if (!live.count(it->first)) {
+            it = m_index.erase(it);
+            removed++;
+        } else {
+            liveBytes[it->second.pack] += it->second.storedSize;
+            ++it;
+        }
+    }
+
+    // Delete empty packs, repack mostly-dead ones
+    std::unordered_set<uint32_t> repack;
+    std::vector<fs::path> deadPacks;
+    fs::path packDir = fs::path(m_storeDir) / "packs";
+    std::error_code ec;
+    if (fs::exists(packDir, ec)) {
+        for (const auto& entry : fs::directory_iterator(packDir)) {
+            std::string stem = entry.path().stem().string();
+            if (stem.rfind("pack-", 0) != 0) continue;
+            uint32_t id = static_cast<uint32_t>(std::stoul(stem.substr(5)));
+            uint64_t total = entry.file_size();
+            uint64_t used = liveBytes.count(id) ? liveBytes[id] : 0;
+            if (used == 0) {
+                deadPacks.push_back(entry.path());
+            } else if (total > 0 && double(total - used) / double(total) >= kRepackThreshold) {
+                repack.insert(id);
+                deadPacks.push_back(entry.path());
+            }
+        }
+    }
+
+    if (!repack.empty()) {
+        std::vector<uint8_t> data;
+        std::vector<std::string> moved;
+        for (const auto& pair : m_index) {
+            if (repack.count(pair.second.pack)) moved.push_back(pair.first);
+        }
+        for (const auto& hash : moved) {
+            ChunkLocation old = m_index[hash];
+            auto& reader = m_readers[old.pack];
+            if (!reader) reader.reset(new std::ifstream(packPath(old.pack), std::ios::binary));
+            data.resize(old.storedSize);
+            reader->clear();
+            reader->seekg(static_cast<std::streamoff>(old.offset));
+            reader->read(reinterpret_cast<char*>(data.data()), old.storedSize);
+            if (!*reader || !openPackForAppend()) return false;
+
+            ChunkLocation loc = old;
+            loc.pack = m_packId;
+            loc.offset = m_packSize;
+            m_pack.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!m_pack) return false;
+            m_packSize += data.size();
+            m_index[hash] = loc;
+        }
+        closePack();
+        m_readers.clear();
+    }
+
+    // Persist the index before deleting anything it no longer points to
+    if (!saveIndex()) return false;
+    for (const auto& p : deadPacks) {
+        fs::remove(p, ec);
+    }
+
+    if (removed > 0 || !deadPacks.empty()) {
+        std::cout << "Garbage collected " << removed << " chunk(s), " << deadPacks.size()
+                  << " pack(s) removed" << std::endl;
+    }
+    return true;
+}
+
+bool ChunkStore::destroy() {
+    closePack();
+    m_readers.clear();
+    m_index.clear();
+    m_indexLoaded = false;
+    std::error_code ec;
+    fs::remove_all(m_storeDir, ec);
+    return !ec;
+}
+
+bool ChunkStore::loadManifest(const std::string& path, std::vector<ManifestEntry>& entries,
+                              uint64_t* storedBytes) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+
+    entries.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        if (line.rfind("stored_bytes=", 0) == 0) {
+            if (storedBytes) *storedBytes = std::stoull(line.substr(13));
+            continue;
+        }
+
+        // size \t mtime \t inode \t chunk,chunk,... \t path
+        std::istringstream fields(line);
+        ManifestEntry e;
+        std::string chunks;
+        if (!(fields >> e.size >> e.mtimeNs >> e.inode)) continue;
+        fields.get();
+        std::getline(fields, chunks, '\t');
+        std::getline(fields, e.path);
+
+        std::istringstream list(chunks);
+        std::string h;
+        while (std::getline(list, h, ',')) {
+            if (!h.empty()) e.chunks.push_back(h);
+        }
+        entries.push_back(std::move(e));
+    }
+    return true;
+}
+
+uint64_t ChunkStore::manifestStoredBytes(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    // The counter sits right after the comment header
+    for (int i = 0; i < 2 && std::getline(file, line); i++) {
+        if (line.rfind("stored_bytes=", 0) == 0) {
+            return std::stoull(line.substr(13));
+        }
+    }
+    return 0;
+}
+
+bool ChunkStore::saveManifest(const std::string& path, const std::vector<ManifestEntry>& entries,
+                              uint64_t storedBytes) {
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (!file.is_open()) return false;
+        file << "# Bik Snapshot Manifest\n";
+        file << "stored_bytes=" << storedBytes << "\n";
+        for (const auto& e : entries) {
+            file << e.size << '\t' << e.mtimeNs << '\t' << e.inode << '\t'
+                 << join_chunks(e.chunks) << '\t' << e.path << '\n';
+        }
+        if (!file) return false;
+    }
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+} // namespace bik
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace bik {
+
+class IgnoreMatcher;
+struct ChangeSet;
+struct VerifyReport;
+
+struct ChunkLocation {
+    uint32_t pack = 0;
+    uint64_t offset = 0;
+    uint32_t storedSize = 0;    // bytes in the pack
+    uint32_t rawSize = 0;       // bytes after decompression
+    bool compressed = false;
+};
+
+struct ManifestEntry {
+    std::string path;           // relative, '/'-separated
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    uint64_t inode = 0;
+    std::vector<std::string> chunks;
+};
+
+// Deduplicating backup store. Files are split with a content-defined chunker,
+// each distinct chunk is stored once (keyed by SHA-256) in append-only pack
+// files under <backupDir>/.bikstore, and every backup is a small manifest
+// <backupDir>/<name>.bikm listing the chunks of each file.
+class ChunkStore {
+public:
+    explicit ChunkStore(const std::string& backupDir);
+    ~ChunkStore();
+
+    // Snapshot sourceDir into manifestPath. Files whose stat matches the
+    // previous manifest reuse its chunk list without being read; paths the
+    // ignore rules exclude are left out. With changes (relative to the
+    // previous manifest), only the paths it names are looked at.
+    bool createSnapshot(const std::string& sourceDir, const std::string& manifestPath,
+                        const std::string& previousManifest = "", IgnoreMatcher* ignore = nullptr,
+                        const ChangeSet* changes = nullptr);
+
+    // Rebuild the files of a manifest under destDir. With only, just those
+    // paths are written, each through a temp file renamed into place.
+    bool restoreSnapshot(const std::string& manifestPath, const std::string& destDir,
+                         const std::unordered_set<std::string>* only = nullptr);
+
+    // Read every chunk a manifest references on jobs threads (0 = all cores)
+    // and check it against its SHA-256. A file is corrupt if any of its
+    // chunks is missing or damaged, or they do not add up to its size.
+    bool verifySnapshot(const std::string& manifestPath, unsigned jobs, VerifyReport& report);
+
+    // Mark-and-sweep: drop chunks no manifest references and repack
+    // packs that are mostly garbage
+    bool collectGarbage();
+
+    // Remove the whole chunk store
+    bool destroy();
+
+    static bool loadManifest(const std::string& path, std::vector<ManifestEntry>& entries,
+                             uint64_t* storedBytes = nullptr);
+    // Bytes of new chunk data a manifest added, read from its header only
+    static uint64_t manifestStoredBytes(const std::string& path);
+    static bool saveManifest(const std::string& path, const std::vector<ManifestEntry>& entries,
+                             uint64_t storedBytes);
+
+    static constexpr const char* kManifestExtension = ".bikm";
+
+    // Hashes of the chunks a file on disk would be stored as, without
+    // storing anything
+    static bool hashFile(const std::string& path, std::vector<std::string>& chunks);
+
+    // Boundaries of a content-defined chunk starting at data (FastCDC).
+    // Returns the length of the chunk, at most len.
+    static size_t findChunkBoundary(const uint8_t* data, size_t len);
+
+private:
+    // Pack files open for reading, by pack number
+    using PackReaders = std::unordered_map<uint32_t, std::unique_ptr<std::ifstream>>;
+
+    bool loadIndex();
+    bool saveIndex() const;
+    bool storeChunk(const uint8_t* data, size_t len, std::string& hash, uint64_t& added);
+    bool readChunk(const std::string& hash, std::vector<uint8_t>& out);
+    bool readChunk(const std::string& hash, std::vector<uint8_t>& out, PackReaders& readers);
+    bool chunkFile(const std::string& absPath, ManifestEntry& entry, uint64_t& added);
+    // Read a file and hand each of its chunks, in order, to onChunk
+    static bool splitFile(const std::string& absPath,
+                          const std::function<bool(const uint8_t*, size_t)>& onChunk);
+    std::string packPath(uint32_t pack) const;
+    bool openPackForAppend();
+    void closePack();
+
+    std::string m_backupDir;
+    std::string m_storeDir;
+    std::unordered_map<std::string, ChunkLocation> m_index;
+    uint32_t m_nextPack;
+    bool m_indexLoaded;
+
+    // Pack currently being appended to
+    std::ofstream m_pack;
+    uint32_t m_packId;
+    uint64_t m_packSize;
+
+    // Open packs for reading during restore
+    PackReaders m_readers;
+};
+
+} // namespace bik
@@ -0,0 +1,75 @@
+#include "core/Common.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace bik {
+
+void put_u8(std::string& buf, uint8_t v) {
+    buf.push_back(static_cast<char>(v));
+}
+
+void put_u32(std::string& buf, uint32_t v) {
+    for (int i = 0; i < 4; i++) buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void put_u64(std::string& buf, uint64_t v) {
+    for (int i = 0; i < 8; i++) buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+uint64_t get_le(const char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+}
+
+bool safe_name(const std::string& name) {
+    if (name.empty() || name[0] == '/' || name.find('\\') != std::string::npos) return false;
+    size_t start = 0;
+    bool first = true;
+    while (true) {
+        size_t slash = name.find('/', start);
+        std::string part = name.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+        if (part.empty() || part == "." || part == ".." || (first && part == ".bik")) return false;
+        if (slash == std::string::npos) return true;
+        start = slash + 1;
+        first = false;
+    }
+}
+
+bool run_workers(unsigned jobs, const std::function<bool()>& worker) {
+    if (jobs <= 1) return worker();
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> threads;
+    try {
+        for (unsigned i = 0; i < jobs; i++) {
+            threads.emplace_back([&] { if (!worker()) ok = false; });
+        }
+    } catch (...) {
+        // Joinable threads must not be destroyed
+        for (auto& t : threads) t.join();
+        throw;
+    }
+    for (auto& t : threads) t.join();
+    return ok;
+}
+
+std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+} // namespace bik
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace bik {
+
+// Small helpers shared by the archive formats and reports
+
+// zstd's own default level
+const int kZstdDefaultLevel = 3;
+
+// Little-endian integers appended to a byte string, as every bik format stores them
+void put_u8(std::string& buf, uint8_t v);
+void put_u32(std::string& buf, uint32_t v);
+void put_u64(std::string& buf, uint64_t v);
+
+// Little-endian integer of the given number of bytes at p
+uint64_t get_le(const char* p, int bytes);
+
+// An entry name that is safe to restore: relative, '/'-separated, no empty,
+// "." or ".." component (so it stays inside the destination) and not in .bik
+bool safe_name(const std::string& name);
+
+// Run worker on jobs threads (inline for a single job); true if every call succeeded
+bool run_workers(unsigned jobs, const std::function<bool()>& worker);
+
+// s quoted and escaped as a JSON string
+std::string json_string(const std::string& s);
+
+} // namespace bik
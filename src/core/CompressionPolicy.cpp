@@ -0,0 +1,156 @@
+#include "core/CompressionPolicy.h"
+#include "core/ProjectConfig.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+// Formats that are compressed already and practically never shrink further
+const char* const kDefaultStoreExtensions[] = {
+    // images, audio, video
+    ".png", ".jpg", ".jpeg", ".gif", ".webp", ".avif", ".heic",
+    ".mp3", ".ogg", ".opus", ".flac", ".aac", ".m4a",
+    ".mp4", ".mkv", ".webm", ".mov", ".avi",
+    // archives and compressed streams
+    ".zip", ".gz", ".tgz", ".bz2", ".xz", ".zst", ".lz4", ".7z", ".rar", ".br",
+    // containers that are zip files
+    ".jar", ".war", ".apk", ".aar", ".whl", ".nupkg", ".docx", ".xlsx", ".pptx", ".odt",
+    // fonts and model weights
+    ".woff", ".woff2", ".safetensors", ".onnx", ".pt", ".pth", ".ckpt", ".gguf",
+};
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+int clamp_level(int level) {
+    return std::max(1, std::min(9, level));
+}
+
+} // namespace
+
+bool parseCodec(const std::string& name, Codec& codec) {
+    std::string n = lower(name);
+    if (n == "deflate") {
+        codec = Codec::Deflate;
+        return true;
+    }
+    if (n == "zstd") {
+        codec = Codec::Zstd;
+        return true;
+    }
+    return false;
+}
+
+const char* codecName(Codec codec) {
+    return codec == Codec::Zstd ? "zstd" : "deflate";
+}
+
+bool codecLevelValid(Codec codec, int level) {
+    return level >= 1 && level <= (codec == Codec::Zstd ? 22 : 9);
+}
+
+CompressionPolicy::CompressionPolicy()
+    : m_probe(true), m_entropyThreshold(7.5),
+      m_smallLimit(128 * 1024), m_largeLimit(64ULL * 1024 * 1024),
+      m_smallLevel(9), m_mediumLevel(6), m_largeLevel(4) {
+    for (const char* ext : kDefaultStoreExtensions) {
+        m_storeExtensions.insert(ext);
+    }
+}
+
+void CompressionPolicy::configure(const ProjectConfig& config) {
+    try {
+        if (config.has("compress_store_extensions")) {
+            m_storeExtensions.clear();
+            std::istringstream list(config.get("compress_store_extensions"));
+            std::string ext;
+            while (std::getline(list, ext, ',')) {
+                ext.erase(0, ext.find_first_not_of(" \t"));
+                ext.erase(ext.find_last_not_of(" \t") + 1);
+                if (ext.empty()) continue;
+                if (ext[0] != '.') ext = "." + ext;
+                m_storeExtensions.insert(lower(ext));
+            }
+        }
+        if (config.has("compress_entropy_probe")) {
+            m_probe = config.get("compress_entropy_probe") != "false";
+        }
+        if (config.has("compress_entropy_threshold")) {
+            m_entropyThreshold = std::stod(config.get("compress_entropy_threshold"));
+        }
+        if (config.has("compress_small_limit")) {
+            m_smallLimit = std::stoull(config.get("compress_small_limit"));
+        }
+        if (config.has("compress_large_limit")) {
+            m_largeLimit = std::stoull(config.get("compress_large_limit"));
+        }
+        if (config.has("compress_level_small")) {
+            m_smallLevel = clamp_level(std::stoi(config.get("compress_level_small")));
+        }
+        if (config.has("compress_level_medium")) {
+            m_mediumLevel = clamp_level(std::stoi(config.get("compress_level_medium")));
+        }
+        if (config.has("compress_level_large")) {
+            m_largeLevel = clamp_level(std::stoi(config.get("compress_level_large")));
+        }
+    } catch (const std::exception&) {
+        // Malformed numbers keep the defaults parsed so far
+    }
+}
+
+CompressionChoice CompressionPolicy::choose(const std::string& path, uint64_t size) const {
+    CompressionChoice choice;
+    if (m_storeExtensions.count(lower(fs::path(path).extension().string()))) {
+        choice.store = true;
+        return choice;
+    }
+    // Small files are cheap to deflate, so only larger ones are sampled
+    if (m_probe && size >= kProbeBytes && sampleEntropy(path, kProbeBytes) > m_entropyThreshold) {
+        choice.store = true;
+        return choice;
+    }
+
+    if (size < m_smallLimit) {
+        choice.level = m_smallLevel;
+    } else if (size >= m_largeLimit) {
+        choice.level = m_largeLevel;
+    } else {
+        choice.level = m_mediumLevel;
+    }
+    return choice;
+}
+
+double CompressionPolicy::sampleEntropy(const std::string& path, size_t sampleBytes) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) return -1.0;
+    std::vector<char> buf(sampleBytes);
+    ifs.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+    size_t n = static_cast<size_t>(ifs.gcount());
+    if (n == 0) return 0.0;
+
+    size_t counts[256] = {};
+    for (size_t i = 0; i < n; i++) {
+        counts[static_cast<unsigned char>(buf[i])]++;
+    }
+    double entropy = 0.0;
+    for (size_t c : counts) {
+        if (c == 0) continue;
+        double p = static_cast<double>(c) / static_cast<double>(n);
+        entropy -= p * std::log2(p);
+    }
+    return entropy;
+}
+
+} // namespace bik
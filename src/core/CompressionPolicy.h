@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+
+namespace bik {
+
+class ProjectConfig;
+
+enum class Codec {
+    Deflate,
+    Zstd,
+};
+
+// "deflate" / "zstd"
+bool parseCodec(const std::string& name, Codec& codec);
+const char* codecName(Codec codec);
+// Levels accepted for codec: 1-9 for deflate, 1-22 for zstd
+bool codecLevelValid(Codec codec, int level);
+
+struct CompressionChoice {
+    bool store = false;         // write the file uncompressed
+    int level = 6;              // codec level when not stored
+};
+
+// Decides per file whether deflating is worth the CPU, and at which level.
+// Already-compressed formats are stored, either by extension or because a
+// sample of their first bytes looks random; everything else is deflated at
+// a level picked by file size class.
+//
+// Settings are read from .bik/config.txt:
+//   compress_store_extensions   comma-separated list, replaces the defaults
+//   compress_entropy_probe      true/false
+//   compress_entropy_threshold  bits per byte above which a file is stored
+//   compress_small_limit        files below this size use the small level
+//   compress_large_limit        files at or above this size use the large level
+//   compress_level_small / compress_level_medium / compress_level_large
+class CompressionPolicy {
+public:
+    CompressionPolicy();
+
+    // Override defaults with the compress_* keys of config
+    void configure(const ProjectConfig& config);
+
+    CompressionChoice choose(const std::string& path, uint64_t size) const;
+
+    // Shannon entropy in bits per byte of the first sampleBytes of path,
+    // or -1 if it cannot be read
+    static double sampleEntropy(const std::string& path, size_t sampleBytes);
+
+    // Bytes read by the entropy probe
+    static const size_t kProbeBytes = 4096;
+
+private:
+    std::unordered_set<std::string> m_storeExtensions;     // lower case, with dot
+    bool m_probe;
+    double m_entropyThreshold;
+    uint64_t m_smallLimit;
+    uint64_t m_largeLimit;
+    int m_smallLevel;
+    int m_mediumLevel;
+    int m_largeLevel;
+};
+
+} // namespace bik
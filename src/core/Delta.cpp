@@ -0,0 +1,327 @@
+#include "core/Delta.h"
+#include "core/Common.h"
+#include "core/Hash.h"
+#include "core/Stats.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <zlib.h>
+
+namespace bik {
+
+namespace {
+
+// Bytes read from the new file at a time
+const size_t kReadSize = 8 << 20;
+
+// Bits of the filter that rules out most non-matching rolling checksums
+// before the sorted table is searched
+const int kFilterBits = 20;
+
+// rsync's rolling checksum: a is the byte sum, b the position-weighted sum
+struct Rolling {
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    void reset(const char* data, size_t len) {
+        a = b = 0;
+        for (size_t i = 0; i < len; i++) {
+            uint32_t x = static_cast<unsigned char>(data[i]);
+            a += x;
+            b += static_cast<uint32_t>(len - i) * x;
+        }
+    }
+
+    // Slide a window of len bytes one byte on
+    void roll(unsigned char out, unsigned char in, size_t len) {
+        a = a - out + in;
+        b = b - static_cast<uint32_t>(len) * out + a;
+    }
+
+    uint32_t value() const {
+        return (a & 0xffff) | (b << 16);
+    }
+};
+
+uint32_t filter_slot(uint32_t weak) {
+    return static_cast<uint32_t>((weak * 0x9e3779b1u) >> (32 - kFilterBits));
+}
+
+} // namespace
+
+void DeltaSignature::addBlocks(const char* data, size_t len) {
+    for (size_t off = 0; off < len; off += blockSize) {
+        size_t n = std::min<size_t>(blockSize, len - off);
+        Rolling r;
+        r.reset(data + off, n);
+        uint64_t h[2];
+        murmur3_128(data + off, n, h);
+        weak.push_back(r.value());
+        strong.push_back(h[0]);
+        strong.push_back(h[1]);
+    }
+    fileSize += len;
+}
+
+std::string DeltaSignature::serialize() const {
+    std::string out;
+    put_u32(out, blockSize);
+    put_u64(out, fileSize);
+    put_u64(out, weak.size());
+    for (uint32_t w : weak) put_u32(out, w);
+    for (uint64_t s : strong) put_u64(out, s);
+    return out;
+}
+
+bool DeltaSignature::parse(const std::string& data, DeltaSignature& sig) {
+    if (data.size() < 20) return false;
+    sig.blockSize = static_cast<uint32_t>(get_le(data.data(), 4));
+    sig.fileSize = get_le(data.data() + 4, 8);
+    uint64_t count = get_le(data.data() + 12, 8);
+    if (sig.blockSize == 0 || count != (data.size() - 20) / 20 || data.size() != 20 + count * 20
+        || count != (sig.fileSize + sig.blockSize - 1) / sig.blockSize) {
+        return false;
+    }
+    const char* p = data.data() + 20;
+    sig.weak.resize(static_cast<size_t>(count));
+    for (auto& w : sig.weak) { w = static_cast<uint32_t>(get_le(p, 4)); p += 4; }
+    sig.strong.resize(static_cast<size_t>(count * 2));
+    for (auto& s : sig.strong) { s = get_le(p, 8); p += 8; }
+    return true;
+}
+
+bool Delta::encode(const std::string& path, const DeltaSignature& base, uint64_t maxPayload,
+                   const std::function<bool(const char*, size_t)>& emit, DeltaSignature& sig,
+                   uint32_t& crc, bool& tooLarge) {
+    Stats::Span span("delta", path);
+    std::ifstream in(path, std::ios::binary);
+    if (!in || base.blockSize == 0 || base.blockSize > kReadSize) return false;
+    const size_t B = base.blockSize;
+    // Ops not yet handed to emit: at most one literal run and a few copies
+    std::string payload;
+    uint64_t emitted = 0;
+    bool emitOk = true;
+    tooLarge = false;
+    sig = DeltaSignature();
+    sig.blockSize = kBlockSize;
+    uLong fileCrc = crc32(0L, Z_NULL, 0);
+
+    // Full-size base blocks sorted by rolling checksum, behind a bit filter
+    std::vector<std::pair<uint32_t, uint32_t>> table;
+    std::vector<uint64_t> filter((1u << kFilterBits) / 64, 0);
+    uint64_t fullBlocks = base.fileSize / B;
+    for (uint32_t i = 0; i < fullBlocks && i < base.weak.size(); i++) {
+        table.push_back(std::make_pair(base.weak[i], i));
+        uint32_t slot = filter_slot(base.weak[i]);
+        filter[slot / 64] |= 1ULL << (slot % 64);
+    }
+    std::sort(table.begin(), table.end());
+
+    // buf holds the file from bufStart; it keeps everything from the
+    // earlier of the match position and the next block still to be signed
+    std::vector<char> buf;
+    uint64_t bufStart = 0;
+    uint64_t pos = 0;
+    uint64_t signedTo = 0;
+    bool eof = false;
+    size_t literalAt = std::string::npos;    // length field of the open literal run
+    uint64_t copySource = 0;
+    uint64_t copyLength = 0;
+    Rolling rolling;
+    bool rollingValid = false;
+
+    // Pass buffered ops on once no literal run is open, so no length field
+    // needs patching afterwards
+    auto emit_ops = [&](bool all) {
+        if (literalAt != std::string::npos || payload.empty() || (!all && payload.size() < kMaxLiteralRun)) return;
+        emitted += payload.size();
+        emitOk = emit(payload.data(), payload.size()) && emitOk;
+        payload.clear();
+    };
+    auto flush_copy = [&] {
+        if (copyLength == 0) return;
+        payload.push_back('C');
+        put_u64(payload, copySource);
+        put_u64(payload, copyLength);
+        copyLength = 0;
+        emit_ops(false);
+    };
+    auto close_literal = [&] {
+        if (literalAt == std::string::npos) return;
+        uint64_t len = payload.size() - literalAt - 8;
+        for (int i = 0; i < 8; i++) payload[literalAt + i] = static_cast<char>((len >> (8 * i)) & 0xff);
+        literalAt = std::string::npos;
+        emit_ops(false);
+    };
+    auto literal = [&](const char* data, size_t len) {
+        flush_copy();
+        if (literalAt == std::string::npos) {
+            payload.push_back('L');
+            literalAt = payload.size();
+            put_u64(payload, 0);
+        }
+        payload.append(data, len);
+        if (payload.size() - literalAt - 8 >= kMaxLiteralRun) close_literal();
+    };
+    auto over_limit = [&] {
+        return emitted + payload.size() > maxPayload;
+    };
+
+    while (true) {
+        // Refill so that a whole window past pos is buffered, if the file has it
+        uint64_t bufEnd = bufStart + buf.size();
+        if (!eof && pos + B > bufEnd) {
+            uint64_t keep = std::min(pos, signedTo);
+            buf.erase(buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(keep - bufStart));
+            bufStart = keep;
+            size_t have = buf.size();
+            buf.resize(have + kReadSize);
+            in.read(buf.data() + have, static_cast<std::streamsize>(kReadSize));
+            buf.resize(have + static_cast<size_t>(in.gcount()));
+            if (in.bad()) return false;
+            fileCrc = crc32(fileCrc, reinterpret_cast<const Bytef*>(buf.data() + have),
+                            static_cast<uInt>(in.gcount()));
+            eof = in.gcount() < static_cast<std::streamsize>(kReadSize);
+            bufEnd = bufStart + buf.size();
+            Stats::add(Stats::Counter::BytesRead, static_cast<uint64_t>(in.gcount()));
+        }
+
+        // Sign the new version's blocks as they become complete
+        while (signedTo < bufEnd && (signedTo + kBlockSize <= bufEnd || eof)) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(kBlockSize, bufEnd - signedTo));
+            sig.addBlocks(buf.data() + (signedTo - bufStart), n);
+            signedTo += n;
+        }
+
+        // Nothing else needs the rest of the file: the caller stores it whole
+        if (over_limit()) {
+            tooLarge = true;
+            return emitOk;
+        }
+        if (!emitOk) return false;
+
+        if (pos + B > bufEnd) {
+            // Less than a block left: a copy of the base's short last block, or literal
+            const char* rest = buf.data() + (pos - bufStart);
+            size_t restLen = static_cast<size_t>(bufEnd - pos);
+            size_t lastLen = static_cast<size_t>(base.fileSize % B);
+            bool same = false;
+            if (eof && restLen > 0 && restLen == lastLen && fullBlocks < base.weak.size()) {
+                uint64_t h[2];
+                murmur3_128(rest, restLen, h);
+                same = base.strong[fullBlocks * 2] == h[0] && base.strong[fullBlocks * 2 + 1] == h[1];
+            }
+            if (same) {
+                close_literal();
+                if (copyLength == 0 || copySource + copyLength != fullBlocks * B) {
+                    flush_copy();
+                    copySource = fullBlocks * B;
+                }
+                copyLength += restLen;
+            } else if (restLen > 0) {
+                literal(rest, restLen);
+            }
+            pos = bufEnd;
+            if (eof) break;
+            continue;
+        }
+
+        // Match or move on one byte at a time, up to the end of the buffer
+        while (pos + B <= bufEnd) {
+            const char* window = buf.data() + (pos - bufStart);
+            if (!rollingValid) {
+                rolling.reset(window, B);
+                rollingValid = true;
+            }
+            uint32_t weak = rolling.value();
+            uint32_t slot = filter_slot(weak);
+            long match = -1;
+            if (filter[slot / 64] & (1ULL << (slot % 64))) {
+                auto it = std::lower_bound(table.begin(), table.end(), std::make_pair(weak, 0u));
+                if (it != table.end() && it->first == weak) {
+                    uint64_t h[2];
+                    murmur3_128(window, B, h);
+                    for (; it != table.end() && it->first == weak; ++it) {
+                        if (base.strong[it->second * 2] == h[0] && base.strong[it->second * 2 + 1] == h[1]) {
+                            match = it->second;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (match >= 0) {
+                close_literal();
+                uint64_t source = static_cast<uint64_t>(match) * B;
+                if (copyLength > 0 && copySource + copyLength == source) {
+                    copyLength += B;
+                } else {
+                    flush_copy();
+                    copySource = source;
+                    copyLength = B;
+                }
+                pos += B;
+                rollingValid = false;
+                continue;
+            }
+            literal(window, 1);
+            if (pos + B < bufEnd) {
+                rolling.roll(static_cast<unsigned char>(window[0]), static_cast<unsigned char>(window[B]), B);
+            } else {
+                rollingValid = false;
+            }
+            pos++;
+            if (over_limit()) break;
+        }
+        if (over_limit()) {
+            tooLarge = true;
+            return emitOk;
+        }
+        if (eof && pos >= bufEnd) break;
+    }
+    close_literal();
+    flush_copy();
+    if (over_limit()) {
+        tooLarge = true;
+        return emitOk;
+    }
+    emit_ops(true);
+    crc = static_cast<uint32_t>(fileCrc);
+    return emitOk;
+}
+
+bool Delta::parse(uint64_t payloadSize, const std::function<bool(uint64_t, char*, size_t)>& read,
+                  std::vector<DeltaOp>& ops, uint64_t& size) {
+    ops.clear();
+    size = 0;
+    uint64_t p = 0;
+    char header[17];
+    while (p < payloadSize) {
+        if (!read(p, header, 1)) return false;
+        char type = header[0];
+        p++;
+        DeltaOp op;
+        op.target = size;
+        if (type == 'C') {
+            if (payloadSize - p < 16 || !read(p, header + 1, 16)) return false;
+            op.copy = true;
+            op.source = get_le(header + 1, 8);
+            op.length = get_le(header + 9, 8);
+            p += 16;
+        } else if (type == 'L') {
+            if (payloadSize - p < 8 || !read(p, header + 1, 8)) return false;
+            op.length = get_le(header + 1, 8);
+            p += 8;
+            if (op.length > payloadSize - p) return false;
+            op.source = p;
+            p += op.length;
+        } else {
+            return false;
+        }
+        size += op.length;
+        ops.push_back(op);
+    }
+    return true;
+}
+
+} // namespace bik
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bik {
+
+// Block signature of one version of a file: a rolling (rsync) checksum and a
+// 128-bit hash per fixed-size block. Kept in the archive beside the file, so
+// the next backup can encode the next version against it without reading or
+// decompressing this one.
+struct DeltaSignature {
+    uint32_t blockSize = 0;
+    uint64_t fileSize = 0;
+    std::vector<uint32_t> weak;
+    std::vector<uint64_t> strong;   // two words per block
+
+    // Append the signature of data, which starts at a block boundary
+    // (every block but the last must be blockSize long)
+    void addBlocks(const char* data, size_t len);
+
+    std::string serialize() const;
+    static bool parse(const std::string& data, DeltaSignature& sig);
+};
+
+// One step of rebuilding a file from a delta
+struct DeltaOp {
+    uint64_t target = 0;    // offset in the rebuilt file
+    uint64_t length = 0;
+    uint64_t source = 0;    // offset in the base file, or of the literal bytes in the payload
+    bool copy = false;
+};
+
+// rsync-style binary delta. The payload is a sequence of
+//   'C' | source u64 | length u64             copy from the base version
+//   'L' | length u64 | bytes                  literal bytes
+// covering the new file front to back.
+class Delta {
+public:
+    // Encode the file at path against base, handing the payload to emit in
+    // pieces of at most about kMaxLiteralRun bytes as it is produced. sig
+    // and crc receive the signature and CRC32 of the new version. Once the
+    // payload would exceed maxPayload, encoding stops right there (tooLarge
+    // is set, sig and crc are left incomplete).
+    static bool encode(const std::string& path, const DeltaSignature& base, uint64_t maxPayload,
+                       const std::function<bool(const char*, size_t)>& emit, DeltaSignature& sig,
+                       uint32_t& crc, bool& tooLarge);
+
+    // Split a payload of payloadSize bytes into ops, reading it through read
+    // (offset, buffer, length). Only op headers are read, literal bytes are
+    // skipped, so the payload never has to be in memory. size receives the
+    // length of the rebuilt file.
+    static bool parse(uint64_t payloadSize, const std::function<bool(uint64_t, char*, size_t)>& read,
+                      std::vector<DeltaOp>& ops, uint64_t& size);
+
+    // Block size of new signatures
+    static const uint32_t kBlockSize = 64 * 1024;
+
+    // Longest literal run; longer ones are split so the encoder only ever
+    // holds one run in memory
+    static const uint32_t kMaxLiteralRun = 1 << 20;
+};
+
+} // namespace bik
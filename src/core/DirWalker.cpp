@@ -0,0 +1,303 @@
+#include "core/DirWalker.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+#ifndef _WIN32
+
+// One directory's entries: names packed NUL-separated in a single buffer
+struct Listing {
+    std::string names;
+    std::vector<std::pair<size_t, DirWalker::Type>> entries;  // offset into names
+};
+
+DirWalker::Type type_from_mode(mode_t mode) {
+    if (S_ISREG(mode)) return DirWalker::Type::File;
+    if (S_ISDIR(mode)) return DirWalker::Type::Directory;
+    if (S_ISLNK(mode)) return DirWalker::Type::Symlink;
+    return DirWalker::Type::Other;
+}
+
+// d_type, or an lstat for filesystems that leave it DT_UNKNOWN
+DirWalker::Type entry_type(int dirFd, const char* name, unsigned char dtype) {
+    switch (dtype) {
+    case DT_REG: return DirWalker::Type::File;
+    case DT_DIR: return DirWalker::Type::Directory;
+    case DT_LNK: return DirWalker::Type::Symlink;
+    case DT_UNKNOWN: {
+        struct stat st;
+        if (::fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return DirWalker::Type::Other;
+        return type_from_mode(st.st_mode);
+    }
+    default: return DirWalker::Type::Other;
+    }
+}
+
+void add_entry(Listing& listing, int dirFd, const char* name, unsigned char dtype) {
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        return;
+    }
+    listing.entries.emplace_back(listing.names.size(), entry_type(dirFd, name, dtype));
+    listing.names.append(name);
+    listing.names.push_back('\0');
+}
+
+#if defined(__linux__)
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+
+bool read_dir(int fd, Listing& listing) {
+#if defined(__linux__)
+    // Large batches: one syscall returns hundreds of entries
+    alignas(8) char buf[64 * 1024];
+    for (;;) {
+        long n = ::syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return true;
+        for (long off = 0; off < n;) {
+            const LinuxDirent64* d = reinterpret_cast<const LinuxDirent64*>(buf + off);
+            add_entry(listing, fd, d->d_name, d->d_type);
+            off += d->d_reclen;
+        }
+    }
+#else
+    // readdir owns (and closes) the descriptor it is given
+    int dupFd = ::dup(fd);
+    if (dupFd < 0) return false;
+    DIR* dir = ::fdopendir(dupFd);
+    if (!dir) {
+        ::close(dupFd);
+        return false;
+    }
+    errno = 0;
+    while (struct dirent* d = ::readdir(dir)) {
+        add_entry(listing, fd, d->d_name, d->d_type);
+    }
+    bool ok = errno == 0;
+    ::closedir(dir);
+    return ok;
+#endif
+}
+
+int open_dir(int parentFd, const char* name) {
+    return ::openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+struct FdCloser {
+    int fd;
+    ~FdCloser() { ::close(fd); }
+};
+
+#else
+
+DirWalker::Type entry_type(const fs::directory_entry& entry) {
+    if (entry.is_symlink()) return DirWalker::Type::Symlink;
+    if (entry.is_directory()) return DirWalker::Type::Directory;
+    if (entry.is_regular_file()) return DirWalker::Type::File;
+    return DirWalker::Type::Other;
+}
+
+#endif
+
+void join(std::string& relPath, const char* name) {
+    if (!relPath.empty()) relPath.push_back('/');
+    relPath.append(name);
+}
+
+} // namespace
+
+DirWalker::DirWalker(const std::string& root) : m_root(root) {
+    while (m_root.size() > 1 && m_root.back() == '/') m_root.pop_back();
+}
+
+std::string DirWalker::absolutePath(const std::string& relPath) const {
+    return relPath.empty() ? m_root : m_root + "/" + relPath;
+}
+
+bool DirWalker::walk(const Visitor& visit) {
+    std::string relPath;
+    relPath.reserve(4096);
+#ifndef _WIN32
+    int fd = ::open(m_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Error reading directory " << m_root << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return walkDir(fd, relPath, visit);
+#else
+    // No getdents here: walk with std::filesystem, still skipping fs::relative
+    std::error_code ec;
+    auto it = fs::recursive_directory_iterator(m_root, ec);
+    size_t rootLen = fs::path(m_root).generic_string().size() + 1;
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        relPath = it->path().generic_string().substr(rootLen);
+        Type type = entry_type(*it);
+        Visit v = visit(relPath, type);
+        if (v == Visit::Stop) return false;
+        if (v == Visit::Skip && type == Type::Directory) it.disable_recursion_pending();
+    }
+    if (ec) {
+        std::cerr << "Error reading directory " << m_root << ": " << ec.message() << std::endl;
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool DirWalker::walkDir(int fd, std::string& relPath, const Visitor& visit) {
+#ifndef _WIN32
+    FdCloser closer{fd};
+    Listing listing;
+    if (!read_dir(fd, listing)) {
+        std::cerr << "Error reading directory " << absolutePath(relPath) << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    size_t base = relPath.size();
+    for (const auto& entry : listing.entries) {
+        const char* name = listing.names.c_str() + entry.first;
+        join(relPath, name);
+        bool ok = true;
+        Visit v = visit(relPath, entry.second);
+        if (v == Visit::Stop) {
+            ok = false;
+        } else if (v == Visit::Continue && entry.second == Type::Directory) {
+            int child = open_dir(fd, name);
+            if (child < 0) {
+                std::cerr << "Error reading directory " << absolutePath(relPath) << ": " << std::strerror(errno)
+                          << std::endl;
+                ok = false;
+            } else {
+                ok = walkDir(child, relPath, visit);
+            }
+        }
+        relPath.resize(base);
+        if (!ok) return false;
+    }
+    return true;
+#else
+    (void)fd;
+    (void)relPath;
+    (void)visit;
+    return false;
+#endif
+}
+
+bool DirWalker::collect(std::vector<Item>& items, unsigned jobs) {
+    items.clear();
+#ifndef _WIN32
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    int rootFd = ::open(m_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rootFd < 0) {
+        std::cerr << "Error reading directory " << m_root << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    FdCloser rootCloser{rootFd};
+
+    // Directories still to read, shared by the workers; a worker that finds
+    // the queue empty waits until nobody can add to it any more
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::string> pending{std::string()};
+    size_t busy = 0;
+    bool failed = false;
+    std::vector<std::vector<Item>> found(jobs);
+
+    auto worker = [&](std::vector<Item>& out) {
+        for (;;) {
+            std::string dir;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return !pending.empty() || busy == 0 || failed; });
+                if (pending.empty() || failed) return;
+                dir = std::move(pending.front());
+                pending.pop_front();
+                busy++;
+            }
+
+            std::vector<std::string> subdirs;
+            bool ok = false;
+            int fd = open_dir(rootFd, dir.empty() ? "." : dir.c_str());
+            if (fd >= 0) {
+                FdCloser closer{fd};
+                Listing listing;
+                ok = read_dir(fd, listing);
+                for (const auto& entry : listing.entries) {
+                    std::string relPath = dir;
+                    join(relPath, listing.names.c_str() + entry.first);
+                    if (entry.second == Type::Directory) subdirs.push_back(relPath);
+                    out.push_back(Item{std::move(relPath), entry.second});
+                }
+            }
+            if (!ok) {
+                std::cerr << "Error reading directory " << absolutePath(dir) << ": " << std::strerror(errno)
+                          << std::endl;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& d : subdirs) pending.push_back(std::move(d));
+            busy--;
+            if (!ok) failed = true;
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < jobs; i++) {
+        threads.emplace_back(worker, std::ref(found[i]));
+    }
+    worker(found[0]);
+    for (auto& t : threads) t.join();
+    if (failed) return false;
+
+    size_t total = 0;
+    for (const auto& f : found) total += f.size();
+    items.reserve(total);
+    for (auto& f : found) {
+        std::move(f.begin(), f.end(), std::back_inserter(items));
+    }
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.relPath < b.relPath; });
+    return true;
+#else
+    (void)jobs;
+    return walk([&](const std::string& relPath, Type type) {
+        items.push_back(Item{relPath, type});
+        return Visit::Continue;
+    });
+#endif
+}
+
+} // namespace bik
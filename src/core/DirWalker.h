@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bik {
+
+// Directory tree walk for backups. On POSIX it reads directories with
+// openat/getdents64 and takes entry types from d_type, so entries are not
+// stat'ed just to be classified, and relative paths are built in one reused
+// buffer instead of being derived from absolute ones.
+class DirWalker {
+public:
+    enum class Type { File, Directory, Symlink, Other };
+
+    // What a visitor wants next: Skip on a directory leaves its contents out
+    enum class Visit { Continue, Skip, Stop };
+
+    // relPath is '/'-separated and only valid during the call
+    using Visitor = std::function<Visit(const std::string& relPath, Type type)>;
+
+    struct Item {
+        std::string relPath;
+        Type type;
+    };
+
+    explicit DirWalker(const std::string& root);
+
+    // Depth-first, each directory before its contents, in directory order.
+    // Symlinks are reported, never followed. False on an I/O error or Stop.
+    bool walk(const Visitor& visit);
+
+    // Every entry below root, subtrees read on up to jobs threads (0: one per
+    // core), sorted by path
+    bool collect(std::vector<Item>& items, unsigned jobs = 0);
+
+    std::string absolutePath(const std::string& relPath) const;
+
+private:
+    bool walkDir(int fd, std::string& relPath, const Visitor& visit);
+
+    std::string m_root;
+};
+
+} // namespace bik
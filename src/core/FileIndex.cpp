@@ -0,0 +1,148 @@
+#include "core/FileIndex.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+FileIndex::FileIndex() {
+}
+
+FileIndex::~FileIndex() {
+}
+
+bool FileIndex::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    clear();
+    std::string line;
+
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        if (line.rfind("archive=", 0) == 0) {
+            m_archive = line.substr(8);
+            continue;
+        }
+
+        // size \t mtime \t inode \t crc \t path
+        std::istringstream fields(line);
+        FileIndexEntry entry;
+        if (!(fields >> entry.size >> entry.mtimeNs >> entry.inode >> entry.crc)) {
+            continue;
+        }
+        fields.get();
+        std::getline(fields, entry.path);
+        if (!entry.path.empty()) {
+            m_entries[entry.path] = entry;
+        }
+    }
+
+    return true;
+}
+
+bool FileIndex::save(const std::string& path) const {
+    // Write to a temp file and rename so a crash never leaves a torn index
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        file << "# Bik File Index\n";
+        file << "archive=" << m_archive << "\n";
+        for (const auto& pair : m_entries) {
+            const FileIndexEntry& e = pair.second;
+            file << e.size << '\t' << e.mtimeNs << '\t' << e.inode << '\t'
+                 << e.crc << '\t' << e.path << '\n';
+        }
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    return !ec;
+}
+
+void FileIndex::setArchive(const std::string& archivePath) {
+    m_archive = archivePath;
+}
+
+std::string FileIndex::archive() const {
+    return m_archive;
+}
+
+void FileIndex::set(const FileIndexEntry& entry) {
+    m_entries[entry.path] = entry;
+}
+
+const FileIndexEntry* FileIndex::find(const std::string& relPath) const {
+    auto it = m_entries.find(relPath);
+    if (it != m_entries.end()) {
+        return &it->second;
+    }
+    return nullptr;
+}
+
+void FileIndex::clear() {
+    m_archive.clear();
+    m_entries.clear();
+}
+
+size_t FileIndex::size() const {
+    return m_entries.size();
+}
+
+const std::unordered_map<std::string, FileIndexEntry>& FileIndex::entries() const {
+    return m_entries;
+}
+
+bool FileIndex::isUnchanged(const FileIndexEntry& current) const {
+    const FileIndexEntry* old = find(current.path);
+    return old && old->size == current.size && old->mtimeNs == current.mtimeNs
+        && old->inode == current.inode;
+}
+
+bool FileIndex::statFile(const std::string& absPath, FileIndexEntry& entry) {
+#ifndef _WIN32
+    struct stat st;
+    if (::stat(absPath.c_str(), &st) != 0) {
+        return false;
+    }
+    entry.size = static_cast<uint64_t>(st.st_size);
+#if defined(__APPLE__)
+    entry.mtimeNs = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    entry.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    entry.inode = static_cast<uint64_t>(st.st_ino);
+    return true;
+#else
+    std::error_code ec;
+    entry.size = fs::file_size(absPath, ec);
+    if (ec) return false;
+    auto ftime = fs::last_write_time(absPath, ec);
+    if (ec) return false;
+    entry.mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(ftime.time_since_epoch()).count();
+    entry.inode = 0;
+    return true;
+#endif
+}
+
+} // namespace bik
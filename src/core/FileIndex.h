@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace bik {
+
+struct FileIndexEntry {
+    std::string path;       // relative, '/'-separated
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;    // modification time in nanoseconds since epoch
+    uint64_t inode = 0;
+    uint32_t crc = 0;       // CRC32 as stored in the archive
+};
+
+// Per-file stat index describing the files stored in one archive. Used to
+// decide which entries can be copied unchanged from the previous backup.
+class FileIndex {
+public:
+    FileIndex();
+    ~FileIndex();
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    // Archive this index describes
+    void setArchive(const std::string& archivePath);
+    std::string archive() const;
+
+    void set(const FileIndexEntry& entry);
+    const FileIndexEntry* find(const std::string& relPath) const;
+    void clear();
+    size_t size() const;
+
+    const std::unordered_map<std::string, FileIndexEntry>& entries() const;
+
+    // True if the file described by current has the same size, mtime and
+    // inode as the indexed entry for the same path
+    bool isUnchanged(const FileIndexEntry& current) const;
+
+    // Fill size, mtime and inode of a file on disk
+    static bool statFile(const std::string& absPath, FileIndexEntry& entry);
+
+private:
+    std::string m_archive;
+    std::unordered_map<std::string, FileIndexEntry> m_entries;
+};
+
+} // namespace bik
@@ -0,0 +1,129 @@
+#include "core/FileMeta.h"
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+const uint8_t kExtraVersion = 1;
+const size_t kExtraSize = 1 + 4 + 8;
+// Optional trailing hash; readers that predate it ignore the extra bytes
+const size_t kExtraHashSize = 16;
+
+} // namespace
+
+void FileMeta::setMode(uint32_t unixMode) {
+    mode = unixMode;
+    // S_IFLNK is the same on every Unix and in zip external attributes
+    symlink = (unixMode & 0170000) == 0120000;
+}
+
+bool FileMeta::read(const std::string& path, FileMeta& meta) {
+#ifndef _WIN32
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    meta.mode = static_cast<uint32_t>(st.st_mode);
+#if defined(__APPLE__)
+    meta.mtimeNs = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    meta.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    meta.symlink = S_ISLNK(st.st_mode);
+    meta.linkTarget.clear();
+    if (meta.symlink) {
+        std::error_code ec;
+        meta.linkTarget = fs::read_symlink(path, ec).string();
+        if (ec) return false;
+    }
+    return true;
+#else
+    std::error_code ec;
+    auto status = fs::symlink_status(path, ec);
+    if (ec) return false;
+    meta.mode = 0;
+    meta.symlink = fs::is_symlink(status);
+    auto ftime = fs::last_write_time(path, ec);
+    meta.mtimeNs = ec ? 0 : std::chrono::duration_cast<std::chrono::nanoseconds>(ftime.time_since_epoch()).count();
+    if (meta.symlink) meta.linkTarget = fs::read_symlink(path, ec).string();
+    return true;
+#endif
+}
+
+bool FileMeta::apply(const std::string& path) const {
+#ifndef _WIN32
+    bool ok = true;
+    if (!symlink && mode != 0) {
+        ok = ::chmod(path.c_str(), static_cast<mode_t>(mode & 07777)) == 0;
+    }
+    if (mtimeNs != 0) {
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = static_cast<time_t>(mtimeNs / 1000000000LL);
+        times[1].tv_nsec = static_cast<long>(mtimeNs % 1000000000LL);
+        if (times[1].tv_nsec < 0) {
+            times[1].tv_sec -= 1;
+            times[1].tv_nsec += 1000000000L;
+        }
+        ok = ::utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW) == 0 && ok;
+    }
+    return ok;
+#else
+    return true;
+#endif
+}
+
+std::string FileMeta::encodeExtra() const {
+    // version:u8 mode:u32le mtime_ns:i64le [hash:u64le u64le]
+    std::string out(kExtraSize + (hasHash ? kExtraHashSize : 0), '\0');
+    out[0] = static_cast<char>(kExtraVersion);
+    for (int i = 0; i < 4; i++) {
+        out[1 + i] = static_cast<char>((mode >> (8 * i)) & 0xff);
+    }
+    uint64_t t = static_cast<uint64_t>(mtimeNs);
+    for (int i = 0; i < 8; i++) {
+        out[5 + i] = static_cast<char>((t >> (8 * i)) & 0xff);
+    }
+    if (hasHash) {
+        for (int i = 0; i < 16; i++) {
+            out[kExtraSize + i] = static_cast<char>((hash[i / 8] >> (8 * (i % 8))) & 0xff);
+        }
+    }
+    return out;
+}
+
+bool FileMeta::decodeExtra(const uint8_t* data, size_t len, FileMeta& meta) {
+    if (!data || len < kExtraSize || data[0] != kExtraVersion) {
+        return false;
+    }
+    uint32_t mode = 0;
+    for (int i = 0; i < 4; i++) {
+        mode |= static_cast<uint32_t>(data[1 + i]) << (8 * i);
+    }
+    uint64_t t = 0;
+    for (int i = 0; i < 8; i++) {
+        t |= static_cast<uint64_t>(data[5 + i]) << (8 * i);
+    }
+    meta.setMode(mode);
+    meta.mtimeNs = static_cast<int64_t>(t);
+    meta.hasHash = len >= kExtraSize + kExtraHashSize;
+    meta.hash[0] = meta.hash[1] = 0;
+    for (size_t i = 0; meta.hasHash && i < 16; i++) {
+        meta.hash[i / 8] |= static_cast<uint64_t>(data[kExtraSize + i]) << (8 * (i % 8));
+    }
+    return true;
+}
+
+} // namespace bik
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace bik {
+
+// File attributes that have to survive a backup/restore round trip so build
+// systems see restored files as up to date: Unix mode, nanosecond mtime and
+// symlink targets.
+struct FileMeta {
+    uint32_t mode = 0;          // st_mode including file type bits; 0 if unknown
+    int64_t mtimeNs = 0;        // modification time in nanoseconds since epoch
+    bool symlink = false;
+    std::string linkTarget;
+    // murmur3_128 of the entry's data, which bik verify checks zip entries
+    // against; only carried through the zip extra field
+    bool hasHash = false;
+    uint64_t hash[2] = {0, 0};
+
+    // Set mode from Unix st_mode bits, deriving the symlink flag
+    void setMode(uint32_t unixMode);
+
+    // Read the attributes of path itself (symlinks are not followed)
+    static bool read(const std::string& path, FileMeta& meta);
+
+    // Apply mode and mtime to path (mode is skipped when unknown or for symlinks)
+    bool apply(const std::string& path) const;
+
+    // Payload of the bik zip extra field carrying mode, mtime and the hash
+    std::string encodeExtra() const;
+    static bool decodeExtra(const uint8_t* data, size_t len, FileMeta& meta);
+
+    // Extra field header id ("bk")
+    static const uint16_t kExtraFieldId = 0x6b62;
+};
+
+} // namespace bik
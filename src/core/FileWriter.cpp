@@ -0,0 +1,219 @@
+#include "core/FileWriter.h"
+#include "core/Stats.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace bik {
+
+namespace {
+
+// Largest write issued at once, and the cap of the coalescing buffer
+const size_t kBufferSize = 1 << 20;
+
+} // namespace
+
+FileWriter::FileWriter() : m_fd(-1), m_used(0), m_written(0), m_preallocated(0), m_ok(false) {
+}
+
+FileWriter::~FileWriter() {
+    close();
+}
+
+bool FileWriter::open(const std::string& path, uint64_t expectedSize) {
+    close();
+    m_used = 0;
+    m_written = 0;
+    m_preallocated = 0;
+    // Small files get a small buffer; it only has to hold one file
+    m_buffer.resize(static_cast<size_t>(std::min<uint64_t>(std::max<uint64_t>(expectedSize, 4096), kBufferSize)));
+#ifndef _WIN32
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (m_fd < 0) {
+        return false;
+    }
+#if defined(__linux__)
+    // Reserve the extents up front: less fragmentation, no allocation per write.
+    // Filesystems without fallocate just skip it.
+    if (expectedSize > 0 && ::fallocate(m_fd, 0, 0, static_cast<off_t>(expectedSize)) == 0) {
+        m_preallocated = expectedSize;
+    }
+#endif
+#else
+    m_stream.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_stream) {
+        return false;
+    }
+#endif
+    m_ok = true;
+    return true;
+}
+
+bool FileWriter::write(const char* data, size_t len) {
+    if (!m_ok) return false;
+    if (m_used + len > m_buffer.size() && !flush()) {
+        return false;
+    }
+    // Large blocks skip the buffer
+    if (len >= m_buffer.size()) {
+        return writeAll(data, len);
+    }
+    std::memcpy(m_buffer.data() + m_used, data, len);
+    m_used += len;
+    return true;
+}
+
+bool FileWriter::flush() {
+    if (m_used == 0) return true;
+    bool ok = writeAll(m_buffer.data(), m_used);
+    m_used = 0;
+    return ok;
+}
+
+bool FileWriter::writeAll(const char* data, size_t len) {
+#ifndef _WIN32
+    while (len > 0) {
+        ssize_t n = ::write(m_fd, data, std::min(len, kBufferSize));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            m_ok = false;
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+        m_written += static_cast<uint64_t>(n);
+    }
+    return true;
+#else
+    m_stream.write(data, static_cast<std::streamsize>(len));
+    m_written += len;
+    if (!m_stream) m_ok = false;
+    return m_ok;
+#endif
+}
+
+bool FileWriter::close() {
+#ifndef _WIN32
+    if (m_fd < 0) return m_ok;
+    bool ok = m_ok && flush();
+    // The archive's size was wrong (or the write failed): drop the slack
+    if (m_preallocated > m_written && ::ftruncate(m_fd, static_cast<off_t>(m_written)) != 0) {
+        ok = false;
+    }
+    if (::close(m_fd) != 0) {
+        ok = false;
+    }
+    m_fd = -1;
+#else
+    if (!m_stream.is_open()) return m_ok;
+    bool ok = m_ok && flush();
+    m_stream.close();
+    if (!m_stream) ok = false;
+#endif
+    Stats::add(Stats::Counter::BytesWritten, m_written);
+    m_ok = false;
+    std::vector<char>().swap(m_buffer);
+    return ok;
+}
+
+uint64_t FileWriter::written() const {
+    return m_written;
+}
+
+bool FileWriter::copyFile(const std::string& from, const std::string& to) {
+#ifndef _WIN32
+    int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    struct stat st;
+    if (::fstat(in, &st) != 0) {
+        ::close(in);
+        return false;
+    }
+    int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+
+    bool ok = false;
+    bool done = false;
+#if defined(__linux__)
+    // Reflink: the copy shares the source's extents (btrfs, XFS, ...)
+    if (::ioctl(out, FICLONE, in) == 0) {
+        ok = done = true;
+    }
+    if (!done) {
+        uint64_t remaining = static_cast<uint64_t>(st.st_size);
+        while (remaining > 0) {
+            ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, std::min<uint64_t>(remaining, 1ULL << 30), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            remaining -= static_cast<uint64_t>(n);
+        }
+        if (remaining == 0) {
+            ok = done = true;
+        } else if (::lseek(in, 0, SEEK_SET) != 0 || ::lseek(out, 0, SEEK_SET) != 0 || ::ftruncate(out, 0) != 0) {
+            done = true;
+        }
+    }
+#endif
+    if (!done) {
+        std::vector<char> buf(kBufferSize);
+        ok = true;
+        while (ok) {
+            ssize_t n = ::read(in, buf.data(), buf.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                ok = n == 0;
+                break;
+            }
+            for (ssize_t off = 0; off < n;) {
+                ssize_t w = ::write(out, buf.data() + off, static_cast<size_t>(n - off));
+                if (w < 0 && errno == EINTR) continue;
+                if (w <= 0) {
+                    ok = false;
+                    break;
+                }
+                off += w;
+            }
+        }
+    }
+    ::close(in);
+    if (::close(out) != 0) ok = false;
+    return ok;
+#else
+    std::ifstream src(from, std::ios::binary);
+    std::ofstream dst(to, std::ios::binary | std::ios::trunc);
+    dst << src.rdbuf();
+    return src && dst;
+#endif
+}
+
+bool FileWriter::syncFilesystem(const std::string& path) {
+#if defined(__linux__)
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = ::syncfs(fd) == 0;
+    ::close(fd);
+    return ok;
+#elif !defined(_WIN32)
+    (void)path;
+    ::sync();
+    return true;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+} // namespace bik
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace bik {
+
+// Output side of extraction. A file is preallocated to its known size, and
+// data reaches the kernel in large writes (up to 1 MB). Durability is left to
+// a single syncFilesystem() call at the end of a restore instead of one
+// fsync per file.
+class FileWriter {
+public:
+    FileWriter();
+    ~FileWriter();
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    // Create or truncate path; expectedSize (if known) is preallocated
+    bool open(const std::string& path, uint64_t expectedSize = 0);
+    bool write(const char* data, size_t len);
+    // Flush, trim any unused preallocation and close; false if anything failed
+    bool close();
+
+    uint64_t written() const;
+
+    // Copy a file, sharing extents (FICLONE) or copying inside the kernel
+    // (copy_file_range) when the filesystem allows, plain read/write otherwise
+    static bool copyFile(const std::string& from, const std::string& to);
+
+    // One durability barrier for everything written under path
+    static bool syncFilesystem(const std::string& path);
+
+private:
+    bool flush();
+    bool writeAll(const char* data, size_t len);
+
+    int m_fd;
+    std::ofstream m_stream;         // used where POSIX I/O is unavailable
+    std::vector<char> m_buffer;
+    size_t m_used;
+    uint64_t m_written;
+    uint64_t m_preallocated;
+    bool m_ok;
+};
+
+} // namespace bik
@@ -0,0 +1,96 @@
+#include "core/Glob.h"
+
+namespace bik {
+
+namespace {
+
+// Match one [...] class at pattern[p] against c; p is moved past the class.
+// A class without a closing ']' is taken as a literal '['.
+bool match_class(const std::string& pattern, size_t& p, char c) {
+    size_t i = p + 1;
+    bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+    if (negate) i++;
+    bool matched = false;
+    bool first = true;
+    for (; i < pattern.size() && (first || pattern[i] != ']'); i++, first = false) {
+        char lo = pattern[i];
+        char hi = lo;
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            hi = pattern[i + 2];
+            i += 2;
+        }
+        if (c >= lo && c <= hi) matched = true;
+    }
+    if (i >= pattern.size()) {
+        // Unterminated: literal '['
+        p++;
+        return c == '[';
+    }
+    p = i + 1;
+    return matched != negate && c != '/';
+}
+
+bool match_from(const std::string& pattern, size_t p, const std::string& path, size_t s) {
+    while (p < pattern.size()) {
+        char pc = pattern[p];
+        if (pc == '*') {
+            bool doubleStar = p + 1 < pattern.size() && pattern[p + 1] == '*';
+            if (doubleStar) {
+                p += 2;
+                // "**/" may also match nothing at all
+                if (p < pattern.size() && pattern[p] == '/') {
+                    if (match_from(pattern, p + 1, path, s)) return true;
+                }
+                for (size_t k = s; k <= path.size(); k++) {
+                    if (match_from(pattern, p, path, k)) return true;
+                }
+                return false;
+            }
+            p++;
+            for (size_t k = s; k <= path.size(); k++) {
+                if (match_from(pattern, p, path, k)) return true;
+                if (k < path.size() && path[k] == '/') break;
+            }
+            return false;
+        }
+        if (s >= path.size()) return false;
+        if (pc == '?') {
+            if (path[s] == '/') return false;
+            p++;
+        } else if (pc == '[') {
+            if (!match_class(pattern, p, path[s])) return false;
+        } else {
+            if (pc != path[s]) return false;
+            p++;
+        }
+        s++;
+    }
+    return s == path.size();
+}
+
+std::string normalize(const std::string& pattern) {
+    std::string p = pattern;
+    while (p.rfind("./", 0) == 0) p.erase(0, 2);
+    while (p.size() > 1 && p.back() == '/') p.pop_back();
+    return p;
+}
+
+} // namespace
+
+bool globMatch(const std::string& pattern, const std::string& path) {
+    return match_from(pattern, 0, path, 0);
+}
+
+bool hasGlobChars(const std::string& pattern) {
+    return pattern.find_first_of("*?[") != std::string::npos;
+}
+
+bool pathSelected(const std::string& pattern, const std::string& path) {
+    std::string p = normalize(pattern);
+    if (hasGlobChars(p)) {
+        return globMatch(p, path);
+    }
+    return path == p || (path.size() > p.size() && path.compare(0, p.size(), p) == 0 && path[p.size()] == '/');
+}
+
+} // namespace bik
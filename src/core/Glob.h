@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace bik {
+
+// Shell-style match of a relative, '/'-separated path.
+//   *      any run of characters except '/'
+//   **     any run of characters including '/' ("a/**/b" also matches "a/b")
+//   ?      one character except '/'
+//   [...]  one character from the set ("[!...]" or "[^...]" negates, ranges allowed)
+bool globMatch(const std::string& pattern, const std::string& path);
+
+// True if pattern contains any of * ? [
+bool hasGlobChars(const std::string& pattern);
+
+// Match a restore/select pattern: a glob, or a plain path naming a file or
+// any directory above it
+bool pathSelected(const std::string& pattern, const std::string& path);
+
+} // namespace bik
@@ -0,0 +1,224 @@
+#include "core/Hash.h"
+#include <algorithm>
+#include <cstring>
+
+namespace bik {
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t get_le64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+inline uint64_t fmix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+} // namespace
+
+Sha256::Sha256() : m_length(0), m_bufferLen(0) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    std::memcpy(m_state, init, sizeof(m_state));
+}
+
+void Sha256::transform(const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t(block[i * 4]) << 24) | (uint32_t(block[i * 4 + 1]) << 16)
+             | (uint32_t(block[i * 4 + 2]) << 8) | uint32_t(block[i * 4 + 3]);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+    uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + S1 + ch + K[i] + w[i];
+        uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = S0 + maj;
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+    m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+}
+
+void Sha256::update(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    m_length += len;
+
+    if (m_bufferLen > 0) {
+        size_t take = std::min(len, sizeof(m_buffer) - m_bufferLen);
+        std::memcpy(m_buffer + m_bufferLen, p, take);
+        m_bufferLen += take;
+        p += take;
+        len -= take;
+        if (m_bufferLen < sizeof(m_buffer)) return;
+        transform(m_buffer);
+        m_bufferLen = 0;
+    }
+    while (len >= 64) {
+        transform(p);
+        p += 64;
+        len -= 64;
+    }
+    if (len > 0) {
+        std::memcpy(m_buffer, p, len);
+        m_bufferLen = len;
+    }
+}
+
+void Sha256::final(uint8_t digest[32]) {
+    uint64_t bits = m_length * 8;
+    uint8_t pad[72] = {0x80};
+    size_t padLen = (m_bufferLen < 56) ? (56 - m_bufferLen) : (120 - m_bufferLen);
+    for (int i = 0; i < 8; i++) {
+        pad[padLen + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    }
+    update(pad, padLen + 8);
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = static_cast<uint8_t>(m_state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(m_state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(m_state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(m_state[i]);
+    }
+}
+
+std::string Sha256::hex(const void* data, size_t len) {
+    Sha256 h;
+    h.update(data, len);
+    uint8_t digest[32];
+    h.final(digest);
+    return toHex(digest, sizeof(digest));
+}
+
+std::string toHex(const uint8_t* data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(len * 2, '0');
+    for (size_t i = 0; i < len; i++) {
+        out[i * 2] = digits[data[i] >> 4];
+        out[i * 2 + 1] = digits[data[i] & 0xf];
+    }
+    return out;
+}
+
+void murmur3_128(const void* input, size_t len, uint64_t out[2]) {
+    Murmur3 h;
+    h.update(input, len);
+    h.final(out);
+}
+
+namespace {
+
+const uint64_t kMurmurC1 = 0x87c37b91114253d5ULL;
+const uint64_t kMurmurC2 = 0x4cf5ad432745937fULL;
+
+} // namespace
+
+Murmur3::Murmur3() : m_h1(0), m_h2(0), m_length(0), m_bufferLen(0) {}
+
+void Murmur3::mix(const unsigned char block[16]) {
+    uint64_t k1 = get_le64(block);
+    uint64_t k2 = get_le64(block + 8);
+    k1 *= kMurmurC1; k1 = rotl64(k1, 31); k1 *= kMurmurC2; m_h1 ^= k1;
+    m_h1 = rotl64(m_h1, 27); m_h1 += m_h2; m_h1 = m_h1 * 5 + 0x52dce729;
+    k2 *= kMurmurC2; k2 = rotl64(k2, 33); k2 *= kMurmurC1; m_h2 ^= k2;
+    m_h2 = rotl64(m_h2, 31); m_h2 += m_h1; m_h2 = m_h2 * 5 + 0x38495ab5;
+}
+
+void Murmur3::update(const void* data, size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    m_length += len;
+
+    if (m_bufferLen > 0) {
+        size_t take = std::min(len, sizeof(m_buffer) - m_bufferLen);
+        std::memcpy(m_buffer + m_bufferLen, p, take);
+        m_bufferLen += take;
+        p += take;
+        len -= take;
+        if (m_bufferLen < sizeof(m_buffer)) return;
+        mix(m_buffer);
+        m_bufferLen = 0;
+    }
+    while (len >= 16) {
+        mix(p);
+        p += 16;
+        len -= 16;
+    }
+    if (len > 0) {
+        std::memcpy(m_buffer, p, len);
+        m_bufferLen = len;
+    }
+}
+
+void Murmur3::final(uint64_t out[2]) {
+    const unsigned char* tail = m_buffer;
+    uint64_t h1 = m_h1;
+    uint64_t h2 = m_h2;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    switch (m_bufferLen) {
+    case 15: k2 ^= static_cast<uint64_t>(tail[14]) << 48; // fall through
+    case 14: k2 ^= static_cast<uint64_t>(tail[13]) << 40; // fall through
+    case 13: k2 ^= static_cast<uint64_t>(tail[12]) << 32; // fall through
+    case 12: k2 ^= static_cast<uint64_t>(tail[11]) << 24; // fall through
+    case 11: k2 ^= static_cast<uint64_t>(tail[10]) << 16; // fall through
+    case 10: k2 ^= static_cast<uint64_t>(tail[9]) << 8;   // fall through
+    case 9:  k2 ^= static_cast<uint64_t>(tail[8]);
+             k2 *= kMurmurC2; k2 = rotl64(k2, 33); k2 *= kMurmurC1; h2 ^= k2; // fall through
+    case 8:  k1 ^= static_cast<uint64_t>(tail[7]) << 56;  // fall through
+    case 7:  k1 ^= static_cast<uint64_t>(tail[6]) << 48;  // fall through
+    case 6:  k1 ^= static_cast<uint64_t>(tail[5]) << 40;  // fall through
+    case 5:  k1 ^= static_cast<uint64_t>(tail[4]) << 32;  // fall through
+    case 4:  k1 ^= static_cast<uint64_t>(tail[3]) << 24;  // fall through
+    case 3:  k1 ^= static_cast<uint64_t>(tail[2]) << 16;  // fall through
+    case 2:  k1 ^= static_cast<uint64_t>(tail[1]) << 8;   // fall through
+    case 1:  k1 ^= static_cast<uint64_t>(tail[0]);
+             k1 *= kMurmurC1; k1 = rotl64(k1, 31); k1 *= kMurmurC2; h1 ^= k1;
+    }
+    h1 ^= m_length; h2 ^= m_length;
+    h1 += h2; h2 += h1;
+    h1 = fmix(h1); h2 = fmix(h2);
+    h1 += h2; h2 += h1;
+    out[0] = h1;
+    out[1] = h2;
+}
+
+} // namespace bik
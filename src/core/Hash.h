@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bik {
+
+// Incremental SHA-256, used to address content-defined chunks
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void* data, size_t len);
+    void final(uint8_t digest[32]);
+
+    // One-shot hash of a buffer as a lowercase hex string
+    static std::string hex(const void* data, size_t len);
+
+private:
+    void transform(const uint8_t block[64]);
+
+    uint32_t m_state[8];
+    uint64_t m_length;
+    uint8_t m_buffer[64];
+    size_t m_bufferLen;
+};
+
+// Lowercase hex encoding of a byte string
+std::string toHex(const uint8_t* data, size_t len);
+
+// MurmurHash3 x64_128. Not cryptographic, but several GB/s per core: the
+// strong hash of delta signatures, native archive blocks and zip entries,
+// where it backs up a CRC32 rather than standing alone.
+void murmur3_128(const void* data, size_t len, uint64_t out[2]);
+
+// Incremental murmur3_128, for data that arrives in pieces; the result is
+// the same as one murmur3_128 call over the concatenation
+class Murmur3 {
+public:
+    Murmur3();
+
+    void update(const void* data, size_t len);
+    void final(uint64_t out[2]);
+
+private:
+    void mix(const unsigned char block[16]);
+
+    uint64_t m_h1;
+    uint64_t m_h2;
+    uint64_t m_length;
+    unsigned char m_buffer[16];
+    size_t m_bufferLen;
+};
+
+} // namespace bik
@@ -0,0 +1,192 @@
+#include "core/IgnoreMatcher.h"
+#include "core/Glob.h"
+#include <fstream>
+#include <sstream>
+
+namespace bik {
+
+const char* const IgnoreMatcher::kFileName = ".bikignore";
+
+namespace {
+
+std::string base_name(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Trailing spaces are dropped unless escaped with a backslash
+void trim_trailing(std::string& line) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    while (!line.empty() && line.back() == ' ') {
+        if (line.size() >= 2 && line[line.size() - 2] == '\\') {
+            line.erase(line.size() - 2, 1);
+            break;
+        }
+        line.pop_back();
+    }
+}
+
+} // namespace
+
+IgnoreMatcher::IgnoreMatcher() {
+}
+
+void IgnoreMatcher::addRules(const std::string& baseDir, const std::string& text) {
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        trim_trailing(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        Rule rule;
+        rule.base = baseDir;
+        if (line[0] == '!') {
+            rule.negate = true;
+            line.erase(0, 1);
+        } else if (line[0] == '\\') {
+            // "\#" and "\!" start literal patterns
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.dirOnly = true;
+            while (!line.empty() && line.back() == '/') line.pop_back();
+        }
+        // A slash anywhere but the end ties the pattern to this directory;
+        // a leading "**/" undoes that again
+        if (line.find('/') != std::string::npos) {
+            rule.anchored = true;
+            if (line[0] == '/') line.erase(0, 1);
+        }
+        while (line.rfind("**/", 0) == 0 && line.find('/', 3) == std::string::npos) {
+            line.erase(0, 3);
+            rule.anchored = false;
+        }
+        if (line.empty()) {
+            continue;
+        }
+        rule.pattern = line;
+
+        int index = static_cast<int>(m_rules.size());
+        if (!hasGlobChars(line)) {
+            if (rule.anchored) {
+                m_byPath[baseDir.empty() ? line : baseDir + "/" + line].push_back(index);
+            } else {
+                m_byName[line].push_back(index);
+            }
+        } else if (!rule.anchored && line[0] == '*' && line.size() > 1 && !hasGlobChars(line.substr(1))) {
+            // "*.o", "*~": a suffix test on the name
+            m_bySuffix[line.substr(1)].push_back(index);
+            m_suffixLengths.insert(line.size() - 1);
+        } else {
+            m_globs.push_back(index);
+        }
+        m_rules.push_back(std::move(rule));
+    }
+}
+
+bool IgnoreMatcher::enterDirectory(const std::string& absDir, const std::string& relDir) {
+    if (!m_entered.insert(relDir).second) {
+        return false;
+    }
+    std::ifstream file(absDir + "/" + kFileName, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    addRules(relDir, text.str());
+    return true;
+}
+
+bool IgnoreMatcher::applies(const Rule& rule, const std::string& relPath, bool isDir) const {
+    if (rule.dirOnly && !isDir) {
+        return false;
+    }
+    // Rules only reach below the directory of their .bikignore
+    if (!rule.base.empty()) {
+        if (relPath.size() <= rule.base.size() || relPath.compare(0, rule.base.size(), rule.base) != 0 ||
+            relPath[rule.base.size()] != '/') {
+            return false;
+        }
+    }
+    return true;
+}
+
+void IgnoreMatcher::consider(const std::vector<int>& candidates, const std::string& relPath, bool isDir,
+                             int& best) const {
+    // Candidates are in rule order; the last one that applies wins
+    for (auto it = candidates.rbegin(); it != candidates.rend(); ++it) {
+        if (*it <= best) return;
+        if (applies(m_rules[*it], relPath, isDir)) {
+            best = *it;
+            return;
+        }
+    }
+}
+
+bool IgnoreMatcher::ignored(const std::string& relPath, bool isDir) const {
+    if (m_rules.empty()) {
+        return false;
+    }
+    int best = -1;
+    std::string name = base_name(relPath);
+
+    auto byName = m_byName.find(name);
+    if (byName != m_byName.end()) {
+        consider(byName->second, relPath, isDir, best);
+    }
+    auto byPath = m_byPath.find(relPath);
+    if (byPath != m_byPath.end()) {
+        consider(byPath->second, relPath, isDir, best);
+    }
+    for (size_t len : m_suffixLengths) {
+        if (len > name.size()) break;
+        auto bySuffix = m_bySuffix.find(name.substr(name.size() - len));
+        if (bySuffix != m_bySuffix.end()) {
+            consider(bySuffix->second, relPath, isDir, best);
+        }
+    }
+    for (auto it = m_globs.rbegin(); it != m_globs.rend() && *it > best; ++it) {
+        const Rule& rule = m_rules[*it];
+        if (!applies(rule, relPath, isDir)) {
+            continue;
+        }
+        bool matched = rule.anchored
+            ? globMatch(rule.pattern, rule.base.empty() ? relPath : relPath.substr(rule.base.size() + 1))
+            : globMatch(rule.pattern, name);
+        if (matched) {
+            best = *it;
+            break;
+        }
+    }
+
+    return best >= 0 && !m_rules[best].negate;
+}
+
+bool IgnoreMatcher::admit(const std::string& root, const std::string& relPath, bool isDir) {
+    if (ignored(relPath, isDir)) {
+        return false;
+    }
+    if (isDir) {
+        enterDirectory(root + "/" + relPath, relPath);
+    }
+    return true;
+}
+
+bool IgnoreMatcher::admitPath(const std::string& root, const std::string& relPath, bool isDir) {
+    enterDirectory(root, "");
+    for (size_t slash = relPath.find('/'); slash != std::string::npos; slash = relPath.find('/', slash + 1)) {
+        if (!admit(root, relPath.substr(0, slash), true)) {
+            return false;
+        }
+    }
+    return admit(root, relPath, isDir);
+}
+
+bool IgnoreMatcher::empty() const {
+    return m_rules.empty();
+}
+
+} // namespace bik
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace bik {
+
+// .bikignore rules (gitignore syntax: comments, '!' negation, trailing '/'
+// for directories, leading or inner '/' anchoring, '*', '?', '[...]', '**')
+// compiled for fast lookups. Literal names, anchored literal paths and
+// "*suffix" patterns are answered with hash lookups; only the remaining
+// globs are tried one by one. As in git, the last matching rule wins and
+// rules of deeper .bikignore files come after those of their parents.
+class IgnoreMatcher {
+public:
+    IgnoreMatcher();
+
+    // Add the rules of a .bikignore that lives in baseDir (project-relative,
+    // '/'-separated, "" for the project root)
+    void addRules(const std::string& baseDir, const std::string& text);
+
+    // Load absDir/.bikignore, if there is one, as the rules of relDir (once
+    // per directory). Walkers call this for every directory they descend into.
+    bool enterDirectory(const std::string& absDir, const std::string& relDir);
+
+    // Whether the project-relative path is excluded
+    bool ignored(const std::string& relPath, bool isDir) const;
+
+    // Walk step: false if relPath is excluded; a directory that is kept
+    // has its own .bikignore (under root) loaded
+    bool admit(const std::string& root, const std::string& relPath, bool isDir);
+
+    // Like admit() for a path reached without walking down to it: the
+    // directories above it are checked and their .bikignore files loaded first
+    bool admitPath(const std::string& root, const std::string& relPath, bool isDir);
+
+    bool empty() const;
+
+    static const char* const kFileName;
+
+private:
+    struct Rule {
+        std::string base;       // directory of the .bikignore, "" for the root
+        std::string pattern;
+        bool negate = false;
+        bool dirOnly = false;
+        bool anchored = false;  // matched against the path below base, not the name
+    };
+
+    bool applies(const Rule& rule, const std::string& relPath, bool isDir) const;
+    void consider(const std::vector<int>& candidates, const std::string& relPath, bool isDir, int& best) const;
+
+    std::vector<Rule> m_rules;
+    std::unordered_map<std::string, std::vector<int>> m_byName;     // unanchored literal names
+    std::unordered_map<std::string, std::vector<int>> m_byPath;     // anchored literal paths (base joined)
+    std::unordered_map<std::string, std::vector<int>> m_bySuffix;   // unanchored "*literal"
+    std::set<size_t> m_suffixLengths;
+    std::vector<int> m_globs;                                       // everything else
+    std::unordered_set<std::string> m_entered;                      // directories whose .bikignore was read
+};
+
+} // namespace bik
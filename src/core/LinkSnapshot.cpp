@@ -0,0 +1,486 @@
+#include "core/LinkSnapshot.h"
+#include "core/ChangeJournal.h"
+#include "core/Common.h"
+#include "core/DirWalker.h"
+#include "core/FileIndex.h"
+#include "core/FileMeta.h"
+#include "core/FileWriter.h"
+#include "core/IgnoreMatcher.h"
+#include "core/ParallelCompressor.h"
+#include "core/Stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+// Manifest lines end at '\n', which is legal in a file name: names are
+// written with '\\' and '\n' escaped
+std::string escape_name(const std::string& name) {
+    std::string out;
+    out.reserve(name.size());
+    for (char c : name) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+// False on an escape escape_name never writes
+bool unescape_name(const std::string& text, std::string& name) {
+    name.clear();
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] != '\\') {
+            name += text[i];
+            continue;
+        }
+        if (++i == text.size()) return false;
+        if (text[i] == '\\') name += '\\';
+        else if (text[i] == 'n') name += '\n';
+        else return false;
+    }
+    return true;
+}
+
+bool is_symlink_mode(uint32_t mode) {
+    FileMeta meta;
+    meta.setMode(mode);
+    return meta.symlink;
+}
+
+// A symlink holding target at path, with the entry's mtime
+bool make_symlink(const std::string& target, const fs::path& path, const ZipEntryInfo& info) {
+    std::error_code ec;
+    fs::create_symlink(target, path, ec);
+    if (ec) return false;
+    FileMeta meta;
+    meta.setMode(info.mode);
+    meta.mtimeNs = info.mtimeNs;
+    meta.apply(path.string());
+    return true;
+}
+
+} // namespace
+
+const char* LinkSnapshotWriter::extension() const {
+    return ".bikd";
+}
+
+bool LinkSnapshotWriter::write(const std::string& sourceDir, const std::string& path, const ZipOptions& options) {
+    fs::path source = fs::absolute(sourceDir);
+    fs::path dest = fs::absolute(path);
+    if (!fs::exists(source)) {
+        std::cerr << "Source directory does not exist: " << source << std::endl;
+        return false;
+    }
+    if (fs::exists(dest)) {
+        std::cerr << "Error: " << dest << " already exists" << std::endl;
+        return false;
+    }
+
+    // Built beside the destination and renamed into place once complete
+    fs::path staging = dest.string() + ".bik-tmp";
+    std::error_code ec;
+    fs::remove_all(staging, ec);
+    fs::create_directories(staging / ".bik", ec);
+    if (ec) {
+        std::cerr << "Error: cannot create " << staging << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    // Previous snapshot that unchanged files are linked to
+    LinkSnapshotReader base;
+    fs::path basePath = options.baseZipPath;
+    bool haveBase = options.index && !options.baseZipPath.empty() && base.open(options.baseZipPath);
+
+    struct Copy {
+        std::string from;
+        size_t entry;       // in manifest
+    };
+    std::vector<ZipEntryInfo> manifest;
+    std::vector<Copy> copies;
+    FileIndex newIndex;
+    std::set<fs::path> dirs;
+    size_t reused = 0;
+    uint64_t sourceBytes = 0;
+    std::atomic<uint64_t> stored(0);
+
+    auto ensureParent = [&](const std::string& rel) {
+        fs::path dir = (staging / rel).parent_path();
+        if (dirs.insert(dir).second) fs::create_directories(dir);
+    };
+    // Link an entry of the base snapshot; copy it when the link is refused
+    // (too many links, or a filesystem without hard links)
+    auto linkFromBase = [&](const ZipEntryInfo& info) {
+        ensureParent(info.name);
+        fs::path from = basePath / info.name;
+        fs::path to = staging / info.name;
+        if (is_symlink_mode(info.mode)) {
+            std::error_code linkEc;
+            fs::path target = fs::read_symlink(from, linkEc);
+            return !linkEc && make_symlink(target.string(), to, info);
+        }
+        std::error_code linkEc;
+        fs::create_hard_link(from, to, linkEc);
+        if (!linkEc) return true;
+        if (!FileWriter::copyFile(from.string(), to.string())) return false;
+        FileMeta meta;
+        meta.setMode(info.mode);
+        meta.mtimeNs = info.mtimeNs;
+        meta.apply(to.string());
+        stored += info.size;
+        return true;
+    };
+
+    bool ok = true;
+    try {
+        Stats::Phase phase("scan");
+        DirWalker walker(source.string());
+        auto addPath = [&](const std::string& rel, DirWalker::Type type) {
+            if (rel == ".bik" || (options.ignore && !options.ignore->admit(source.string(), rel,
+                                                                           type == DirWalker::Type::Directory))) {
+                return DirWalker::Visit::Skip;
+            }
+            if (type != DirWalker::Type::File && type != DirWalker::Type::Symlink) {
+                return DirWalker::Visit::Continue;
+            }
+            std::string abs = walker.absolutePath(rel);
+            FileMeta meta;
+            if (!FileMeta::read(abs, meta)) {
+                std::cerr << "Error: cannot read " << abs << std::endl;
+                ok = false;
+                return DirWalker::Visit::Stop;
+            }
+            ZipEntryInfo info;
+            info.name = rel;
+            info.mode = meta.mode;
+            info.mtimeNs = meta.mtimeNs;
+            if (meta.symlink) {
+                // The link target stands in for the data, as in the archive formats
+                info.size = meta.linkTarget.size();
+                info.crc = static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(meta.linkTarget.data()),
+                                                       static_cast<uInt>(meta.linkTarget.size())));
+                ensureParent(rel);
+                if (!make_symlink(meta.linkTarget, staging / rel, info)) {
+                    std::cerr << "Error: cannot create symlink " << (staging / rel) << std::endl;
+                    ok = false;
+                    return DirWalker::Visit::Stop;
+                }
+                manifest.push_back(info);
+                return DirWalker::Visit::Continue;
+            }
+
+            FileIndexEntry current;
+            current.path = rel;
+            bool haveStat = FileIndex::statFile(abs, current);
+            uint64_t size = haveStat ? current.size : fs::file_size(abs);
+            sourceBytes += size;
+            Stats::add(Stats::Counter::FilesScanned);
+            Stats::file(rel, size);
+
+            bool linked = false;
+            if (haveBase && haveStat && options.index->isUnchanged(current)) {
+                const FileIndexEntry* old = options.index->find(rel);
+                const ZipEntryInfo* previous = base.find(rel);
+                if (previous && previous->size == old->size && previous->crc == old->crc
+                    && (previous->mode & 07777) == (meta.mode & 07777) && linkFromBase(*previous)) {
+                    info = *previous;
+                    current.crc = old->crc;
+                    linked = true;
+                    reused++;
+                }
+            }
+            if (!linked) {
+                ensureParent(rel);
+                copies.push_back({abs, manifest.size()});
+            }
+            if (haveStat) newIndex.set(current);
+            manifest.push_back(info);
+            return DirWalker::Visit::Continue;
+        };
+
+        if (haveBase && options.changes) {
+            // Journal from `bik watch`: paths nothing touched are linked
+            // to the previous snapshot without looking at the disk
+            std::vector<ZipEntryInfo> previous;
+            base.list(previous);
+            for (const auto& info : previous) {
+                if (options.changes->touches(info.name)) continue;
+                if (!linkFromBase(info)) {
+                    std::cerr << "Error: cannot link " << info.name << " from " << basePath << std::endl;
+                    ok = false;
+                    break;
+                }
+                manifest.push_back(info);
+                const FileIndexEntry* old = options.index->find(info.name);
+                if (old) newIndex.set(*old);
+                sourceBytes += info.size;
+                reused++;
+            }
+            if (ok && !options.changes->visit(source.string(), options.ignore, addPath)) ok = false;
+        } else if (!walker.walk(addPath)) {
+            ok = false;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error while creating snapshot: " << e.what() << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        // Changed files are copied on every core; the kernel clones or
+        // copies the data where it can
+        Stats::Phase phase("copy");
+        unsigned jobs = options.jobs == 0 ? ParallelCompressor::defaultJobs() : options.jobs;
+        jobs = static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(copies.size(), 1)));
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        run_workers(jobs, [&] {
+            for (size_t k = next++; k < copies.size() && !failed; k = next++) {
+                ZipEntryInfo& info = manifest[copies[k].entry];
+                std::string to = (staging / info.name).string();
+                Stats::Span span("copy", info.name);
+                FileMeta meta;
+                meta.setMode(info.mode);
+                meta.mtimeNs = info.mtimeNs;
+                std::error_code sizeEc;
+                if (!FileWriter::copyFile(copies[k].from, to) || !meta.apply(to)
+                    || !ZipUtils::fileCrc32(to, info.crc)) {
+                    std::cerr << "Error: failed to copy " << copies[k].from << std::endl;
+                    failed = true;
+                    return false;
+                }
+                info.size = fs::file_size(to, sizeEc);
+                stored += info.size;
+                Stats::add(Stats::Counter::FilesCompressed);
+                Stats::add(Stats::Counter::BytesRead, info.size);
+            }
+            return true;
+        });
+        ok = !failed;
+    }
+
+    if (ok) {
+        // The stat index keeps the CRC the snapshot holds
+        for (const auto& c : copies) {
+            const ZipEntryInfo& info = manifest[c.entry];
+            const FileIndexEntry* indexed = newIndex.find(info.name);
+            if (indexed && indexed->crc != info.crc) {
+                FileIndexEntry updated = *indexed;
+                updated.crc = info.crc;
+                newIndex.set(updated);
+            }
+        }
+
+        std::ofstream file(staging / LinkSnapshotReader::kManifestPath, std::ios::trunc);
+        file << "# Bik Snapshot Manifest\n";
+        file << "stored=" << stored << "\n";
+        for (const auto& e : manifest) {
+            file << e.size << '\t' << e.crc << '\t' << e.mtimeNs << '\t' << e.mode << '\t' << escape_name(e.name) << '\n';
+        }
+        file.close();
+        ok = static_cast<bool>(file);
+        if (ok) {
+            fs::rename(staging, dest, ec);
+            ok = !ec;
+        }
+    }
+    if (!ok) {
+        std::cerr << "Error: failed to write " << dest << std::endl;
+        fs::remove_all(staging, ec);
+        return false;
+    }
+
+    Stats::add(Stats::Counter::FilesReused, reused);
+    Stats::add(Stats::Counter::BytesIn, sourceBytes);
+    Stats::add(Stats::Counter::BytesOut, stored);
+    if (options.index) {
+        newIndex.setArchive(dest.string());
+        *options.index = newIndex;
+        if (haveBase) {
+            std::cout << "Linked " << reused << " unchanged file(s) to previous backup" << std::endl;
+        }
+    }
+    return true;
+}
+
+bool LinkSnapshotReader::open(const std::string& path) {
+    m_path = path;
+    m_entries.clear();
+    m_byName.clear();
+    std::ifstream file(fs::path(path) / kManifestPath);
+    if (!file.is_open()) return false;
+
+    // A line that cannot be used costs its own file, not the whole snapshot
+    std::string line;
+    size_t lineNo = 0;
+    while (std::getline(file, line)) {
+        lineNo++;
+        if (line.empty() || line[0] == '#' || line.rfind("stored=", 0) == 0) continue;
+
+        // size \t crc \t mtime \t mode \t path (escaped)
+        std::istringstream fields(line);
+        ZipEntryInfo info;
+        std::string name;
+        bool parsed = static_cast<bool>(fields >> info.size >> info.crc >> info.mtimeNs >> info.mode);
+        if (parsed) {
+            fields.get();
+            std::getline(fields, name);
+            parsed = unescape_name(name, info.name);
+        }
+        if (!parsed) {
+            std::cerr << "Warning: skipping bad entry on line " << lineNo << " of " << path << "/"
+                      << kManifestPath << std::endl;
+            continue;
+        }
+        if (!safe_name(info.name)) {
+            std::cerr << "Warning: skipping unsafe path in " << path << ": " << info.name << std::endl;
+            continue;
+        }
+        m_byName[info.name] = m_entries.size();
+        m_entries.push_back(info);
+    }
+    return true;
+}
+
+bool LinkSnapshotReader::list(std::vector<ZipEntryInfo>& entries) {
+    entries = m_entries;
+    return true;
+}
+
+const ZipEntryInfo* LinkSnapshotReader::find(const std::string& name) const {
+    auto it = m_byName.find(name);
+    return it == m_byName.end() ? nullptr : &m_entries[it->second];
+}
+
+bool LinkSnapshotReader::extract(const std::string& destDir, const ExtractOptions& options) {
+    Stats::Phase phase("extract");
+    fs::path dest = fs::absolute(destDir);
+
+    std::vector<const ZipEntryInfo*> wanted;
+    if (options.only) {
+        for (const auto& name : *options.only) {
+            const ZipEntryInfo* info = find(name);
+            if (info) wanted.push_back(info);
+        }
+    } else {
+        for (const auto& info : m_entries) wanted.push_back(&info);
+    }
+
+    std::set<fs::path> dirs;
+    dirs.insert(dest);
+    for (const ZipEntryInfo* info : wanted) {
+        dirs.insert((dest / info->name).parent_path());
+        Stats::file(info->name, info->size);
+    }
+    for (const auto& d : dirs) {
+        std::error_code ec;
+        fs::create_directories(d, ec);
+        if (ec) return false;
+    }
+
+    unsigned jobs = options.jobs == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.jobs;
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(wanted.size(), 1)));
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    run_workers(jobs, [&] {
+        for (size_t k = next++; k < wanted.size() && !failed; k = next++) {
+            const ZipEntryInfo& info = *wanted[k];
+            fs::path from = fs::path(m_path) / info.name;
+            fs::path out = dest / info.name;
+            fs::path staged = options.replaceAtomically ? fs::path(out.string() + ".bik-tmp") : out;
+            Stats::Span span("extract", out.string());
+            Stats::add(Stats::Counter::FilesRestored);
+
+            std::error_code ec;
+            fs::remove(staged, ec);
+            bool ok;
+            if (is_symlink_mode(info.mode)) {
+                fs::path target = fs::read_symlink(from, ec);
+                ok = !ec && make_symlink(target.string(), staged, info);
+            } else {
+                FileMeta meta;
+                meta.setMode(info.mode);
+                meta.mtimeNs = info.mtimeNs;
+                ok = FileWriter::copyFile(from.string(), staged.string()) && meta.apply(staged.string());
+                if (ok) Stats::add(Stats::Counter::BytesWritten, info.size);
+            }
+            if (ok && staged != out) {
+                fs::rename(staged, out, ec);
+                ok = !ec;
+            }
+            if (!ok) {
+                fs::remove(staged, ec);
+                std::cerr << "Error: failed to restore " << info.name << " from " << m_path << std::endl;
+                failed = true;
+                return false;
+            }
+        }
+        return true;
+    });
+    return !failed;
+}
+
+bool LinkSnapshotReader::verify(unsigned jobs, VerifyReport& report) {
+    Stats::Phase phase("verify");
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(m_entries.size(), 1)));
+    std::vector<char> bad(m_entries.size(), 0);
+    std::atomic<size_t> next(0);
+    run_workers(jobs, [&] {
+        for (size_t k = next++; k < m_entries.size(); k = next++) {
+            const ZipEntryInfo& info = m_entries[k];
+            fs::path from = fs::path(m_path) / info.name;
+            Stats::Span span("verify", info.name);
+            std::error_code ec;
+            uint32_t crc = 0;
+            uint64_t size = 0;
+            bool ok;
+            if (is_symlink_mode(info.mode)) {
+                std::string target = fs::read_symlink(from, ec).string();
+                size = target.size();
+                crc = static_cast<uint32_t>(
+                    crc32(0L, reinterpret_cast<const Bytef*>(target.data()), static_cast<uInt>(target.size())));
+                ok = !ec;
+            } else {
+                size = fs::file_size(from, ec);
+                ok = !ec && ZipUtils::fileCrc32(from.string(), crc);
+                if (ok) Stats::add(Stats::Counter::BytesRead, size);
+            }
+            bad[k] = !ok || size != info.size || crc != info.crc;
+        }
+        return true;
+    });
+
+    for (size_t k = 0; k < m_entries.size(); k++) {
+        report.entries++;
+        if (bad[k]) report.corrupt.push_back(m_entries[k].name);
+        else report.bytes += m_entries[k].size;
+    }
+    return report.corrupt.empty();
+}
+
+uint64_t LinkSnapshotReader::storedBytes(const std::string& path) {
+    std::ifstream file(fs::path(path) / kManifestPath);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("stored=", 0) == 0) return std::strtoull(line.c_str() + 7, nullptr, 10);
+        if (!line.empty() && line[0] != '#') break;
+    }
+    return 0;
+}
+
+} // namespace bik
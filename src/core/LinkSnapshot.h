@@ -0,0 +1,52 @@
+#pragma once
+
+#include "core/Archive.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bik {
+
+// Snapshot directories (backup_format=link, <name>.bikd): every backup is a
+// plain copy of the tree. Files unchanged since the previous snapshot are
+// hard links to it, so a backup costs a copy of what changed plus one link
+// per file, and with FICLONE support even the copies share extents.
+// <name>.bikd/.bik/manifest.txt lists each file's size, CRC32, mtime and
+// mode, which is what restores compare the working tree against; `.bik` is
+// never part of a backup, so it cannot clash with a project path.
+class LinkSnapshotWriter : public ArchiveWriter {
+public:
+    bool write(const std::string& sourceDir, const std::string& path, const ZipOptions& options) override;
+    const char* extension() const override;
+};
+
+class LinkSnapshotReader : public ArchiveReader {
+public:
+    // Load the manifest of the snapshot at path
+    bool open(const std::string& path);
+
+    bool list(std::vector<ZipEntryInfo>& entries) override;
+    // Copies the wanted files out, cloning their extents where the
+    // filesystem allows; never links, so editing a restored file cannot
+    // write through into the snapshot
+    bool extract(const std::string& destDir, const ExtractOptions& options) override;
+    // Re-reads every file and compares its size and CRC32 with the manifest;
+    // catches bit rot and files changed through a hard link
+    bool verify(unsigned jobs, VerifyReport& report) override;
+
+    // Manifest entry called name, or null
+    const ZipEntryInfo* find(const std::string& name) const;
+
+    // Bytes the snapshot at path copied rather than linked, from its manifest
+    static uint64_t storedBytes(const std::string& path);
+
+    static constexpr const char* kManifestPath = ".bik/manifest.txt";
+
+private:
+    std::string m_path;
+    std::vector<ZipEntryInfo> m_entries;
+    std::unordered_map<std::string, size_t> m_byName;
+};
+
+} // namespace bik
@@ -0,0 +1,109 @@
+#include "core/MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bik {
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0), m_open(false), m_mapped(false) {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    m_size = static_cast<uint64_t>(st.st_size);
+    if (m_size == 0) {
+        // Nothing to map; an empty view is still a valid file
+        ::close(fd);
+        m_open = true;
+        return true;
+    }
+    void* p = ::mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        m_size = 0;
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(p);
+    m_open = true;
+    m_mapped = true;
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+    if (m_mapped) {
+        ::munmap(const_cast<uint8_t*>(m_data), static_cast<size_t>(m_size));
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+    m_mapped = false;
+}
+
+void MappedFile::advise(Access access) const {
+    advise(access, 0, m_size);
+}
+
+void MappedFile::advise(Access access, uint64_t offset, uint64_t length) const {
+#ifndef _WIN32
+    if (!m_mapped || offset >= m_size) {
+        return;
+    }
+    if (length > m_size - offset) {
+        length = m_size - offset;
+    }
+    // madvise wants a page-aligned start
+    uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    uint64_t start = offset - offset % page;
+    int advice = MADV_NORMAL;
+    switch (access) {
+    case Access::Sequential: advice = MADV_SEQUENTIAL; break;
+    case Access::Random: advice = MADV_RANDOM; break;
+    case Access::WillNeed: advice = MADV_WILLNEED; break;
+    case Access::Normal: break;
+    }
+    ::madvise(const_cast<uint8_t*>(m_data) + start, static_cast<size_t>(length + (offset - start)), advice);
+#else
+    (void)access;
+    (void)offset;
+    (void)length;
+#endif
+}
+
+bool MappedFile::isOpen() const {
+    return m_open;
+}
+
+const uint8_t* MappedFile::data() const {
+    return m_data;
+}
+
+uint64_t MappedFile::size() const {
+    return m_size;
+}
+
+} // namespace bik
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace bik {
+
+// Read-only memory mapping of a whole file, so archive readers can decode
+// straight from the page cache without per-entry read syscalls. open()
+// fails where mapping is unavailable (e.g. Windows); callers then fall back
+// to ordinary file I/O.
+class MappedFile {
+public:
+    enum class Access {
+        Normal,
+        Sequential,     // read front to back once (full extraction)
+        Random,         // scattered small reads (central directory, partial restore)
+        WillNeed,       // start reading ahead now
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    // Kernel hint for the whole mapping, or for [offset, offset + length)
+    void advise(Access access) const;
+    void advise(Access access, uint64_t offset, uint64_t length) const;
+
+    bool isOpen() const;
+    const uint8_t* data() const;
+    uint64_t size() const;
+
+private:
+    const uint8_t* m_data;
+    uint64_t m_size;
+    bool m_open;
+    bool m_mapped;
+};
+
+} // namespace bik
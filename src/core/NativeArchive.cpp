@@ -0,0 +1,1348 @@
+#include "core/NativeArchive.h"
+#include "core/ChangeJournal.h"
+#include "core/Common.h"
+#include "core/DirWalker.h"
+#include "core/FileIndex.h"
+#include "core/FileMeta.h"
+#include "core/FileWriter.h"
+#include "core/Hash.h"
+#include "core/IgnoreMatcher.h"
+#include "core/ParallelCompressor.h"
+#include "core/Stats.h"
+#include "core/ZstdDictionary.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <zlib.h>
+
+#ifdef BIK_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+const char NativeArchiveReader::kMagic[8] = {'B', 'I', 'K', 'A', 'R', 'C', 0, 1};
+const char NativeArchiveReader::kEndMagic[8] = {'B', 'I', 'K', 'A', 'E', 'N', 'D', 1};
+
+namespace {
+
+const uint8_t kCodecStored = 0;
+const uint8_t kCodecDeflate = 1;
+const uint8_t kCodecZstd = 2;
+const uint8_t kCodecZstdDict = 3;     // the frame names its dictionary by ID
+
+// Raw bytes per block
+const uint32_t kBlockSize = 1 << 20;
+
+// Blocks compressed ahead of the writer, per worker
+const size_t kBlocksAhead = 8;
+
+// Bases a delta entry may be rebuilt through; the writer keeps chains to
+// delta_max_chain, this only stops a damaged archive set from looping
+const unsigned kMaxDeltaDepth = 64;
+
+const size_t kFooterSize = 8 + 8 + 8 + 4 + 8;
+
+// Bounds-checked reads from the decoded index
+class Cursor {
+public:
+    explicit Cursor(const std::string& data) : m_data(data), m_pos(0), m_ok(true) {}
+
+    const char* take(uint64_t len) {
+        if (!m_ok || len > m_data.size() - m_pos) {
+            m_ok = false;
+            return nullptr;
+        }
+        const char* p = m_data.data() + m_pos;
+        m_pos += static_cast<size_t>(len);
+        return p;
+    }
+
+    template <typename T>
+    bool column(std::vector<T>& out, uint64_t count, int bytes) {
+        if (count > (m_data.size() - m_pos) / static_cast<uint64_t>(bytes)) {
+            m_ok = false;
+            return false;
+        }
+        const char* p = take(count * bytes);
+        out.resize(static_cast<size_t>(count));
+        for (size_t i = 0; i < out.size(); i++) out[i] = static_cast<T>(get_le(p + i * bytes, bytes));
+        return true;
+    }
+
+    bool ok() const { return m_ok; }
+    bool atEnd() const { return m_pos == m_data.size(); }
+
+private:
+    const std::string& m_data;
+    size_t m_pos;
+    bool m_ok;
+};
+
+// FNV-1a; the hash table in the index is keyed by it, so it must not change
+uint64_t name_hash(const char* data, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Block compression with contexts kept for the life of a worker
+class Encoder {
+public:
+    Encoder() : m_deflateLevel(0), m_deflateReady(false) {
+#ifdef BIK_HAVE_ZSTD
+        m_cctx = ZSTD_createCCtx();
+#endif
+    }
+
+    ~Encoder() {
+        if (m_deflateReady) deflateEnd(&m_zs);
+#ifdef BIK_HAVE_ZSTD
+        ZSTD_freeCCtx(m_cctx);
+#endif
+    }
+
+    Encoder(const Encoder&) = delete;
+    Encoder& operator=(const Encoder&) = delete;
+
+    // Compress in into out; stores the block when compression does not pay.
+    // kCodecZstdDict takes the compression dictionary (ZSTD_CDict) in cdict.
+    bool encode(const char* in, size_t len, uint8_t codec, int level, std::vector<char>& out, uint8_t& used,
+                const void* cdict = nullptr) {
+        if (codec == kCodecZstd || codec == kCodecZstdDict) {
+#ifdef BIK_HAVE_ZSTD
+            out.resize(ZSTD_compressBound(len));
+            size_t n = codec == kCodecZstdDict
+                ? ZSTD_compress_usingCDict(m_cctx, out.data(), out.size(), in, len,
+                                           static_cast<const ZSTD_CDict*>(cdict))
+                : ZSTD_compressCCtx(m_cctx, out.data(), out.size(), in, len, level);
+            if (ZSTD_isError(n)) return false;
+            out.resize(n);
+#else
+            (void)cdict;
+            return false;
+#endif
+        } else if (codec == kCodecDeflate) {
+            if (!m_deflateReady || level != m_deflateLevel) {
+                if (m_deflateReady) deflateEnd(&m_zs);
+                m_zs = z_stream{};
+                m_deflateReady = deflateInit2(&m_zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+                if (!m_deflateReady) return false;
+                m_deflateLevel = level;
+            } else {
+                deflateReset(&m_zs);
+            }
+            out.resize(deflateBound(&m_zs, static_cast<uLong>(len)));
+            m_zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+            m_zs.avail_in = static_cast<uInt>(len);
+            m_zs.next_out = reinterpret_cast<Bytef*>(out.data());
+            m_zs.avail_out = static_cast<uInt>(out.size());
+            if (deflate(&m_zs, Z_FINISH) != Z_STREAM_END) return false;
+            out.resize(out.size() - m_zs.avail_out);
+        }
+        if (codec == kCodecStored || out.size() >= len) {
+            out.assign(in, in + len);
+            used = kCodecStored;
+        } else {
+            used = codec;
+        }
+        return true;
+    }
+
+private:
+    z_stream m_zs;
+    int m_deflateLevel;
+    bool m_deflateReady;
+#ifdef BIK_HAVE_ZSTD
+    ZSTD_CCtx* m_cctx;
+#endif
+};
+
+class Decoder {
+public:
+    Decoder() : m_inflateReady(false) {
+#ifdef BIK_HAVE_ZSTD
+        m_dctx = ZSTD_createDCtx();
+#endif
+    }
+
+    ~Decoder() {
+        if (m_inflateReady) inflateEnd(&m_zs);
+#ifdef BIK_HAVE_ZSTD
+        ZSTD_freeDCtx(m_dctx);
+#endif
+    }
+
+    Decoder(const Decoder&) = delete;
+    Decoder& operator=(const Decoder&) = delete;
+
+    // Decode a whole block into out, which must hold exactly its raw size.
+    // kCodecZstdDict takes the decompression dictionary (ZSTD_DDict) in ddict.
+    bool decode(const char* in, size_t len, uint8_t codec, char* out, size_t size, const void* ddict = nullptr) {
+        if (codec == kCodecStored) {
+            if (len != size) return false;
+            std::memcpy(out, in, len);
+            return true;
+        }
+        if (codec == kCodecZstdDict && !ddict) return false;
+        if (codec == kCodecZstd || codec == kCodecZstdDict) {
+#ifdef BIK_HAVE_ZSTD
+            size_t n = codec == kCodecZstdDict
+                ? ZSTD_decompress_usingDDict(m_dctx, out, size, in, len, static_cast<const ZSTD_DDict*>(ddict))
+                : ZSTD_decompressDCtx(m_dctx, out, size, in, len);
+            return !ZSTD_isError(n) && n == size;
+#else
+            std::cerr << "Error: this archive holds zstd blocks; rebuild bik with libzstd to read it" << std::endl;
+            return false;
+#endif
+        }
+        if (codec != kCodecDeflate) return false;
+        if (!m_inflateReady) {
+            m_zs = z_stream{};
+            m_inflateReady = inflateInit2(&m_zs, -MAX_WBITS) == Z_OK;
+            if (!m_inflateReady) return false;
+        } else {
+            inflateReset(&m_zs);
+        }
+        m_zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        m_zs.avail_in = static_cast<uInt>(len);
+        m_zs.next_out = reinterpret_cast<Bytef*>(out);
+        m_zs.avail_out = static_cast<uInt>(size);
+        int ret = inflate(&m_zs, Z_FINISH);
+        return ret == Z_STREAM_END && m_zs.avail_out == 0;
+    }
+
+private:
+    z_stream m_zs;
+    bool m_inflateReady;
+#ifdef BIK_HAVE_ZSTD
+    ZSTD_DCtx* m_dctx;
+#endif
+};
+
+// One block of a file (or of its delta payload) to compress
+struct BlockJob {
+    std::string sourcePath;
+    std::string inputPath;      // read instead of sourcePath when set: a spilled delta payload
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    uint8_t codec = kCodecDeflate;
+    int level = 0;
+    const void* dictionary = nullptr;   // ZSTD_CDict for kCodecZstdDict
+    bool sign = false;          // also compute the block's delta signature
+    // Filled by the worker
+    std::vector<char> data;
+    uint32_t size = 0;          // raw bytes actually read
+    uint32_t crc = 0;
+    uint64_t hash[2] = {0, 0};
+    uint8_t used = kCodecStored;
+    DeltaSignature sig;
+    bool done = false;
+    bool ok = false;
+};
+
+// Compresses blocks on a worker pool; the writer takes them back strictly in
+// submission order. Workers stay at most kBlocksAhead blocks each ahead of
+// the writer, which bounds memory to a few MB per core.
+class BlockPool {
+public:
+    explicit BlockPool(unsigned jobs)
+        : m_next(0), m_released(0), m_window(jobs * kBlocksAhead), m_stop(false) {
+        for (unsigned i = 0; i < jobs; i++) {
+            m_workers.emplace_back(&BlockPool::workerLoop, this);
+        }
+    }
+
+    ~BlockPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_workReady.notify_all();
+        for (auto& t : m_workers) t.join();
+    }
+
+    size_t submit(std::unique_ptr<BlockJob> job) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+        m_workReady.notify_one();
+        return m_jobs.size() - 1;
+    }
+
+    BlockJob& wait(size_t ticket) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobDone.wait(lock, [&] { return m_jobs[ticket]->done; });
+        return *m_jobs[ticket];
+    }
+
+    // Tickets are released in order once written
+    void release(size_t ticket) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs[ticket].reset();
+        m_released = ticket + 1;
+        m_workReady.notify_all();
+    }
+
+private:
+    void workerLoop() {
+        Encoder encoder;
+        std::vector<char> raw(kBlockSize);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_workReady.wait(lock, [&] {
+                return m_stop || (m_next < m_jobs.size() && m_next < m_released + m_window);
+            });
+            if (m_stop) return;
+            BlockJob& job = *m_jobs[m_next++];
+            lock.unlock();
+
+            {
+                Stats::Span span("compress", job.sourcePath);
+                const char* data = raw.data();
+                std::ifstream in(job.inputPath.empty() ? job.sourcePath : job.inputPath, std::ios::binary);
+                if (in && job.offset > 0) in.seekg(static_cast<std::streamoff>(job.offset));
+                if (in) in.read(raw.data(), job.length);
+                // A file that shrank since the scan ends early
+                job.size = static_cast<uint32_t>(in.gcount());
+                bool readOk = !in.bad();
+                job.crc = static_cast<uint32_t>(
+                    crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(data), job.size));
+                murmur3_128(data, job.size, job.hash);
+                if (job.sign) {
+                    job.sig.blockSize = Delta::kBlockSize;
+                    job.sig.addBlocks(data, job.size);
+                }
+                job.ok = readOk && encoder.encode(data, job.size, job.codec, job.level, job.data, job.used,
+                                                        job.dictionary);
+            }
+
+            lock.lock();
+            job.done = true;
+            m_jobDone.notify_all();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::unique_ptr<BlockJob>> m_jobs;
+    size_t m_next;
+    size_t m_released;
+    size_t m_window;
+    bool m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_workReady;
+    std::condition_variable m_jobDone;
+};
+
+// Random access to the data of one entry. A delta entry is rebuilt on the
+// fly: literal bytes come from its payload, copies from the same file in
+// its base archive, which may itself be a delta.
+class EntryReader {
+public:
+    bool open(NativeArchiveReader& archive, size_t i, unsigned depth) {
+        m_archive = &archive;
+        m_first = archive.firstBlock(i);
+        uint64_t end = archive.signatureBlock(i);
+        // The entry's blocks: its data, or the payload of a delta
+        m_starts.push_back(0);
+        for (uint64_t b = m_first; b < end; b++) m_starts.push_back(m_starts.back() + archive.block(b).size);
+        std::string baseName = archive.deltaBase(i);
+        if (baseName.empty()) {
+            return true;
+        }
+
+        // Only the op index is kept; literal bytes are decoded when read,
+        // so restoring a large delta chain holds one block per level
+        if (depth >= kMaxDeltaDepth) return false;
+        uint64_t size = 0;
+        auto readPayload = [this](uint64_t offset, char* out, size_t len) { return readBlocks(offset, out, len); };
+        if (!Delta::parse(m_starts.back(), readPayload, m_ops, size) || size != archive.entry(i).size) return false;
+        fs::path basePath = fs::path(archive.path()).parent_path() / baseName;
+        m_baseArchive.reset(new NativeArchiveReader());
+        long b = m_baseArchive->open(basePath.string()) ? m_baseArchive->find(archive.entry(i).name) : -1;
+        if (b < 0) {
+            std::cerr << "Error: " << archive.entry(i).name << " in " << archive.path()
+                      << " is a delta against " << basePath << ", which is missing or does not hold it" << std::endl;
+            return false;
+        }
+        m_base.reset(new EntryReader());
+        return m_base->open(*m_baseArchive, static_cast<size_t>(b), depth + 1);
+    }
+
+    bool read(uint64_t offset, char* out, size_t len) {
+        if (!m_base) return readBlocks(offset, out, len);
+        while (len > 0) {
+            auto it = std::upper_bound(m_ops.begin(), m_ops.end(), offset,
+                                       [](uint64_t v, const DeltaOp& op) { return v < op.target; });
+            if (it == m_ops.begin()) return false;
+            const DeltaOp& op = *--it;
+            uint64_t skip = offset - op.target;
+            if (skip >= op.length) return false;
+            size_t n = static_cast<size_t>(std::min<uint64_t>(len, op.length - skip));
+            if (op.copy) {
+                if (!m_base->read(op.source + skip, out, n)) return false;
+            } else if (!readBlocks(op.source + skip, out, n)) {
+                return false;
+            }
+            offset += n;
+            out += n;
+            len -= n;
+        }
+        return true;
+    }
+
+private:
+    // Read the entry's own blocks, keeping the last one decoded
+    bool readBlocks(uint64_t offset, char* out, size_t len) {
+        while (len > 0) {
+            auto it = std::upper_bound(m_starts.begin(), m_starts.end(), offset);
+            if (it == m_starts.begin() || it == m_starts.end()) return false;
+            size_t k = static_cast<size_t>(it - m_starts.begin() - 1);
+            if (k != m_cached) {
+                m_cached = static_cast<size_t>(-1);
+                if (!m_archive->decodeBlock(m_first + k, m_scratch, m_raw)) return false;
+                m_cached = k;
+            }
+            uint64_t skip = offset - m_starts[k];
+            if (skip >= m_raw.size()) return false;
+            size_t n = static_cast<size_t>(std::min<uint64_t>(len, m_raw.size() - skip));
+            std::memcpy(out, m_raw.data() + skip, n);
+            offset += n;
+            out += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    NativeArchiveReader* m_archive = nullptr;
+    uint64_t m_first = 0;
+    // Raw offset of each block (data or delta payload), and the last one decoded
+    std::vector<uint64_t> m_starts;
+    size_t m_cached = static_cast<size_t>(-1);
+    std::vector<char> m_scratch;
+    std::vector<char> m_raw;
+    // Delta entries
+    std::vector<DeltaOp> m_ops;
+    std::unique_ptr<NativeArchiveReader> m_baseArchive;
+    std::unique_ptr<EntryReader> m_base;
+};
+
+} // namespace
+
+const char* NativeArchiveWriter::extension() const {
+    return ".bika";
+}
+
+bool NativeArchiveWriter::write(const std::string& sourceDir, const std::string& path, const ZipOptions& options) {
+    fs::path source = fs::absolute(sourceDir);
+    fs::path dest = fs::absolute(path);
+    if (!fs::exists(source)) {
+        std::cerr << "Source directory does not exist: " << source << std::endl;
+        return false;
+    }
+    // Never rewrite an archive: it may be the base being copied from (still
+    // mapped), and later archives hold deltas against it by name
+    if (fs::exists(dest)) {
+        std::cerr << "Error: " << dest << " already exists" << std::endl;
+        return false;
+    }
+    bool zstd = options.codec == Codec::Zstd;
+    if (zstd && !ParallelCompressor::supportsZstd()) {
+        std::cerr << "Error: zstd native archives need bik built with libzstd" << std::endl;
+        return false;
+    }
+    fs::create_directories(dest.parent_path());
+
+    // Previous archive whose blocks unchanged files are copied from
+    std::unique_ptr<NativeArchiveReader> base;
+    if (options.index && !options.baseZipPath.empty() && fs::exists(options.baseZipPath)) {
+        base.reset(new NativeArchiveReader());
+        if (!base->open(options.baseZipPath)) base.reset();
+    }
+
+    // Small files are compressed with the project's dictionary, when it has one
+    std::shared_ptr<void> dictionary;
+    if (options.dictionary && !options.dictionary->empty()) {
+#ifdef BIK_HAVE_ZSTD
+        int dictLevel = options.level != 0 && zstd ? options.level : kZstdDefaultLevel;
+        dictionary.reset(ZSTD_createCDict(options.dictionary->data(), options.dictionary->size(), dictLevel),
+                         [](void* p) { ZSTD_freeCDict(static_cast<ZSTD_CDict*>(p)); });
+#endif
+        if (!dictionary) {
+            std::cerr << "Error: cannot use the zstd dictionary; zstd support is missing" << std::endl;
+            return false;
+        }
+    }
+
+    // Deltas are only taken against an archive the reader will find beside this one
+    bool deltas = base && options.deltaMinSize > 0
+        && fs::absolute(options.baseZipPath).parent_path() == dest.parent_path();
+    std::string baseName = fs::path(options.baseZipPath).filename().string();
+
+    // Entries in archive order; fresh files have their blocks queued on the pool
+    struct Planned {
+        std::string name;
+        FileMeta meta;
+        long baseEntry = -1;        // copied from the base archive
+        size_t firstTicket = 0;
+        size_t tickets = 0;
+        bool sign = false;          // store a signature after the data
+        // Delta against the same file in the base archive
+        bool delta = false;
+        unsigned chain = 0;
+        uint64_t size = 0;
+        uint32_t crc = 0;
+        std::string signature;
+    };
+    std::vector<Planned> plan;
+    // Delta payloads wait in files beside the archive until their blocks are
+    // written; removed only after the pool is gone
+    struct SpillFiles {
+        std::vector<std::string> paths;
+        ~SpillFiles() {
+            for (const auto& p : paths) {
+                std::error_code ec;
+                fs::remove(p, ec);
+            }
+        }
+    } spills;
+    unsigned jobs = options.jobs == 0 ? ParallelCompressor::defaultJobs() : options.jobs;
+    BlockPool pool(jobs);
+    FileIndex newIndex;
+    size_t reused = 0;
+    size_t deltaCount = 0;
+    uint64_t sourceBytes = 0;
+
+    bool ok = true;
+    try {
+        Stats::Phase phase("scan");
+        DirWalker walker(source.string());
+        auto addPath = [&](const std::string& rel, DirWalker::Type type) {
+            if (rel == ".bik" || (options.ignore && !options.ignore->admit(source.string(), rel,
+                                                                           type == DirWalker::Type::Directory))) {
+                return DirWalker::Visit::Skip;
+            }
+            if (type != DirWalker::Type::File && type != DirWalker::Type::Symlink) {
+                return DirWalker::Visit::Continue;
+            }
+            std::string abs = walker.absolutePath(rel);
+            Planned planned;
+            planned.name = rel;
+            if (!FileMeta::read(abs, planned.meta)) {
+                std::cerr << "Error: cannot read " << abs << std::endl;
+                ok = false;
+                return DirWalker::Visit::Stop;
+            }
+            if (type == DirWalker::Type::Symlink) {
+                plan.push_back(planned);
+                return DirWalker::Visit::Continue;
+            }
+
+            FileIndexEntry current;
+            current.path = rel;
+            bool haveStat = FileIndex::statFile(abs, current);
+            uint64_t size = haveStat ? current.size : fs::file_size(abs);
+            sourceBytes += size;
+            Stats::add(Stats::Counter::FilesScanned);
+            Stats::file(rel, size);
+
+            if (base && haveStat && options.index->isUnchanged(current)) {
+                const FileIndexEntry* old = options.index->find(rel);
+                long b = base->find(rel);
+                if (b >= 0) {
+                    ZipEntryInfo info = base->entry(static_cast<size_t>(b));
+                    if (info.size == old->size && info.crc == old->crc) {
+                        planned.baseEntry = b;
+                        current.crc = old->crc;
+                        reused++;
+                    }
+                }
+            }
+            if (planned.baseEntry < 0) {
+                CompressionChoice choice;
+                if (options.policy) choice = options.policy->choose(abs, size);
+                else choice.level = Z_DEFAULT_COMPRESSION;
+                int level = options.level != 0 ? options.level : zstd ? kZstdDefaultLevel : choice.level;
+                uint8_t codec = choice.store ? kCodecStored : zstd ? kCodecZstd : kCodecDeflate;
+                bool small = dictionary && !choice.store && size <= ZstdDictionary::kMaxEntrySize;
+                if (small) codec = kCodecZstdDict;
+                Stats::add(Stats::Counter::FilesCompressed);
+                planned.sign = options.deltaMinSize > 0 && size >= options.deltaMinSize;
+
+                // A delta is kept only if it is at most half the file. Its
+                // payload is spilled to disk as it is produced, so memory
+                // stays bounded however many large files changed.
+                std::string payloadPath;
+                uint64_t payloadSize = 0;
+                long b = planned.sign && deltas ? base->find(rel) : -1;
+                DeltaSignature baseSig;
+                if (b >= 0 && base->chain(static_cast<size_t>(b)) < std::min(options.deltaMaxChain, kMaxDeltaDepth)
+                    && base->signature(static_cast<size_t>(b), baseSig)) {
+                    payloadPath = dest.string() + ".bik-delta-" + std::to_string(plan.size());
+                    spills.paths.push_back(payloadPath);
+                    std::ofstream spill(payloadPath, std::ios::binary | std::ios::trunc);
+                    auto emit = [&](const char* data, size_t len) {
+                        spill.write(data, static_cast<std::streamsize>(len));
+                        payloadSize += len;
+                        return static_cast<bool>(spill);
+                    };
+                    DeltaSignature sig;
+                    bool tooLarge = false;
+                    bool encoded = spill && Delta::encode(abs, baseSig, size / 2, emit, sig, planned.crc, tooLarge);
+                    spill.close();
+                    if (encoded && spill && !tooLarge) {
+                        planned.delta = true;
+                        planned.chain = base->chain(static_cast<size_t>(b)) + 1;
+                        planned.size = sig.fileSize;
+                        planned.signature = sig.serialize();
+                        deltaCount++;
+                    } else {
+                        std::error_code ec;
+                        fs::remove(payloadPath, ec);
+                        spills.paths.pop_back();
+                        payloadPath.clear();
+                    }
+                }
+                uint64_t length = planned.delta ? payloadSize : size;
+                if (!planned.delta) Stats::add(Stats::Counter::BytesRead, size);
+                for (uint64_t offset = 0; offset < length; offset += kBlockSize) {
+                    std::unique_ptr<BlockJob> job(new BlockJob());
+                    job->sourcePath = abs;
+                    job->inputPath = payloadPath;
+                    job->offset = offset;
+                    job->length = static_cast<uint32_t>(std::min<uint64_t>(kBlockSize, length - offset));
+                    job->codec = codec;
+                    job->level = level;
+                    job->dictionary = small ? dictionary.get() : nullptr;
+                    job->sign = planned.sign && !planned.delta;
+                    size_t ticket = pool.submit(std::move(job));
+                    if (planned.tickets++ == 0) planned.firstTicket = ticket;
+                }
+            }
+            if (haveStat) newIndex.set(current);
+            plan.push_back(planned);
+            return DirWalker::Visit::Continue;
+        };
+
+        if (base && options.changes) {
+            // Journal from `bik watch`: entries of paths nothing touched are
+            // copied from the previous archive without looking at the disk
+            for (size_t i = 0; i < base->size(); i++) {
+                ZipEntryInfo info = base->entry(i);
+                if (options.changes->touches(info.name)) continue;
+                Planned planned;
+                planned.name = info.name;
+                planned.meta.setMode(info.mode);
+                planned.meta.mtimeNs = info.mtimeNs;
+                planned.baseEntry = static_cast<long>(i);
+                plan.push_back(planned);
+                const FileIndexEntry* old = options.index->find(info.name);
+                if (old) newIndex.set(*old);
+                sourceBytes += info.size;
+                reused++;
+            }
+            if (!options.changes->visit(source.string(), options.ignore, addPath)) ok = false;
+        } else if (!walker.walk(addPath)) {
+            ok = false;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error while archiving: " << e.what() << std::endl;
+        ok = false;
+    }
+    if (!ok) return false;
+
+    Stats::Phase phase("write");
+    FileWriter out;
+    if (!out.open(dest.string())) {
+        std::cerr << "Error: cannot create " << dest << std::endl;
+        return false;
+    }
+    uint64_t offset = 0;
+    auto emit = [&](const char* data, size_t len) {
+        offset += len;
+        return out.write(data, len);
+    };
+    ok = emit(NativeArchiveReader::kMagic, sizeof(NativeArchiveReader::kMagic));
+
+    std::vector<uint64_t> sizes, firstBlocks, signatureBlocks;
+    std::vector<uint32_t> crcs, modes, deltaBases;
+    std::vector<int64_t> mtimes;
+    std::vector<uint8_t> chains;
+    std::vector<NativeArchiveReader::Block> blocks;
+    std::string names;
+    std::vector<uint32_t> nameEnds;
+    std::vector<std::string> archives;
+    std::vector<char> copy;
+
+    // Archives referenced by delta entries, numbered from 1
+    auto archiveId = [&](const std::string& name) -> uint32_t {
+        if (name.empty()) return 0;
+        auto it = std::find(archives.begin(), archives.end(), name);
+        if (it == archives.end()) it = archives.insert(archives.end(), name);
+        return static_cast<uint32_t>(it - archives.begin() + 1);
+    };
+    // Signatures are stored as is, in blocks like any other data
+    auto emitStored = [&](const std::string& data) {
+        bool written = true;
+        for (size_t at = 0; written && at < data.size(); at += kBlockSize) {
+            NativeArchiveReader::Block block;
+            block.offset = offset;
+            block.compSize = block.size = static_cast<uint32_t>(std::min<size_t>(kBlockSize, data.size() - at));
+            block.codec = kCodecStored;
+            murmur3_128(data.data() + at, block.size, block.hash);
+            blocks.push_back(block);
+            written = emit(data.data() + at, block.size);
+        }
+        return written;
+    };
+
+    for (size_t i = 0; ok && i < plan.size(); i++) {
+        const Planned& planned = plan[i];
+        firstBlocks.push_back(blocks.size());
+        uint64_t size = 0;
+        uint32_t crc = static_cast<uint32_t>(crc32(0L, Z_NULL, 0));
+        uint32_t mode = planned.meta.mode;
+        int64_t mtime = planned.meta.mtimeNs;
+        uint64_t signatureBlock = 0;
+        uint32_t deltaBase = 0;
+        unsigned chain = 0;
+
+        if (planned.baseEntry >= 0) {
+            // Links included: an untouched entry's meta from the journal
+            // branch has no target, the base blocks do
+            size_t b = static_cast<size_t>(planned.baseEntry);
+            ZipEntryInfo info = base->entry(b);
+            size = info.size;
+            crc = info.crc;
+            signatureBlock = blocks.size() + (base->signatureBlock(b) - base->firstBlock(b));
+            deltaBase = archiveId(base->deltaBase(b));
+            chain = base->chain(b);
+            for (uint64_t k = base->firstBlock(b); ok && k < base->firstBlock(b + 1); k++) {
+                NativeArchiveReader::Block block = base->block(k);
+                ok = base->readBlock(k, copy);
+                block.offset = offset;
+                blocks.push_back(block);
+                ok = ok && emit(copy.data(), copy.size());
+            }
+        } else if (planned.meta.symlink) {
+            // The link target is the entry's data, as in the zip formats
+            const std::string& target = planned.meta.linkTarget;
+            size = target.size();
+            crc = static_cast<uint32_t>(
+                crc32(0L, reinterpret_cast<const Bytef*>(target.data()), static_cast<uInt>(target.size())));
+            if (size > 0) {
+                NativeArchiveReader::Block block;
+                block.offset = offset;
+                block.compSize = block.size = static_cast<uint32_t>(size);
+                block.codec = kCodecStored;
+                murmur3_128(target.data(), target.size(), block.hash);
+                blocks.push_back(block);
+                ok = emit(target.data(), target.size());
+            }
+            signatureBlock = blocks.size();
+        } else {
+            DeltaSignature sig;
+            sig.blockSize = Delta::kBlockSize;
+            for (size_t t = planned.firstTicket; ok && t < planned.firstTicket + planned.tickets; t++) {
+                BlockJob& job = pool.wait(t);
+                if (!job.ok) {
+                    std::cerr << "Error: failed to read " << job.sourcePath << std::endl;
+                    ok = false;
+                    break;
+                }
+                NativeArchiveReader::Block block;
+                block.offset = offset;
+                block.compSize = static_cast<uint32_t>(job.data.size());
+                block.size = job.size;
+                block.codec = job.used;
+                block.hash[0] = job.hash[0];
+                block.hash[1] = job.hash[1];
+                blocks.push_back(block);
+                crc = static_cast<uint32_t>(crc32_combine(crc, job.crc, static_cast<z_off_t>(job.size)));
+                size += job.size;
+                if (job.sign) {
+                    sig.weak.insert(sig.weak.end(), job.sig.weak.begin(), job.sig.weak.end());
+                    sig.strong.insert(sig.strong.end(), job.sig.strong.begin(), job.sig.strong.end());
+                    sig.fileSize += job.sig.fileSize;
+                }
+                ok = emit(job.data.data(), job.data.size());
+                pool.release(t);
+            }
+            signatureBlock = blocks.size();
+            if (planned.delta) {
+                // The blocks hold the delta; the entry describes the rebuilt file
+                size = planned.size;
+                crc = planned.crc;
+                deltaBase = archiveId(baseName);
+                chain = planned.chain;
+                ok = ok && emitStored(planned.signature);
+            } else if (planned.sign) {
+                ok = ok && emitStored(sig.serialize());
+            }
+        }
+        names += planned.name;
+        nameEnds.push_back(static_cast<uint32_t>(names.size()));
+        sizes.push_back(size);
+        crcs.push_back(crc);
+        mtimes.push_back(mtime);
+        modes.push_back(mode);
+        signatureBlocks.push_back(signatureBlock);
+        deltaBases.push_back(deltaBase);
+        chains.push_back(static_cast<uint8_t>(std::min(chain, 255u)));
+
+        // The stat index keeps the CRC the archive stores
+        const FileIndexEntry* indexed = newIndex.find(planned.name);
+        if (indexed && indexed->crc != crc) {
+            FileIndexEntry updated = *indexed;
+            updated.crc = crc;
+            newIndex.set(updated);
+        }
+    }
+    firstBlocks.push_back(blocks.size());
+
+    if (ok) {
+        // Open addressing over FNV-1a of the names, at most half full
+        uint64_t slotCount = 1;
+        while (slotCount < plan.size() * 2) slotCount <<= 1;
+        std::vector<uint32_t> slots(plan.empty() ? 0 : static_cast<size_t>(slotCount), 0);
+        for (size_t i = 0; i < plan.size(); i++) {
+            uint32_t start = i == 0 ? 0 : nameEnds[i - 1];
+            uint64_t h = name_hash(names.data() + start, nameEnds[i] - start) & (slotCount - 1);
+            while (slots[h] != 0) h = (h + 1) & (slotCount - 1);
+            slots[h] = static_cast<uint32_t>(i + 1);
+        }
+
+        std::string index;
+        put_u64(index, plan.size());
+        put_u64(index, blocks.size());
+        put_u64(index, slots.size());
+        put_u64(index, archives.size());
+        for (uint32_t v : nameEnds) put_u32(index, v);
+        index += names;
+        uint32_t archiveEnd = 0;
+        for (const auto& a : archives) put_u32(index, archiveEnd += static_cast<uint32_t>(a.size()));
+        for (const auto& a : archives) index += a;
+        for (uint64_t v : sizes) put_u64(index, v);
+        for (uint32_t v : crcs) put_u32(index, v);
+        for (int64_t v : mtimes) put_u64(index, static_cast<uint64_t>(v));
+        for (uint32_t v : modes) put_u32(index, v);
+        for (uint64_t v : firstBlocks) put_u64(index, v);
+        for (uint64_t v : signatureBlocks) put_u64(index, v);
+        for (uint32_t v : deltaBases) put_u32(index, v);
+        for (uint8_t v : chains) index.push_back(static_cast<char>(v));
+        for (const auto& b : blocks) put_u64(index, b.offset);
+        for (const auto& b : blocks) put_u32(index, b.compSize);
+        for (const auto& b : blocks) put_u32(index, b.size);
+        for (const auto& b : blocks) index.push_back(static_cast<char>(b.codec));
+        for (const auto& b : blocks) put_u64(index, b.hash[0]);
+        for (const auto& b : blocks) put_u64(index, b.hash[1]);
+        for (uint32_t v : slots) put_u32(index, v);
+
+        std::vector<char> packed;
+        uint8_t used = kCodecDeflate;
+        Encoder encoder;
+        ok = encoder.encode(index.data(), index.size(), kCodecDeflate, Z_DEFAULT_COMPRESSION, packed, used);
+        std::string footer;
+        put_u64(footer, offset);
+        put_u64(footer, used == kCodecDeflate ? packed.size() : 0);
+        put_u64(footer, index.size());
+        put_u32(footer, static_cast<uint32_t>(
+            crc32(0L, reinterpret_cast<const Bytef*>(index.data()), static_cast<uInt>(index.size()))));
+        footer.append(NativeArchiveReader::kEndMagic, sizeof(NativeArchiveReader::kEndMagic));
+        ok = ok && emit(packed.data(), packed.size()) && emit(footer.data(), footer.size());
+    }
+    ok = out.close() && ok;
+    if (!ok) {
+        std::cerr << "Error: failed to write " << dest << std::endl;
+        std::error_code ec;
+        fs::remove(dest, ec);
+        return false;
+    }
+
+    Stats::add(Stats::Counter::FilesReused, reused);
+    Stats::add(Stats::Counter::BytesIn, sourceBytes);
+    Stats::add(Stats::Counter::BytesOut, offset);
+    if (options.index) {
+        newIndex.setArchive(dest.string());
+        *options.index = newIndex;
+        if (base) {
+            std::cout << "Reused " << reused << " unchanged file(s) from previous backup" << std::endl;
+        }
+        if (deltaCount > 0) {
+            std::cout << "Stored " << deltaCount << " changed file(s) as deltas" << std::endl;
+        }
+    }
+    return true;
+}
+
+NativeArchiveReader::NativeArchiveReader() {
+}
+
+bool NativeArchiveReader::open(const std::string& path) {
+    m_path = path;
+    if (!m_map.open(path)) {
+        m_file.open(path, std::ios::binary);
+        if (!m_file) return false;
+    }
+    std::error_code ec;
+    uint64_t fileSize = m_map.isOpen() ? m_map.size() : fs::file_size(path, ec);
+    if (ec || fileSize < sizeof(kMagic) + kFooterSize) return false;
+
+    char head[sizeof(kMagic)];
+    char footer[kFooterSize];
+    if (!readAt(0, head, sizeof(head)) || std::memcmp(head, kMagic, sizeof(kMagic)) != 0
+        || !readAt(fileSize - kFooterSize, footer, sizeof(footer))
+        || std::memcmp(footer + kFooterSize - sizeof(kEndMagic), kEndMagic, sizeof(kEndMagic)) != 0) {
+        return false;
+    }
+    uint64_t indexOffset = get_le(footer, 8);
+    uint64_t compSize = get_le(footer + 8, 8);
+    uint64_t rawSize = get_le(footer + 16, 8);
+    uint32_t indexCrc = static_cast<uint32_t>(get_le(footer + 24, 4));
+    // A compressed size of 0 means the index is stored as is
+    uint64_t stored = compSize == 0 ? rawSize : compSize;
+    if (indexOffset < sizeof(kMagic) || stored > fileSize - kFooterSize - indexOffset
+        || rawSize >= (1ULL << 32)) {
+        return false;
+    }
+
+    Block block;
+    block.offset = indexOffset;
+    block.compSize = static_cast<uint32_t>(stored);
+    block.size = static_cast<uint32_t>(rawSize);
+    block.codec = compSize == 0 ? kCodecStored : kCodecDeflate;
+    std::vector<char> scratch;
+    const char* data = blockData(block, scratch);
+    std::string index(static_cast<size_t>(rawSize), '\0');
+    Decoder decoder;
+    if (!data || !decoder.decode(data, block.compSize, block.codec, &index[0], index.size())
+        || static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(index.data()),
+                                       static_cast<uInt>(index.size()))) != indexCrc) {
+        return false;
+    }
+
+    Cursor in(index);
+    const char* counts = in.take(32);
+    if (!counts) return false;
+    uint64_t count = get_le(counts, 8);
+    uint64_t blockCount = get_le(counts + 8, 8);
+    uint64_t slotCount = get_le(counts + 16, 8);
+    uint64_t archiveCount = get_le(counts + 24, 8);
+    if (!in.column(m_nameEnds, count, 4)) return false;
+    const char* names = in.take(count == 0 ? 0 : m_nameEnds.back());
+    if (!in.ok()) return false;
+    m_names.assign(names ? names : "", count == 0 ? 0 : m_nameEnds.back());
+    std::vector<uint32_t> archiveEnds;
+    if (!in.column(archiveEnds, archiveCount, 4)) return false;
+    const char* archives = in.take(archiveCount == 0 ? 0 : archiveEnds.back());
+    if (!in.ok()) return false;
+    m_archives.clear();
+    for (size_t a = 0; a < archiveEnds.size(); a++) {
+        uint32_t start = a == 0 ? 0 : archiveEnds[a - 1];
+        if (archiveEnds[a] < start) return false;
+        m_archives.emplace_back(archives + start, archiveEnds[a] - start);
+        // A file name beside this archive, nothing else
+        if (!safe_name(m_archives.back()) || m_archives.back().find('/') != std::string::npos) return false;
+    }
+    std::vector<uint64_t> offsets, hashLows, hashHighs;
+    std::vector<uint32_t> compSizes, sizes;
+    std::vector<uint8_t> codecs;
+    if (!in.column(m_sizes, count, 8) || !in.column(m_crcs, count, 4) || !in.column(m_mtimes, count, 8)
+        || !in.column(m_modes, count, 4) || !in.column(m_firstBlocks, count + 1, 8)
+        || !in.column(m_signatureBlocks, count, 8) || !in.column(m_deltaBases, count, 4)
+        || !in.column(m_chains, count, 1) || !in.column(offsets, blockCount, 8) || !in.column(compSizes, blockCount, 4)
+        || !in.column(sizes, blockCount, 4) || !in.column(codecs, blockCount, 1)
+        || !in.column(hashLows, blockCount, 8) || !in.column(hashHighs, blockCount, 8)
+        || !in.column(m_slots, slotCount, 4) || !in.atEnd()) {
+        return false;
+    }
+    if ((slotCount & (slotCount - 1)) != 0 || (count > 0 && slotCount < count)) return false;
+
+    uint32_t previousEnd = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (m_nameEnds[i] < previousEnd || m_firstBlocks[i] > m_signatureBlocks[i]
+            || m_signatureBlocks[i] > m_firstBlocks[i + 1] || m_deltaBases[i] > archiveCount) {
+            return false;
+        }
+        previousEnd = m_nameEnds[i];
+    }
+    if (m_firstBlocks[0] != 0 || m_firstBlocks[count] != blockCount) return false;
+    m_blocks.resize(static_cast<size_t>(blockCount));
+    for (size_t b = 0; b < m_blocks.size(); b++) {
+        if (offsets[b] > indexOffset || compSizes[b] > indexOffset - offsets[b] || sizes[b] > kBlockSize) {
+            return false;
+        }
+        m_blocks[b].offset = offsets[b];
+        m_blocks[b].compSize = compSizes[b];
+        m_blocks[b].size = sizes[b];
+        m_blocks[b].codec = codecs[b];
+        m_blocks[b].hash[0] = hashLows[b];
+        m_blocks[b].hash[1] = hashHighs[b];
+    }
+    for (uint32_t s : m_slots) {
+        if (s > count) return false;
+    }
+    return true;
+}
+
+size_t NativeArchiveReader::size() const {
+    return m_sizes.size();
+}
+
+long NativeArchiveReader::find(const std::string& name) const {
+    if (m_slots.empty()) return -1;
+    uint64_t mask = m_slots.size() - 1;
+    for (uint64_t h = name_hash(name.data(), name.size()) & mask, probes = 0; probes <= mask;
+         h = (h + 1) & mask, probes++) {
+        uint32_t slot = m_slots[static_cast<size_t>(h)];
+        if (slot == 0) return -1;
+        size_t i = slot - 1;
+        uint32_t start = i == 0 ? 0 : m_nameEnds[i - 1];
+        if (m_nameEnds[i] - start == name.size() && m_names.compare(start, name.size(), name) == 0) {
+            return static_cast<long>(i);
+        }
+    }
+    return -1;
+}
+
+ZipEntryInfo NativeArchiveReader::entry(size_t i) const {
+    ZipEntryInfo info;
+    uint32_t start = i == 0 ? 0 : m_nameEnds[i - 1];
+    info.name = m_names.substr(start, m_nameEnds[i] - start);
+    info.size = m_sizes[i];
+    info.crc = m_crcs[i];
+    info.mtimeNs = m_mtimes[i];
+    info.mode = m_modes[i];
+    return info;
+}
+
+uint64_t NativeArchiveReader::firstBlock(size_t i) const {
+    return m_firstBlocks[i];
+}
+
+uint64_t NativeArchiveReader::signatureBlock(size_t i) const {
+    return m_signatureBlocks[i];
+}
+
+const NativeArchiveReader::Block& NativeArchiveReader::block(uint64_t b) const {
+    return m_blocks[static_cast<size_t>(b)];
+}
+
+std::string NativeArchiveReader::deltaBase(size_t i) const {
+    return m_deltaBases[i] == 0 ? std::string() : m_archives[m_deltaBases[i] - 1];
+}
+
+unsigned NativeArchiveReader::chain(size_t i) const {
+    return m_chains[i];
+}
+
+bool NativeArchiveReader::signature(size_t i, DeltaSignature& sig) {
+    std::string data;
+    std::vector<char> scratch, raw;
+    for (uint64_t b = m_signatureBlocks[i]; b < m_firstBlocks[i + 1]; b++) {
+        if (!decodeBlock(b, scratch, raw)) return false;
+        data.append(raw.data(), raw.size());
+    }
+    return !data.empty() && DeltaSignature::parse(data, sig);
+}
+
+const std::string& NativeArchiveReader::path() const {
+    return m_path;
+}
+
+std::vector<std::string> NativeArchiveReader::dependencies() {
+    std::vector<std::string> paths;
+    for (const auto& name : m_archives) {
+        paths.push_back((fs::path(m_path).parent_path() / name).string());
+    }
+    return paths;
+}
+
+bool NativeArchiveReader::readBlock(uint64_t b, std::vector<char>& out) {
+    const Block& block = m_blocks[static_cast<size_t>(b)];
+    const char* data = blockData(block, out);
+    if (!data) return false;
+    if (data != out.data()) out.assign(data, data + block.compSize);
+    return true;
+}
+
+bool NativeArchiveReader::decodeBlock(uint64_t b, std::vector<char>& scratch, std::vector<char>& raw) {
+    thread_local Decoder decoder;
+    const Block& block = m_blocks[static_cast<size_t>(b)];
+    const char* data = blockData(block, scratch);
+    raw.resize(block.size);
+    return data && decoder.decode(data, block.compSize, block.codec, raw.data(), raw.size(),
+                                  block.codec == kCodecZstdDict ? dictionaryFor(data, block.compSize) : nullptr);
+}
+
+const char* NativeArchiveReader::blockData(const Block& b, std::vector<char>& scratch) {
+    if (m_map.isOpen()) {
+        return b.compSize <= m_map.size() - b.offset
+            ? reinterpret_cast<const char*>(m_map.data()) + b.offset : nullptr;
+    }
+    scratch.resize(b.compSize);
+    return readAt(b.offset, scratch.data(), scratch.size()) ? scratch.data() : nullptr;
+}
+
+const void* NativeArchiveReader::dictionaryFor(const char* frame, size_t len) {
+#ifdef BIK_HAVE_ZSTD
+    uint32_t id = ZSTD_getDictID_fromFrame(frame, len);
+    std::lock_guard<std::mutex> lock(m_dictMutex);
+    auto it = m_dicts.find(id);
+    if (it != m_dicts.end()) return it->second.get();
+
+    // Dictionaries live with the backups, beside this archive
+    std::string data;
+    std::shared_ptr<void> ddict;
+    std::string dir = fs::path(m_path).parent_path().string();
+    if (id != 0 && ZstdDictionary::load(dir, id, data)) {
+        ddict.reset(ZSTD_createDDict(data.data(), data.size()),
+                    [](void* p) { ZSTD_freeDDict(static_cast<ZSTD_DDict*>(p)); });
+    }
+    if (!ddict) {
+        std::cerr << "Error: " << m_path << " needs zstd dictionary " << ZstdDictionary::pathFor(dir, id) << std::endl;
+    }
+    m_dicts[id] = ddict;
+    return ddict.get();
+#else
+    (void)frame;
+    (void)len;
+    std::cerr << "Error: this archive holds zstd blocks; rebuild bik with libzstd to read it" << std::endl;
+    return nullptr;
+#endif
+}
+
+bool NativeArchiveReader::readAt(uint64_t offset, char* out, size_t len) {
+    if (m_map.isOpen()) {
+        if (offset > m_map.size() || len > m_map.size() - offset) return false;
+        std::memcpy(out, m_map.data() + offset, len);
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    m_file.clear();
+    m_file.seekg(static_cast<std::streamoff>(offset));
+    m_file.read(out, static_cast<std::streamsize>(len));
+    return static_cast<size_t>(m_file.gcount()) == len;
+}
+
+bool NativeArchiveReader::list(std::vector<ZipEntryInfo>& entries) {
+    entries.clear();
+    entries.reserve(size());
+    for (size_t i = 0; i < size(); i++) {
+        entries.push_back(entry(i));
+    }
+    return true;
+}
+
+bool NativeArchiveReader::extractEntry(size_t i, const std::string& outPath, const ExtractOptions& options,
+                                       std::vector<char>& scratch, std::vector<char>& raw) {
+    Stats::Span span("extract", outPath);
+    Stats::add(Stats::Counter::FilesRestored);
+    thread_local Decoder decoder;
+    FileMeta meta;
+    meta.setMode(m_modes[i]);
+    meta.mtimeNs = m_mtimes[i];
+
+    std::string staged = options.replaceAtomically ? outPath + ".bik-tmp" : outPath;
+    std::error_code ec;
+    bool ok = true;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint64_t produced = 0;
+    FileWriter out;
+    std::string target;
+    if (!meta.symlink) ok = out.open(staged, m_sizes[i]);
+
+    if (m_deltaBases[i] != 0) {
+        EntryReader delta;
+        ok = ok && delta.open(*this, i, 0);
+        while (ok && produced < m_sizes[i]) {
+            raw.resize(static_cast<size_t>(std::min<uint64_t>(kBlockSize, m_sizes[i] - produced)));
+            ok = delta.read(produced, raw.data(), raw.size());
+            if (!ok) break;
+            crc = crc32(crc, reinterpret_cast<const Bytef*>(raw.data()), static_cast<uInt>(raw.size()));
+            produced += raw.size();
+            ok = out.write(raw.data(), raw.size());
+        }
+    }
+    for (uint64_t b = m_firstBlocks[i]; ok && m_deltaBases[i] == 0 && b < m_signatureBlocks[i]; b++) {
+        const Block& block = m_blocks[static_cast<size_t>(b)];
+        const char* data = blockData(block, scratch);
+        raw.resize(block.size);
+        ok = data && decoder.decode(data, block.compSize, block.codec, raw.data(), raw.size(),
+                                    block.codec == kCodecZstdDict ? dictionaryFor(data, block.compSize) : nullptr);
+        if (!ok) break;
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(raw.data()), static_cast<uInt>(raw.size()));
+        produced += raw.size();
+        if (meta.symlink) target.append(raw.data(), raw.size());
+        else ok = out.write(raw.data(), raw.size());
+    }
+    ok = ok && produced == m_sizes[i] && static_cast<uint32_t>(crc) == m_crcs[i];
+
+    if (meta.symlink) {
+        fs::remove(staged, ec);
+        if (ok) {
+            fs::create_symlink(target, staged, ec);
+            ok = !ec;
+        }
+    } else {
+        ok = out.close() && ok;
+    }
+    if (ok) meta.apply(staged);
+    if (staged != outPath) {
+        if (ok) {
+            fs::rename(staged, outPath, ec);
+            ok = !ec;
+        }
+        if (!ok) fs::remove(staged, ec);
+    }
+    if (!ok) std::cerr << "Error: failed to extract " << entry(i).name << " from " << m_path << std::endl;
+    return ok;
+}
+
+bool NativeArchiveReader::extract(const std::string& destDir, const ExtractOptions& options) {
+    Stats::Phase phase("extract");
+    fs::path dest = fs::absolute(destDir);
+
+    // Selected entries are looked up by name instead of scanning the index
+    std::vector<size_t> wanted;
+    if (options.only) {
+        for (const auto& name : *options.only) {
+            long i = find(name);
+            if (i >= 0) wanted.push_back(static_cast<size_t>(i));
+        }
+        // Archive order reads the data front to back
+        std::sort(wanted.begin(), wanted.end());
+    } else {
+        for (size_t i = 0; i < size(); i++) wanted.push_back(i);
+    }
+
+    std::vector<std::string> outPaths;
+    outPaths.reserve(wanted.size());
+    std::set<fs::path> dirs;
+    dirs.insert(dest);
+    for (size_t i : wanted) {
+        ZipEntryInfo info = entry(i);
+        if (!safe_name(info.name)) {
+            std::cerr << "Error: " << m_path << " holds an unsafe path: " << info.name << std::endl;
+            return false;
+        }
+        fs::path out = dest / fs::path(info.name);
+        dirs.insert(out.parent_path());
+        outPaths.push_back(out.string());
+        Stats::file(info.name, info.size);
+    }
+    for (const auto& d : dirs) {
+        std::error_code ec;
+        fs::create_directories(d, ec);
+        if (ec) return false;
+    }
+    if (m_map.isOpen()) {
+        m_map.advise(wanted.size() * 4 < size() ? MappedFile::Access::Random : MappedFile::Access::Sequential);
+    }
+
+    unsigned jobs = options.jobs == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.jobs;
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(wanted.size(), 1)));
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    return run_workers(jobs, [&] {
+        std::vector<char> scratch;
+        std::vector<char> raw;
+        for (size_t k = next++; k < wanted.size() && !failed; k = next++) {
+            if (!extractEntry(wanted[k], outPaths[k], options, scratch, raw)) {
+                failed = true;
+                return false;
+            }
+        }
+        return true;
+    }) && !failed;
+}
+
+bool NativeArchiveReader::verify(unsigned jobs, VerifyReport& report) {
+    Stats::Phase phase("verify");
+    if (m_map.isOpen()) m_map.advise(MappedFile::Access::Sequential);
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    // Every block, signatures included, is decoded and checked against its
+    // hash, spread over the workers regardless of which file it belongs to
+    std::vector<uint32_t> blockCrcs(m_blocks.size(), 0);
+    std::vector<char> blockBad(m_blocks.size(), 0);
+    std::atomic<size_t> next(0);
+    run_workers(static_cast<unsigned>(std::min<size_t>(jobs, m_blocks.size())), [&] {
+        std::vector<char> scratch;
+        std::vector<char> raw;
+        for (size_t b = next++; b < m_blocks.size(); b = next++) {
+            if (!decodeBlock(b, scratch, raw)) {
+                blockBad[b] = 1;
+                continue;
+            }
+            uint64_t hash[2];
+            murmur3_128(raw.data(), raw.size(), hash);
+            blockBad[b] = hash[0] != m_blocks[b].hash[0] || hash[1] != m_blocks[b].hash[1];
+            blockCrcs[b] = static_cast<uint32_t>(
+                crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(raw.data()), static_cast<uInt>(raw.size())));
+            Stats::add(Stats::Counter::BytesRead, raw.size());
+        }
+        return true;
+    });
+
+    // A full entry is intact if its blocks are and their CRCs combine to its
+    // own; a delta entry is rebuilt through its bases to check that
+    std::vector<char> bad(size(), 0);
+    std::vector<size_t> deltas;
+    for (size_t i = 0; i < size(); i++) {
+        uLong crc = crc32(0L, Z_NULL, 0);
+        uint64_t produced = 0;
+        for (uint64_t b = m_firstBlocks[i]; b < m_firstBlocks[i + 1]; b++) {
+            if (blockBad[b]) bad[i] = 1;
+            if (b < m_signatureBlocks[i]) {
+                crc = crc32_combine(crc, blockCrcs[b], static_cast<z_off_t>(m_blocks[b].size));
+                produced += m_blocks[b].size;
+            }
+        }
+        if (m_deltaBases[i] != 0) {
+            if (!bad[i]) deltas.push_back(i);
+        } else if (produced != m_sizes[i] || static_cast<uint32_t>(crc) != m_crcs[i]) {
+            bad[i] = 1;
+        }
+    }
+    next = 0;
+    run_workers(static_cast<unsigned>(std::min<size_t>(jobs, deltas.size())), [&] {
+        std::vector<char> raw;
+        for (size_t k = next++; k < deltas.size(); k = next++) {
+            size_t i = deltas[k];
+            Stats::Span span("verify", entry(i).name);
+            EntryReader reader;
+            bool ok = reader.open(*this, i, 0);
+            uLong crc = crc32(0L, Z_NULL, 0);
+            for (uint64_t at = 0; ok && at < m_sizes[i]; at += raw.size()) {
+                raw.resize(static_cast<size_t>(std::min<uint64_t>(kBlockSize, m_sizes[i] - at)));
+                ok = reader.read(at, raw.data(), raw.size());
+                crc = crc32(crc, reinterpret_cast<const Bytef*>(raw.data()), static_cast<uInt>(raw.size()));
+            }
+            bad[i] = !ok || static_cast<uint32_t>(crc) != m_crcs[i];
+        }
+        return true;
+    });
+
+    for (size_t i = 0; i < size(); i++) {
+        report.entries++;
+        if (bad[i]) report.corrupt.push_back(entry(i).name);
+        else report.bytes += m_sizes[i];
+    }
+    return report.corrupt.empty();
+}
+
+} // namespace bik
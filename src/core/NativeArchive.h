@@ -0,0 +1,124 @@
+#pragma once
+
+#include "core/Archive.h"
+#include "core/Delta.h"
+#include "core/MappedFile.h"
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bik {
+
+// bik's own archive format (backup_format=native, <name>.bika), built for
+// throughput rather than interchange:
+//
+//   "BIKARC\0\x01" | blocks ... | index | footer
+//   footer: indexOffset u64 | indexCompSize u64 | indexSize u64 | indexCrc u32 | "BIKAEND\x01"
+//
+// File data is cut into independently compressed blocks of up to 1 MB
+// (stored, raw deflate, a zstd frame, or for small files a zstd frame using
+// the project's trained dictionary), so a large file is compressed and
+// decompressed on every core, and an unchanged file is copied from the
+// previous archive block by block without being decoded. The index is one
+// deflated block laid out in columns rather than records (every name, then
+// every size, CRC, mtime, mode, first block and delta base, then the block
+// table), followed by an open-addressing hash table over the names: opening
+// an archive is one read, and finding an entry by name is O(1). Besides each
+// entry's CRC32, the block table holds a 128-bit hash of every block's raw
+// bytes, which `bik verify` checks block by block on every core.
+// Integers are little-endian.
+//
+// With delta_min_size set, large files also carry their block signature
+// (stored blocks after their data), and a changed file whose previous
+// version has one is stored as a delta (see Delta.h) against the archive it
+// was read from, named in the index. Restoring such an entry needs that
+// archive, and its bases in turn, up to delta_max_chain deep.
+class NativeArchiveWriter : public ArchiveWriter {
+public:
+    bool write(const std::string& sourceDir, const std::string& path, const ZipOptions& options) override;
+    const char* extension() const override;
+};
+
+class NativeArchiveReader : public ArchiveReader {
+public:
+    struct Block {
+        uint64_t offset = 0;
+        uint32_t compSize = 0;
+        uint32_t size = 0;
+        uint8_t codec = 0;
+        uint64_t hash[2] = {0, 0};  // murmur3_128 of the raw bytes
+    };
+
+    NativeArchiveReader();
+
+    // Read the footer and index of path
+    bool open(const std::string& path);
+
+    bool list(std::vector<ZipEntryInfo>& entries) override;
+    bool extract(const std::string& destDir, const ExtractOptions& options) override;
+    bool verify(unsigned jobs, VerifyReport& report) override;
+    std::vector<std::string> dependencies() override;
+
+    size_t size() const;
+    // Entry called name, or -1
+    long find(const std::string& name) const;
+    ZipEntryInfo entry(size_t i) const;
+
+    // Blocks of entry i are [firstBlock(i), firstBlock(i + 1)): its data,
+    // then from signatureBlock(i) on its signature, if it has one
+    uint64_t firstBlock(size_t i) const;
+    uint64_t signatureBlock(size_t i) const;
+    const Block& block(uint64_t b) const;
+    // Bytes of block b as stored, to be copied into a new archive
+    bool readBlock(uint64_t b, std::vector<char>& out);
+    // Raw bytes of block b
+    bool decodeBlock(uint64_t b, std::vector<char>& scratch, std::vector<char>& raw);
+
+    // File name of the archive (in the same directory) that entry i is a
+    // delta against; empty if the entry is stored in full
+    std::string deltaBase(size_t i) const;
+    // Deltas between entry i and a version stored in full
+    unsigned chain(size_t i) const;
+    bool signature(size_t i, DeltaSignature& sig);
+    const std::string& path() const;
+
+    static const char kMagic[8];
+    static const char kEndMagic[8];
+
+private:
+    // Stored bytes of block b: a pointer into the mapping, or scratch filled from the file
+    const char* blockData(const Block& b, std::vector<char>& scratch);
+    bool readAt(uint64_t offset, char* out, size_t len);
+    // Decompression dictionary (ZSTD_DDict) for a zstd frame compressed with one, or null
+    const void* dictionaryFor(const char* frame, size_t len);
+    bool extractEntry(size_t i, const std::string& outPath, const ExtractOptions& options,
+                      std::vector<char>& scratch, std::vector<char>& raw);
+
+    std::string m_path;
+    MappedFile m_map;
+    std::ifstream m_file;       // used where the archive cannot be mapped
+    std::mutex m_fileMutex;
+    std::mutex m_dictMutex;
+    std::unordered_map<uint32_t, std::shared_ptr<void>> m_dicts;
+
+    // Index columns
+    std::vector<uint32_t> m_nameEnds;       // end of each name in m_names
+    std::string m_names;
+    std::vector<uint64_t> m_sizes;
+    std::vector<uint32_t> m_crcs;
+    std::vector<int64_t> m_mtimes;
+    std::vector<uint32_t> m_modes;
+    std::vector<uint64_t> m_firstBlocks;    // one more than there are entries
+    std::vector<uint64_t> m_signatureBlocks;
+    std::vector<uint32_t> m_deltaBases;     // archive + 1, 0 for full entries
+    std::vector<uint8_t> m_chains;
+    std::vector<std::string> m_archives;    // delta bases, by file name
+    std::vector<Block> m_blocks;
+    std::vector<uint32_t> m_slots;          // entry + 1 per hash slot, 0 when empty
+};
+
+} // namespace bik
@@ -0,0 +1,485 @@
+#include "core/ParallelCompressor.h"
+#include "core/Stats.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <zlib.h>
+
+#ifdef BIK_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+// Compressed bytes allowed to wait for the writer across all entries
+const uint64_t kMemoryBudget = 256ULL * 1024 * 1024;
+
+// A single entry whose output grows past this goes to a spill file
+const uint64_t kSpillThreshold = 16ULL * 1024 * 1024;
+
+const size_t kReadBlock = 1 << 20;
+
+// Files at least this large are split across workers
+const uint64_t kSplitThreshold = 16ULL * 1024 * 1024;
+
+// Raw bytes per segment of a split file, and segments read ahead per worker
+const size_t kSegmentSize = 1 << 20;
+const size_t kSegmentsAhead = 2;
+
+// Segments (about 2 MB each with their output) queued by all split files
+// together. A file with none queued may still read one, so no splitting
+// worker waits on another and the total stays below this plus one per worker.
+const size_t kMaxSegments = 64;
+
+// Deflate's window: how much of the previous segment primes the next
+const size_t kDictSize = 32 * 1024;
+
+} // namespace
+
+// One segment of a split file, read by the entry's worker and compressed by any
+struct ParallelCompressor::Segment {
+    std::string sourcePath;
+    Codec codec = Codec::Deflate;
+    int level = 0;
+    std::vector<char> dict;     // raw bytes just before in (deflate)
+    std::vector<char> in;
+    bool last = false;
+    // Filled by the worker
+    std::vector<char> out;
+    uint32_t crc = 0;
+    bool done = false;
+    bool ok = false;
+};
+
+CompressedReader::CompressedReader(const CompressedEntry& entry)
+    : m_entry(entry), m_offset(0) {
+    if (!entry.spillPath.empty()) {
+        m_spill.open(entry.spillPath, std::ios::binary);
+    }
+}
+
+bool CompressedReader::good() const {
+    return m_entry.spillPath.empty() || m_spill.is_open();
+}
+
+size_t CompressedReader::read(char* out, size_t len) {
+    if (!m_entry.spillPath.empty()) {
+        m_spill.read(out, static_cast<std::streamsize>(len));
+        return static_cast<size_t>(m_spill.gcount());
+    }
+    size_t n = static_cast<size_t>(std::min<uint64_t>(len, m_entry.data.size() - m_offset));
+    std::memcpy(out, m_entry.data.data() + m_offset, n);
+    m_offset += n;
+    return n;
+}
+
+ParallelCompressor::ParallelCompressor(unsigned jobs, int level, const std::string& spillDir,
+                                       Codec codec, bool longDistance)
+    : m_level(level), m_codec(codec), m_longDistance(longDistance),
+      m_spillDir(spillDir), m_nextJob(0), m_inFlight(0), m_segmentsInFlight(0), m_stop(false) {
+    if (jobs == 0) jobs = defaultJobs();
+    jobs = std::min(jobs, kMaxJobs);
+    try {
+        for (unsigned i = 0; i < jobs; i++) {
+            m_workers.emplace_back(&ParallelCompressor::workerLoop, this);
+        }
+    } catch (...) {
+        // Threads already running would terminate the process when destroyed joinable
+        stopWorkers();
+        throw;
+    }
+}
+
+ParallelCompressor::~ParallelCompressor() {
+    stopWorkers();
+    // Drop spill files the writer never consumed (e.g. after an error)
+    for (const auto& e : m_entries) {
+        if (!e->spillPath.empty()) {
+            std::error_code ec;
+            fs::remove(e->spillPath, ec);
+        }
+    }
+}
+
+void ParallelCompressor::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_workReady.notify_all();
+    for (auto& t : m_workers) {
+        t.join();
+    }
+    m_workers.clear();
+}
+
+unsigned ParallelCompressor::defaultJobs() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? std::min(n, kMaxJobs) : 1;
+}
+
+bool ParallelCompressor::supportsZstd() {
+#ifdef BIK_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+size_t ParallelCompressor::submit(const std::string& sourcePath) {
+    return submit(sourcePath, m_level);
+}
+
+size_t ParallelCompressor::submit(const std::string& sourcePath, int level) {
+    std::unique_ptr<CompressedEntry> entry(new CompressedEntry());
+    entry->sourcePath = sourcePath;
+    entry->codec = m_codec;
+    entry->level = level;
+    std::error_code ec;
+    entry->size = fs::file_size(sourcePath, ec);
+
+    size_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ticket = m_entries.size();
+        m_entries.push_back(std::move(entry));
+    }
+    m_workReady.notify_one();
+    return ticket;
+}
+
+CompressedEntry& ParallelCompressor::wait(size_t ticket) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    CompressedEntry& entry = *m_entries[ticket];
+    if (entry.done) return entry;
+    // The writer is starved: time it
+    Stats::Span span("wait", entry.sourcePath);
+    m_entryDone.wait(lock, [&] { return entry.done; });
+    return entry;
+}
+
+void ParallelCompressor::release(size_t ticket) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        CompressedEntry& entry = *m_entries[ticket];
+        m_inFlight -= entry.reserved;
+        entry.reserved = 0;
+        std::vector<char>().swap(entry.data);
+        if (!entry.spillPath.empty()) {
+            std::error_code ec;
+            fs::remove(entry.spillPath, ec);
+            entry.spillPath.clear();
+        }
+    }
+    m_workReady.notify_all();
+}
+
+void ParallelCompressor::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        // Entries are taken in ticket order; the budget only holds workers back
+        // while older entries are waiting on the writer, so the entry the
+        // writer needs next is always already taken
+        m_workReady.wait(lock, [&] {
+            return m_stop || !m_segments.empty()
+                || (m_nextJob < m_entries.size() && m_inFlight < kMemoryBudget);
+        });
+        if (m_stop) return;
+
+        // Segments of a split file come first: a worker is waiting on them
+        if (!m_segments.empty()) {
+            Segment* segment = m_segments.front();
+            m_segments.pop_front();
+            lock.unlock();
+            bool ok = compressSegment(*segment);
+            lock.lock();
+            segment->ok = ok;
+            segment->done = true;
+            m_segmentDone.notify_all();
+            continue;
+        }
+
+        size_t ticket = m_nextJob++;
+        CompressedEntry& entry = *m_entries[ticket];
+        entry.reserved = std::min(entry.size, kSpillThreshold) + 1;
+        m_inFlight += entry.reserved;
+
+        lock.unlock();
+        bool ok = compress(ticket, entry);
+        lock.lock();
+
+        entry.ok = ok;
+        entry.done = true;
+        m_entryDone.notify_all();
+    }
+}
+
+bool ParallelCompressor::compress(size_t ticket, CompressedEntry& entry) {
+    Stats::Span span("compress", entry.sourcePath);
+    std::ifstream ifs(entry.sourcePath, std::ios::binary);
+    if (!ifs) return false;
+
+    std::error_code ec;
+    auto ftime = fs::last_write_time(entry.sourcePath, ec);
+    if (!ec) {
+        auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+            ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+        entry.mtime = std::chrono::system_clock::to_time_t(sctp);
+    }
+
+    std::vector<char> in(kReadBlock);
+    std::vector<char> out(1 << 16);
+    std::ofstream spill;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    Murmur3 hash;
+    uint64_t size = 0;
+    bool ok = true;
+
+    auto emit = [&](const char* p, size_t n) {
+        if (!spill.is_open() && entry.data.size() + n > kSpillThreshold) {
+            entry.spillPath = (fs::path(m_spillDir) / (".bik-spill-" + std::to_string(ticket) + "-"
+                + std::to_string(reinterpret_cast<uintptr_t>(this)))).string();
+            spill.open(entry.spillPath, std::ios::binary | std::ios::trunc);
+            spill.write(entry.data.data(), static_cast<std::streamsize>(entry.data.size()));
+            std::vector<char>().swap(entry.data);
+        }
+        if (spill.is_open()) {
+            spill.write(p, static_cast<std::streamsize>(n));
+        } else {
+            entry.data.insert(entry.data.end(), p, p + n);
+        }
+        entry.compSize += n;
+    };
+
+    // Read the next block, feeding the CRC and hash; false on a read error
+    bool last = false;
+    std::streamsize got = 0;
+    auto next_block = [&]() {
+        ifs.read(in.data(), static_cast<std::streamsize>(in.size()));
+        got = ifs.gcount();
+        if (ifs.bad()) return false;
+        last = ifs.eof();
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(in.data()), static_cast<uInt>(got));
+        hash.update(in.data(), static_cast<size_t>(got));
+        size += static_cast<uint64_t>(got);
+        return true;
+    };
+
+    if (m_workers.size() > 1 && entry.size >= kSplitThreshold) {
+        uint32_t splitCrc = 0;
+        ok = compressSplit(ifs, entry, emit, splitCrc, hash, size);
+        crc = splitCrc;
+    } else if (entry.codec == Codec::Zstd) {
+#ifdef BIK_HAVE_ZSTD
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        if (!cctx) return false;
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, entry.level);
+        if (m_longDistance) {
+            // Window stays at 2^27 so default decoders (libzip included) accept it
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, 27);
+        }
+        do {
+            if (!next_block()) { ok = false; break; }
+            ZSTD_inBuffer zin{in.data(), static_cast<size_t>(got), 0};
+            ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+            bool finished = false;
+            while (!finished) {
+                ZSTD_outBuffer zout{out.data(), out.size(), 0};
+                size_t remaining = ZSTD_compressStream2(cctx, &zout, &zin, mode);
+                if (ZSTD_isError(remaining)) { ok = false; break; }
+                emit(out.data(), zout.pos);
+                finished = last ? remaining == 0 : zin.pos == zin.size;
+            }
+        } while (ok && !last);
+        ZSTD_freeCCtx(cctx);
+#else
+        return false;
+#endif
+    } else {
+        z_stream zs{};
+        if (deflateInit2(&zs, entry.level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        do {
+            if (!next_block()) { ok = false; break; }
+            int flush = last ? Z_FINISH : Z_NO_FLUSH;
+            zs.next_in = reinterpret_cast<Bytef*>(in.data());
+            zs.avail_in = static_cast<uInt>(got);
+            do {
+                zs.next_out = reinterpret_cast<Bytef*>(out.data());
+                zs.avail_out = static_cast<uInt>(out.size());
+                if (deflate(&zs, flush) == Z_STREAM_ERROR) { ok = false; break; }
+                emit(out.data(), out.size() - zs.avail_out);
+            } while (zs.avail_out == 0);
+        } while (ok && !last);
+        deflateEnd(&zs);
+    }
+
+    if (spill.is_open()) {
+        spill.close();
+        if (!spill) ok = false;
+    }
+
+    entry.size = size;
+    entry.crc = static_cast<uint32_t>(crc);
+    hash.final(entry.hash);
+    return ok;
+}
+
+bool ParallelCompressor::compressSplit(std::ifstream& in, const CompressedEntry& entry,
+                                       const std::function<void(const char*, size_t)>& emit,
+                                       uint32_t& crc, Murmur3& hash, uint64_t& size) {
+    size_t window = m_workers.size() * kSegmentsAhead;
+    std::deque<std::unique_ptr<Segment>> pending;
+    std::vector<char> dict;
+    uLong total = crc32(0L, Z_NULL, 0);
+    bool readAll = false;
+    bool ok = true;
+
+    while (ok && (!readAll || !pending.empty())) {
+        // The file is read here, in order, so every segment is primed with
+        // exactly the bytes the one before it compressed
+        while (!readAll && pending.size() < window) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!pending.empty() && m_segmentsInFlight >= kMaxSegments) break;
+                m_segmentsInFlight++;
+            }
+            std::unique_ptr<Segment> segment(new Segment());
+            segment->sourcePath = entry.sourcePath;
+            segment->codec = entry.codec;
+            segment->level = entry.level;
+            segment->in.resize(kSegmentSize);
+            in.read(segment->in.data(), static_cast<std::streamsize>(kSegmentSize));
+            if (in.bad()) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_segmentsInFlight--;
+                ok = false;
+                break;
+            }
+            segment->in.resize(static_cast<size_t>(in.gcount()));
+            readAll = segment->last = in.eof() || in.peek() == std::ifstream::traits_type::eof();
+            if (entry.codec == Codec::Deflate) {
+                segment->dict.swap(dict);
+                size_t keep = std::min(kDictSize, segment->in.size());
+                dict.assign(segment->in.end() - static_cast<std::ptrdiff_t>(keep), segment->in.end());
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_segments.push_back(segment.get());
+            }
+            m_workReady.notify_one();
+            pending.push_back(std::move(segment));
+        }
+        if (!ok || pending.empty()) break;
+
+        // Compress queued segments (of any file) rather than sit idle
+        Segment& front = *pending.front();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (!front.done) {
+                if (m_segments.empty()) {
+                    m_segmentDone.wait(lock);
+                    continue;
+                }
+                Segment* segment = m_segments.front();
+                m_segments.pop_front();
+                lock.unlock();
+                bool segmentOk = compressSegment(*segment);
+                lock.lock();
+                segment->ok = segmentOk;
+                segment->done = true;
+                m_segmentDone.notify_all();
+            }
+        }
+        if (!front.ok) {
+            ok = false;
+            break;
+        }
+        emit(front.out.data(), front.out.size());
+        total = crc32_combine(total, front.crc, static_cast<z_off_t>(front.in.size()));
+        hash.update(front.in.data(), front.in.size());
+        size += front.in.size();
+        pending.pop_front();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_segmentsInFlight--;
+    }
+
+    // After a failure, take back what is still queued and let the rest finish
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto& segment : pending) {
+        auto it = std::find(m_segments.begin(), m_segments.end(), segment.get());
+        if (it != m_segments.end()) {
+            m_segments.erase(it);
+            segment->done = true;
+        }
+    }
+    m_segmentDone.wait(lock, [&] {
+        return std::all_of(pending.begin(), pending.end(), [](const std::unique_ptr<Segment>& p) { return p->done; });
+    });
+    m_segmentsInFlight -= pending.size();
+    crc = static_cast<uint32_t>(total);
+    return ok;
+}
+
+bool ParallelCompressor::compressSegment(Segment& segment) {
+    Stats::Span span("compress", segment.sourcePath);
+    segment.crc = static_cast<uint32_t>(crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(segment.in.data()),
+                                              static_cast<uInt>(segment.in.size())));
+    if (segment.codec == Codec::Zstd) {
+#ifdef BIK_HAVE_ZSTD
+        // A complete frame; consecutive frames decode as one stream
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        if (!cctx) return false;
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, segment.level);
+        if (m_longDistance) {
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, 27);
+        }
+        segment.out.resize(ZSTD_compressBound(segment.in.size()));
+        size_t n = ZSTD_compress2(cctx, segment.out.data(), segment.out.size(), segment.in.data(), segment.in.size());
+        ZSTD_freeCCtx(cctx);
+        if (ZSTD_isError(n)) return false;
+        segment.out.resize(n);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    z_stream zs{};
+    if (deflateInit2(&zs, segment.level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    bool ok = segment.dict.empty()
+        || deflateSetDictionary(&zs, reinterpret_cast<const Bytef*>(segment.dict.data()),
+                                static_cast<uInt>(segment.dict.size())) == Z_OK;
+    // Every segment but the last ends on a byte boundary without a final
+    // block, so the next one's output continues the same stream
+    int flush = segment.last ? Z_FINISH : Z_SYNC_FLUSH;
+    zs.next_in = reinterpret_cast<Bytef*>(segment.in.data());
+    zs.avail_in = static_cast<uInt>(segment.in.size());
+    segment.out.resize(deflateBound(&zs, static_cast<uLong>(segment.in.size())) + 64);
+    size_t have = 0;
+    while (ok) {
+        if (have == segment.out.size()) segment.out.resize(segment.out.size() * 2);
+        zs.next_out = reinterpret_cast<Bytef*>(segment.out.data() + have);
+        zs.avail_out = static_cast<uInt>(segment.out.size() - have);
+        int ret = deflate(&zs, flush);
+        have = segment.out.size() - zs.avail_out;
+        if (ret == Z_STREAM_ERROR) ok = false;
+        else if (segment.last ? ret == Z_STREAM_END : zs.avail_out != 0) break;
+    }
+    deflateEnd(&zs);
+    segment.out.resize(have);
+    return ok;
+}
+
+} // namespace bik
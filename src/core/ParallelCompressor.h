@@ -0,0 +1,121 @@
+#pragma once
+
+#include "core/CompressionPolicy.h"
+#include "core/Hash.h"
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bik {
+
+struct CompressedEntry {
+    std::string sourcePath;
+    uint64_t size = 0;          // uncompressed bytes
+    uint64_t compSize = 0;      // bytes of the raw deflate stream or zstd frame
+    uint32_t crc = 0;
+    uint64_t hash[2] = {0, 0};  // murmur3_128 of the uncompressed bytes
+    Codec codec = Codec::Deflate;
+    int level = 0;              // codec level
+    std::time_t mtime = 0;
+    std::vector<char> data;     // compressed bytes, when held in memory
+    std::string spillPath;      // compressed bytes, when spilled to disk
+    uint64_t reserved = 0;      // bytes counted against the memory budget
+    bool done = false;
+    bool ok = false;
+};
+
+// Sequential reader over the compressed bytes of a finished entry
+class CompressedReader {
+public:
+    explicit CompressedReader(const CompressedEntry& entry);
+
+    bool good() const;
+    // Returns the number of bytes read, 0 at the end of the stream
+    size_t read(char* out, size_t len);
+
+private:
+    const CompressedEntry& m_entry;
+    std::ifstream m_spill;
+    uint64_t m_offset;
+};
+
+// Compresses files (raw deflate, or zstd when built with libzstd) on a
+// worker pool so a single writer can append them to an archive as
+// pre-compressed entries. Entries are handed out strictly in submission
+// order, so the archive layout does not depend on thread timing.
+// Memory is bounded: workers stall while too many compressed bytes wait for
+// the writer, and any single output above the spill threshold goes to a
+// temp file instead of RAM.
+//
+// A file too large for one core to get through in reasonable time is split,
+// pigz-style, into segments that every idle worker helps compress. Deflate
+// segments are primed with the last 32 KB of the one before and end on a
+// byte boundary (sync flush), so their concatenation is one ordinary raw
+// deflate stream; zstd segments are independent frames, one multi-frame
+// stream. Either way any unzip reads the entry as usual.
+class ParallelCompressor {
+public:
+    // longDistance enables zstd long-distance matching with a 128 MB window
+    ParallelCompressor(unsigned jobs, int level, const std::string& spillDir,
+                       Codec codec = Codec::Deflate, bool longDistance = false);
+    ~ParallelCompressor();
+
+    // Queue a file for compression at the pool's level; returns its ticket
+    size_t submit(const std::string& sourcePath);
+    // Same, with a deflate level for this file
+    size_t submit(const std::string& sourcePath, int level);
+
+    // Block until the entry for ticket is compressed
+    CompressedEntry& wait(size_t ticket);
+
+    // Free the compressed bytes of ticket once the writer consumed them.
+    // Size, CRC, hash and mtime stay available.
+    void release(size_t ticket);
+
+    // Worker count used for jobs == 0
+    static unsigned defaultJobs();
+
+    // Most worker threads any pool starts; larger requests are capped
+    static constexpr unsigned kMaxJobs = 1024;
+
+    // Whether this build can produce zstd entries itself
+    static bool supportsZstd();
+
+private:
+    struct Segment;
+
+    void workerLoop();
+    // Tell the workers to finish and join them
+    void stopWorkers();
+    bool compress(size_t ticket, CompressedEntry& entry);
+    bool compressSplit(std::ifstream& in, const CompressedEntry& entry,
+                       const std::function<void(const char*, size_t)>& emit, uint32_t& crc, Murmur3& hash,
+                       uint64_t& size);
+    bool compressSegment(Segment& segment);
+
+    int m_level;
+    Codec m_codec;
+    bool m_longDistance;
+    std::string m_spillDir;
+    std::vector<std::thread> m_workers;
+    std::deque<std::unique_ptr<CompressedEntry>> m_entries;
+    std::deque<Segment*> m_segments;        // segments of split files waiting for a worker
+    size_t m_nextJob;
+    uint64_t m_inFlight;
+    size_t m_segmentsInFlight;              // read by split files and not yet emitted
+    bool m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_workReady;
+    std::condition_variable m_entryDone;
+    std::condition_variable m_segmentDone;
+};
+
+} // namespace bik
@@ -0,0 +1,274 @@
+#include "core/Stats.h"
+#include "core/Common.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace bik {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Entries kept in the largest-files list
+const size_t kLargestFiles = 10;
+
+const char* const kCounterNames[] = {
+    "files_scanned", "files_compressed", "files_reused", "files_restored",
+    "bytes_read", "bytes_written", "bytes_in", "bytes_out",
+};
+
+struct Total {
+    std::string name;
+    uint64_t ns = 0;
+    uint64_t count = 0;
+};
+
+struct Event {
+    const char* category;       // nullptr for phases
+    std::string name;
+    uint64_t startNs;
+    uint64_t durNs;
+    unsigned thread;
+};
+
+struct State {
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> tracing{false};
+    Clock::time_point origin;
+    std::atomic<uint64_t> counters[static_cast<size_t>(Stats::Counter::Count)] = {};
+
+    std::mutex mutex;
+    std::vector<Total> phases;      // in order of first use
+    std::vector<Total> spans;       // per category
+    std::vector<std::pair<uint64_t, std::string>> largest;     // size descending
+    std::vector<Event> events;
+    std::atomic<unsigned> nextThread{0};
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+uint64_t now_ns() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - state().origin).count());
+}
+
+// Small stable per-thread number for the trace
+unsigned thread_number() {
+    thread_local unsigned id = state().nextThread++;
+    return id;
+}
+
+void accumulate(std::vector<Total>& totals, const char* name, uint64_t ns) {
+    for (auto& t : totals) {
+        if (t.name == name) {
+            t.ns += ns;
+            t.count++;
+            return;
+        }
+    }
+    Total t;
+    t.name = name;
+    t.ns = ns;
+    t.count = 1;
+    totals.push_back(t);
+}
+
+long peak_rss_kb() {
+#ifndef _WIN32
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+uint64_t counter(Stats::Counter c) {
+    return state().counters[static_cast<size_t>(c)].load(std::memory_order_relaxed);
+}
+
+double ms(uint64_t ns) {
+    return static_cast<double>(ns) / 1e6;
+}
+
+} // namespace
+
+void Stats::enable(bool trace) {
+    State& s = state();
+    s.origin = Clock::now();
+    s.tracing = trace;
+    s.enabled = true;
+}
+
+bool Stats::enabled() {
+    return state().enabled.load(std::memory_order_relaxed);
+}
+
+bool Stats::tracing() {
+    return state().tracing.load(std::memory_order_relaxed);
+}
+
+void Stats::add(Counter c, uint64_t n) {
+    if (!enabled()) return;
+    state().counters[static_cast<size_t>(c)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void Stats::file(const std::string& path, uint64_t size) {
+    if (!enabled()) return;
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.largest.size() == kLargestFiles && size <= s.largest.back().first) return;
+    auto pos = std::upper_bound(s.largest.begin(), s.largest.end(), size,
+                                [](uint64_t v, const std::pair<uint64_t, std::string>& e) { return v > e.first; });
+    s.largest.insert(pos, std::make_pair(size, path));
+    if (s.largest.size() > kLargestFiles) s.largest.pop_back();
+}
+
+Stats::Phase::Phase(const char* name) : m_name(name), m_start(0) {
+    if (enabled()) m_start = now_ns() + 1;
+}
+
+Stats::Phase::~Phase() {
+    if (m_start == 0) return;
+    uint64_t start = m_start - 1;
+    uint64_t dur = now_ns() - start;
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    accumulate(s.phases, m_name, dur);
+    if (tracing()) s.events.push_back(Event{nullptr, m_name, start, dur, thread_number()});
+}
+
+Stats::Span::Span(const char* category, const std::string& name) : m_category(category), m_start(0) {
+    if (!enabled()) return;
+    if (tracing()) m_name = name;
+    m_start = now_ns() + 1;
+}
+
+Stats::Span::Span(const char* category, const std::filesystem::path& path) : m_category(category), m_start(0) {
+    if (!enabled()) return;
+    if (tracing()) m_name = path.generic_string();
+    m_start = now_ns() + 1;
+}
+
+Stats::Span::~Span() {
+    if (m_start == 0) return;
+    uint64_t start = m_start - 1;
+    uint64_t dur = now_ns() - start;
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    accumulate(s.spans, m_category, dur);
+    if (tracing()) s.events.push_back(Event{m_category, std::move(m_name), start, dur, thread_number()});
+}
+
+void Stats::print(std::ostream& out) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(1);
+
+    out << "\nStatistics (" << ms(now_ns()) << " ms)\n";
+    out << "  Phases:\n";
+    for (const auto& p : s.phases) {
+        out << "    " << std::setw(24) << std::left << p.name << std::right << std::setw(10) << ms(p.ns) << " ms";
+        if (p.count > 1) out << "  (" << p.count << "x)";
+        out << "\n";
+    }
+    if (!s.spans.empty()) {
+        out << "  Per-file work (summed over threads):\n";
+        for (const auto& p : s.spans) {
+            out << "    " << std::setw(24) << std::left << p.name << std::right << std::setw(10) << ms(p.ns)
+                << " ms  (" << p.count << " files)\n";
+        }
+    }
+
+    out << "  Files: " << counter(Counter::FilesScanned) << " scanned, " << counter(Counter::FilesCompressed)
+        << " compressed, " << counter(Counter::FilesReused) << " reused, " << counter(Counter::FilesRestored)
+        << " restored\n";
+    out << "  I/O: " << counter(Counter::BytesRead) / (1024.0 * 1024.0) << " MB read, "
+        << counter(Counter::BytesWritten) / (1024.0 * 1024.0) << " MB written\n";
+    uint64_t in = counter(Counter::BytesIn);
+    if (in > 0) {
+        out << "  Compression: " << in / (1024.0 * 1024.0) << " MB -> "
+            << counter(Counter::BytesOut) / (1024.0 * 1024.0) << " MB ("
+            << 100.0 * static_cast<double>(counter(Counter::BytesOut)) / static_cast<double>(in) << "%)\n";
+    }
+    if (!s.largest.empty()) {
+        out << "  Largest files:\n";
+        for (const auto& f : s.largest) {
+            out << "    " << std::setw(10) << f.first / (1024.0 * 1024.0) << " MB  " << f.second << "\n";
+        }
+    }
+    out << "  Peak RSS: " << peak_rss_kb() / 1024.0 << " MB" << std::endl;
+    out.flags(flags);
+}
+
+void Stats::writeJson(std::ostream& out) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+
+    out << "{\"wall_ms\": " << ms(now_ns()) << ", \"phases\": [";
+    for (size_t i = 0; i < s.phases.size(); i++) {
+        out << (i ? ", " : "") << "{\"name\": " << json_string(s.phases[i].name) << ", \"ms\": " << ms(s.phases[i].ns)
+            << ", \"count\": " << s.phases[i].count << "}";
+    }
+    out << "], \"spans\": [";
+    for (size_t i = 0; i < s.spans.size(); i++) {
+        out << (i ? ", " : "") << "{\"category\": " << json_string(s.spans[i].name)
+            << ", \"busy_ms\": " << ms(s.spans[i].ns) << ", \"count\": " << s.spans[i].count << "}";
+    }
+    out << "], \"counters\": {";
+    for (size_t i = 0; i < static_cast<size_t>(Counter::Count); i++) {
+        out << (i ? ", " : "") << "\"" << kCounterNames[i] << "\": " << counter(static_cast<Counter>(i));
+    }
+    uint64_t in = counter(Counter::BytesIn);
+    out << "}, \"compression_ratio\": "
+        << (in > 0 ? static_cast<double>(counter(Counter::BytesOut)) / static_cast<double>(in) : 0.0);
+    out << ", \"largest_files\": [";
+    for (size_t i = 0; i < s.largest.size(); i++) {
+        out << (i ? ", " : "") << "{\"path\": " << json_string(s.largest[i].second)
+            << ", \"bytes\": " << s.largest[i].first << "}";
+    }
+    out << "], \"peak_rss_kb\": " << peak_rss_kb() << "}" << std::endl;
+    out.flags(flags);
+}
+
+bool Stats::writeTrace(const std::string& path) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) return false;
+    out << std::fixed << std::setprecision(3);
+
+    // Complete ("X") events; times in microseconds
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (size_t i = 0; i < s.events.size(); i++) {
+        const Event& e = s.events[i];
+        out << "{\"name\": " << json_string(e.name) << ", \"cat\": \"" << (e.category ? e.category : "phase")
+            << "\", \"ph\": \"X\", \"ts\": " << e.startNs / 1e3 << ", \"dur\": " << e.durNs / 1e3
+            << ", \"pid\": 1, \"tid\": " << e.thread << "}" << (i + 1 < s.events.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace bik
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+
+namespace bik {
+
+// Opt-in instrumentation behind --stats and --trace. Off by default: every
+// hook then costs one relaxed atomic load. Phases are coarse steps timed on
+// the thread that runs them (scan, finalize, temp copy, ...); spans are
+// per-file work on any thread (compress, extract) and are summed per category
+// as busy time. Only with tracing on is each span kept as a trace event.
+class Stats {
+public:
+    enum class Counter {
+        FilesScanned,       // regular files looked at by a backup or restore
+        FilesCompressed,    // files compressed or chunked for a new backup
+        FilesReused,        // files taken from the previous backup as they were
+        FilesRestored,      // files written by extraction
+        BytesRead,          // source bytes read to compress, chunk or hash
+        BytesWritten,       // archive bytes and restored file bytes
+        BytesIn,            // original size of everything a new backup holds
+        BytesOut,           // what the new backup takes up on disk
+        Count
+    };
+
+    // Start collecting; trace also keeps every span as an event
+    static void enable(bool trace);
+    static bool enabled();
+    static bool tracing();
+
+    static void add(Counter counter, uint64_t n = 1);
+    // A file whose size makes it a candidate for the largest-files list
+    static void file(const std::string& path, uint64_t size);
+
+    // Times a phase from construction to destruction
+    class Phase {
+    public:
+        explicit Phase(const char* name);
+        ~Phase();
+
+        Phase(const Phase&) = delete;
+        Phase& operator=(const Phase&) = delete;
+
+    private:
+        const char* m_name;
+        uint64_t m_start;
+    };
+
+    // Times one file's worth of work in category (name is the path)
+    class Span {
+    public:
+        Span(const char* category, const std::string& name);
+        Span(const char* category, const std::filesystem::path& path);
+        ~Span();
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* m_category;
+        std::string m_name;     // kept only while tracing
+        uint64_t m_start;
+    };
+
+    // Human-readable summary
+    static void print(std::ostream& out);
+    // The same figures as one JSON object
+    static void writeJson(std::ostream& out);
+    // Chrome trace-event file (chrome://tracing, Perfetto)
+    static bool writeTrace(const std::string& path);
+};
+
+} // namespace bik
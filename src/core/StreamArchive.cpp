@@ -0,0 +1,577 @@
+#include "core/StreamArchive.h"
+#include "core/Common.h"
+#include "core/DirWalker.h"
+#include "core/FileMeta.h"
+#include "core/FileWriter.h"
+#include "core/IgnoreMatcher.h"
+#include "core/ParallelCompressor.h"
+#include "core/Stats.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <zlib.h>
+
+#ifdef BIK_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+const char StreamArchive::kMagic[8] = {'B', 'I', 'K', 'S', 'T', 'R', 'M', 1};
+const char StreamArchive::kEndMagic[8] = {'B', 'I', 'K', 'S', 'E', 'N', 'D', 1};
+
+namespace {
+
+const uint8_t kCodecDeflate = 0;
+const uint8_t kCodecZstd = 1;
+
+// Longest name or link target a reader accepts
+const uint32_t kMaxName = 64 * 1024;
+
+// Entries up to this compressed size are read whole and decoded on a worker;
+// larger ones are decoded straight from the stream
+const uint64_t kBufferedEntry = 16ULL * 1024 * 1024;
+
+// Compressed bytes allowed to wait for the decoders
+const uint64_t kDecodeBudget = 64ULL * 1024 * 1024;
+
+void put_string(std::string& buf, const std::string& s) {
+    put_u32(buf, static_cast<uint32_t>(s.size()));
+    buf += s;
+}
+
+bool read_exact(std::istream& in, char* data, size_t len) {
+    in.read(data, static_cast<std::streamsize>(len));
+    return static_cast<size_t>(in.gcount()) == len;
+}
+
+bool get_u8(std::istream& in, uint8_t& v) {
+    char c;
+    if (!read_exact(in, &c, 1)) return false;
+    v = static_cast<uint8_t>(c);
+    return true;
+}
+
+bool get_u32(std::istream& in, uint32_t& v) {
+    unsigned char b[4];
+    if (!read_exact(in, reinterpret_cast<char*>(b), sizeof(b))) return false;
+    v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | b[i];
+    return true;
+}
+
+bool get_u64(std::istream& in, uint64_t& v) {
+    unsigned char b[8];
+    if (!read_exact(in, reinterpret_cast<char*>(b), sizeof(b))) return false;
+    v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | b[i];
+    return true;
+}
+
+bool get_string(std::istream& in, std::string& s) {
+    uint32_t len = 0;
+    if (!get_u32(in, len) || len > kMaxName) return false;
+    s.resize(len);
+    return len == 0 || read_exact(in, &s[0], len);
+}
+
+struct FileRecord {
+    std::string name;
+    uint32_t mode = 0;
+    int64_t mtimeNs = 0;
+    uint8_t codec = kCodecDeflate;
+    uint64_t size = 0;
+    uint64_t compSize = 0;
+    uint32_t crc = 0;
+    std::vector<char> data;     // the compressed bytes, when buffered
+};
+
+// Pulls up to len compressed bytes; 0 once they are used up or on error
+using Source = std::function<size_t(char*, size_t)>;
+
+// Decode record's compressed bytes from source into out, checking size and CRC
+bool decode(const FileRecord& record, const Source& source, FileWriter& out) {
+    std::vector<char> in(256 * 1024);
+    std::vector<char> buf(1 << 20);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint64_t produced = 0;
+    bool ok = true;
+    bool ended = false;
+
+    auto emit = [&](const char* data, size_t n) {
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(n));
+        produced += n;
+        return out.write(data, n);
+    };
+
+    if (record.codec == kCodecZstd) {
+#ifdef BIK_HAVE_ZSTD
+        ZSTD_DCtx* dctx = ZSTD_createDCtx();
+        if (!dctx) return false;
+        size_t got = 0;
+        while (ok && (got = source(in.data(), in.size())) > 0) {
+            ZSTD_inBuffer zin{in.data(), got, 0};
+            while (ok && zin.pos < zin.size) {
+                ZSTD_outBuffer zout{buf.data(), buf.size(), 0};
+                size_t ret = ZSTD_decompressStream(dctx, &zout, &zin);
+                if (ZSTD_isError(ret)) { ok = false; break; }
+                ok = emit(buf.data(), zout.pos);
+                if (ret == 0) ended = true;
+            }
+        }
+        ZSTD_freeDCtx(dctx);
+#else
+        std::cerr << "Error: " << record.name << " is zstd-compressed; rebuild bik with libzstd to restore it" << std::endl;
+        return false;
+#endif
+    } else if (record.codec == kCodecDeflate) {
+        z_stream zs{};
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) return false;
+        size_t got = 0;
+        int ret = Z_OK;
+        while (ok && ret != Z_STREAM_END && (got = source(in.data(), in.size())) > 0) {
+            zs.next_in = reinterpret_cast<Bytef*>(in.data());
+            zs.avail_in = static_cast<uInt>(got);
+            do {
+                zs.next_out = reinterpret_cast<Bytef*>(buf.data());
+                zs.avail_out = static_cast<uInt>(buf.size());
+                ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) { ok = false; break; }
+                ok = emit(buf.data(), buf.size() - zs.avail_out) && ok;
+            } while (ok && ret != Z_STREAM_END && zs.avail_out == 0);
+        }
+        ended = ret == Z_STREAM_END;
+        inflateEnd(&zs);
+        // Let the caller see every byte consumed, even past the stream's end
+        while (ok && source(in.data(), in.size()) > 0) {}
+    } else {
+        return false;
+    }
+    return ok && ended && produced == record.size && static_cast<uint32_t>(crc) == record.crc;
+}
+
+// Write one file record to dest/name via a staged temp file
+bool restore_file(const FileRecord& record, const Source& source, const fs::path& dest) {
+    Stats::Span span("extract", record.name);
+    Stats::add(Stats::Counter::FilesRestored);
+    fs::path outPath = dest / fs::path(record.name);
+    fs::path staged = outPath.string() + ".bik-tmp";
+
+    FileWriter out;
+    bool ok = out.open(staged.string(), record.size) && decode(record, source, out);
+    ok = out.close() && ok;
+    if (ok) {
+        FileMeta meta;
+        meta.setMode(record.mode);
+        meta.mtimeNs = record.mtimeNs;
+        meta.apply(staged.string());
+    }
+    std::error_code ec;
+    if (ok) {
+        fs::rename(staged, outPath, ec);
+        if (!ec) return true;
+    }
+    fs::remove(staged, ec);
+    std::cerr << "Error: failed to restore " << record.name << std::endl;
+    return false;
+}
+
+// Worker pool decoding buffered records while the reader moves on
+class DecodeQueue {
+public:
+    DecodeQueue(unsigned jobs, const fs::path& dest) : m_dest(dest), m_inFlight(0), m_done(false), m_failed(false) {
+        for (unsigned i = 0; i < jobs; i++) {
+            m_workers.emplace_back(&DecodeQueue::workerLoop, this);
+        }
+    }
+
+    ~DecodeQueue() {
+        finish();
+    }
+
+    // Blocks while the queue holds more than the budget
+    void push(FileRecord&& record) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_spaceFree.wait(lock, [&] { return m_queue.empty() || m_inFlight + record.compSize <= kDecodeBudget; });
+        m_inFlight += record.compSize;
+        m_queue.push_back(std::move(record));
+        m_workReady.notify_one();
+    }
+
+    // Wait for every queued record; false if any failed
+    bool finish() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done = true;
+        }
+        m_workReady.notify_all();
+        for (auto& t : m_workers) {
+            if (t.joinable()) t.join();
+        }
+        return !m_failed;
+    }
+
+    bool failed() const {
+        return m_failed;
+    }
+
+private:
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_workReady.wait(lock, [&] { return m_done || !m_queue.empty(); });
+            if (m_queue.empty()) return;
+            FileRecord record = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+
+            size_t offset = 0;
+            Source source = [&](char* out, size_t len) {
+                size_t n = std::min(len, record.data.size() - offset);
+                std::memcpy(out, record.data.data() + offset, n);
+                offset += n;
+                return n;
+            };
+            if (!m_failed && !restore_file(record, source, m_dest)) m_failed = true;
+
+            lock.lock();
+            m_inFlight -= record.compSize;
+            m_spaceFree.notify_all();
+        }
+    }
+
+    fs::path m_dest;
+    std::vector<std::thread> m_workers;
+    std::deque<FileRecord> m_queue;
+    uint64_t m_inFlight;
+    bool m_done;
+    std::atomic<bool> m_failed;
+    std::mutex m_mutex;
+    std::condition_variable m_workReady;
+    std::condition_variable m_spaceFree;
+};
+
+struct IndexEntry {
+    std::string name;
+    uint64_t size;
+    uint32_t crc;
+    uint64_t offset;
+};
+
+} // namespace
+
+bool StreamArchive::write(const std::string& sourceDir, std::ostream& out, const StreamOptions& options) {
+    fs::path source = fs::absolute(sourceDir);
+    if (!fs::exists(source)) {
+        std::cerr << "Source directory does not exist: " << source << std::endl;
+        return false;
+    }
+    bool zstd = options.codec == Codec::Zstd;
+    if (zstd && !ParallelCompressor::supportsZstd()) {
+        std::cerr << "Error: streaming zstd backups need bik built with libzstd" << std::endl;
+        return false;
+    }
+
+    // Entries in stream order; files are compressed ahead on the pool
+    struct Planned {
+        std::string name;
+        FileMeta meta;
+        size_t ticket;
+    };
+    std::vector<Planned> plan;
+    ParallelCompressor compressor(options.jobs, Z_DEFAULT_COMPRESSION, options.spillDir, options.codec,
+                                  options.longDistance);
+
+    bool ok = true;
+    try {
+        Stats::Phase phase("scan");
+        DirWalker walker(source.string());
+        ok = walker.walk([&](const std::string& rel, DirWalker::Type type) {
+            if (rel == ".bik" || (options.ignore && !options.ignore->admit(source.string(), rel,
+                                                                           type == DirWalker::Type::Directory))) {
+                return DirWalker::Visit::Skip;
+            }
+            if (type != DirWalker::Type::File && type != DirWalker::Type::Symlink) {
+                return DirWalker::Visit::Continue;
+            }
+            std::string path = walker.absolutePath(rel);
+            Planned planned{rel, FileMeta(), 0};
+            if (!FileMeta::read(path, planned.meta)) {
+                std::cerr << "Error: cannot read " << path << std::endl;
+                ok = false;
+                return DirWalker::Visit::Stop;
+            }
+            if (type == DirWalker::Type::File) {
+                std::error_code ec;
+                uint64_t size = fs::file_size(path, ec);
+                CompressionChoice choice;
+                if (options.policy) choice = options.policy->choose(path, size);
+                else choice.level = Z_DEFAULT_COMPRESSION;
+                int level = options.level != 0 ? options.level : zstd ? kZstdDefaultLevel : choice.level;
+                // Already-compressed data: the fastest level, which is close to a copy
+                if (choice.store) level = zstd ? 1 : 0;
+                planned.ticket = compressor.submit(path, level);
+                Stats::add(Stats::Counter::FilesScanned);
+                Stats::file(rel, size);
+            }
+            plan.push_back(planned);
+            return DirWalker::Visit::Continue;
+        }) && ok;
+    } catch (const std::exception& e) {
+        std::cerr << "Error while scanning: " << e.what() << std::endl;
+        ok = false;
+    }
+    if (!ok) return false;
+
+    Stats::Phase phase("write");
+    std::vector<IndexEntry> index;
+    index.reserve(plan.size());
+    uint64_t offset = 0;
+    std::string header;
+    std::vector<char> buf(1 << 20);
+
+    auto emit = [&](const char* data, size_t len) {
+        out.write(data, static_cast<std::streamsize>(len));
+        offset += len;
+        return static_cast<bool>(out);
+    };
+    ok = emit(kMagic, sizeof(kMagic));
+
+    for (size_t i = 0; ok && i < plan.size(); i++) {
+        const Planned& planned = plan[i];
+        header.clear();
+        if (planned.meta.symlink) {
+            index.push_back({planned.name, 0, 0, offset});
+            put_u8(header, 'L');
+            put_string(header, planned.name);
+            put_u32(header, planned.meta.mode);
+            put_u64(header, static_cast<uint64_t>(planned.meta.mtimeNs));
+            put_string(header, planned.meta.linkTarget);
+            ok = emit(header.data(), header.size());
+            continue;
+        }
+
+        const CompressedEntry& entry = compressor.wait(planned.ticket);
+        if (!entry.ok) {
+            std::cerr << "Error: failed to read " << entry.sourcePath << std::endl;
+            ok = false;
+            break;
+        }
+        index.push_back({planned.name, entry.size, entry.crc, offset});
+        put_u8(header, 'F');
+        put_string(header, planned.name);
+        put_u32(header, planned.meta.mode);
+        put_u64(header, static_cast<uint64_t>(planned.meta.mtimeNs));
+        put_u8(header, entry.codec == Codec::Zstd ? kCodecZstd : kCodecDeflate);
+        put_u64(header, entry.size);
+        put_u64(header, entry.compSize);
+        put_u32(header, entry.crc);
+        ok = emit(header.data(), header.size());
+
+        CompressedReader reader(entry);
+        ok = ok && reader.good();
+        size_t n = 0;
+        uint64_t copied = 0;
+        while (ok && (n = reader.read(buf.data(), buf.size())) > 0) {
+            ok = emit(buf.data(), n);
+            copied += n;
+        }
+        ok = ok && copied == entry.compSize;
+        Stats::add(Stats::Counter::FilesCompressed);
+        Stats::add(Stats::Counter::BytesRead, entry.size);
+        Stats::add(Stats::Counter::BytesIn, entry.size);
+        compressor.release(planned.ticket);
+    }
+
+    if (ok) {
+        uint64_t indexOffset = offset;
+        header.clear();
+        put_u8(header, 'E');
+        put_u64(header, index.size());
+        for (const auto& e : index) {
+            put_string(header, e.name);
+            put_u64(header, e.size);
+            put_u32(header, e.crc);
+            put_u64(header, e.offset);
+        }
+        put_u64(header, indexOffset);
+        header.append(kEndMagic, sizeof(kEndMagic));
+        ok = emit(header.data(), header.size());
+        out.flush();
+        ok = ok && static_cast<bool>(out);
+    }
+    if (!ok) {
+        std::cerr << "Error: failed to write the backup stream" << std::endl;
+        return false;
+    }
+    Stats::add(Stats::Counter::BytesWritten, offset);
+    Stats::add(Stats::Counter::BytesOut, offset);
+    return true;
+}
+
+bool StreamArchive::extract(std::istream& in, const std::string& destDir, const ExtractOptions& options,
+                            std::unordered_set<std::string>* names) {
+    Stats::Phase phase("extract");
+    fs::path dest = fs::absolute(destDir);
+    char magic[sizeof(kMagic)];
+    if (!read_exact(in, magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        std::cerr << "Error: input is not a bik backup stream" << std::endl;
+        return false;
+    }
+
+    unsigned jobs = options.jobs == 0 ? ParallelCompressor::defaultJobs() : options.jobs;
+    std::unique_ptr<DecodeQueue> decoders;
+    if (jobs > 1) decoders.reset(new DecodeQueue(jobs, dest));
+
+    std::vector<IndexEntry> seen;
+    std::unordered_set<std::string> createdDirs;
+    // Names are checked as strings only, so a link on the way (`a -> /etc`
+    // then `a/passwd`) would lead out of dest: no parent may be a link
+    auto make_parent = [&](const std::string& name) {
+        size_t slash = name.rfind('/');
+        if (slash == std::string::npos) return true;
+        std::string dir = name.substr(0, slash);
+        if (createdDirs.count(dir)) return true;
+        for (size_t at = 0; at != std::string::npos;) {
+            at = dir.find('/', at + 1);
+            std::error_code ec;
+            if (fs::is_symlink(fs::symlink_status(dest / fs::path(dir.substr(0, at)), ec))) {
+                std::cerr << "Error: refusing to restore " << name << " through a symlink" << std::endl;
+                return false;
+            }
+        }
+        std::error_code ec;
+        fs::create_directories(dest / fs::path(dir), ec);
+        if (ec) return false;
+        createdDirs.insert(dir);
+        return true;
+    };
+    // Links are created once every file is written, so none is in place
+    // while the stream is still naming paths
+    std::vector<std::pair<FileRecord, std::string>> links;
+    auto restore_link = [&](const FileRecord& record, const std::string& target) {
+        if (!make_parent(record.name)) return false;
+        fs::path outPath = dest / fs::path(record.name);
+        fs::path staged = outPath.string() + ".bik-tmp";
+        std::error_code ec;
+        fs::remove(staged, ec);
+        fs::create_symlink(target, staged, ec);
+        if (!ec) {
+            FileMeta meta;
+            meta.setMode(record.mode);
+            meta.mtimeNs = record.mtimeNs;
+            meta.apply(staged.string());
+            fs::rename(staged, outPath, ec);
+        }
+        if (ec) {
+            fs::remove(staged, ec);
+            std::cerr << "Error: failed to restore " << record.name << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    bool ok = true;
+    bool complete = false;
+    while (ok && !(decoders && decoders->failed())) {
+        uint8_t type = 0;
+        if (!get_u8(in, type)) {
+            break;
+        }
+        if (type == 'E') {
+            // Trailing index: the stream is complete if it lists exactly what came before
+            uint64_t count = 0;
+            ok = get_u64(in, count) && count == seen.size();
+            for (uint64_t i = 0; ok && i < count; i++) {
+                IndexEntry e;
+                ok = get_string(in, e.name) && get_u64(in, e.size) && get_u32(in, e.crc) && get_u64(in, e.offset)
+                     && e.name == seen[i].name && e.size == seen[i].size && e.crc == seen[i].crc;
+            }
+            uint64_t indexOffset = 0;
+            char end[sizeof(kEndMagic)];
+            ok = ok && get_u64(in, indexOffset) && read_exact(in, end, sizeof(end))
+                 && std::memcmp(end, kEndMagic, sizeof(kEndMagic)) == 0;
+            complete = ok;
+            break;
+        }
+
+        FileRecord record;
+        uint64_t mtime = 0;
+        if ((type != 'F' && type != 'L') || !get_string(in, record.name) || !get_u32(in, record.mode)
+            || !get_u64(in, mtime) || !safe_name(record.name)) {
+            ok = false;
+            break;
+        }
+        record.mtimeNs = static_cast<int64_t>(mtime);
+        bool wanted = !options.only || options.only->count(record.name);
+        if (names) names->insert(record.name);
+
+        if (type == 'L') {
+            std::string target;
+            if (!get_string(in, target)) { ok = false; break; }
+            seen.push_back({record.name, 0, 0, 0});
+            if (wanted) links.emplace_back(std::move(record), std::move(target));
+            continue;
+        }
+
+        if (!get_u8(in, record.codec) || !get_u64(in, record.size) || !get_u64(in, record.compSize)
+            || !get_u32(in, record.crc)) {
+            ok = false;
+            break;
+        }
+        seen.push_back({record.name, record.size, record.crc, 0});
+        if (!wanted) {
+            in.ignore(static_cast<std::streamsize>(record.compSize));
+            ok = static_cast<uint64_t>(in.gcount()) == record.compSize;
+            continue;
+        }
+        if (!make_parent(record.name)) { ok = false; break; }
+
+        if (decoders && record.compSize <= kBufferedEntry) {
+            record.data.resize(static_cast<size_t>(record.compSize));
+            if (!read_exact(in, record.data.data(), record.data.size())) { ok = false; break; }
+            decoders->push(std::move(record));
+            continue;
+        }
+
+        // Too large to buffer: decode while reading
+        uint64_t left = record.compSize;
+        Source source = [&](char* out, size_t len) -> size_t {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(len, left));
+            in.read(out, static_cast<std::streamsize>(n));
+            n = static_cast<size_t>(in.gcount());
+            left -= n;
+            return n;
+        };
+        ok = restore_file(record, source, dest) && left == 0;
+    }
+
+    if (decoders && !decoders->finish()) ok = false;
+    for (size_t i = 0; ok && complete && i < links.size(); i++) {
+        ok = restore_link(links[i].first, links[i].second);
+    }
+    if (!complete && in.eof()) {
+        std::cerr << "Error: the backup stream ended early" << std::endl;
+        return false;
+    }
+    if (!ok || !complete) {
+        std::cerr << "Error: the backup stream is damaged" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace bik
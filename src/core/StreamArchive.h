@@ -0,0 +1,59 @@
+#pragma once
+
+#include "core/CompressionPolicy.h"
+#include "core/ZipUtils.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+
+namespace bik {
+
+class IgnoreMatcher;
+
+struct StreamOptions {
+    // Compression threads; 0 uses every core
+    unsigned jobs = 0;
+    // Per-file store/level decision; null compresses everything at the default level
+    const CompressionPolicy* policy = nullptr;
+    // zstd needs bik built with libzstd
+    Codec codec = Codec::Deflate;
+    // Level for every entry; 0 keeps the policy's (deflate) or codec default (zstd)
+    int level = 0;
+    bool longDistance = false;
+    IgnoreMatcher* ignore = nullptr;
+    // Where compressed entries too large to hold in memory wait for the writer
+    std::string spillDir;
+};
+
+// Sequential backup format for pipes (`bik backup --stdout`, `bik load --stdin`).
+// Nothing is ever seeked: a reader extracts each entry as it arrives, and the
+// writer needs no local copy of the archive.
+//
+//   "BIKSTRM\x01"
+//   per entry:  'F' | name | mode u32 | mtimeNs i64 | codec u8 | size u64 | compSize u64 | crc u32 | data
+//               'L' | name | mode u32 | mtimeNs i64 | target
+//   'E' | count u64 | count x (name | size u64 | crc u32 | offset u64) | indexOffset u64 | "BIKSEND\x01"
+//
+// Names and targets are a u32 length followed by the bytes; integers are
+// little-endian. Each file is one compressed block (raw deflate, or a zstd
+// frame), so memory stays bounded by the compressor's budget on one side and
+// by the decoders' queue on the other. The trailing index lets a reader
+// confirm the stream is complete before anything is deleted.
+class StreamArchive {
+public:
+    // Write every file under sourceDir (minus .bik and ignored paths) to out
+    static bool write(const std::string& sourceDir, std::ostream& out, const StreamOptions& options);
+
+    // Extract a stream into destDir as it is read. Each file is written beside
+    // its destination and renamed into place; names receives every path the
+    // stream holds. False if an entry is damaged or the stream ends early.
+    static bool extract(std::istream& in, const std::string& destDir, const ExtractOptions& options,
+                        std::unordered_set<std::string>* names = nullptr);
+
+    static const char kMagic[8];
+    static const char kEndMagic[8];
+};
+
+} // namespace bik
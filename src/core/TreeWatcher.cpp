@@ -0,0 +1,338 @@
+#include "core/TreeWatcher.h"
+#include "core/DirWalker.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace bik {
+
+namespace {
+
+#if defined(__linux__)
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_signal(int) {
+    g_stop = 1;
+}
+
+// Directory entries changing; the directory itself going away. Links are
+// not followed and unlinked-but-open files produce no further events.
+const uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+                            IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+// Changes are written in batches at most this often
+const auto kFlushInterval = std::chrono::milliseconds(200);
+
+// ... or as soon as this many distinct paths are waiting
+const size_t kMaxPending = 4096;
+
+#endif
+
+std::string join(const std::string& dir, const char* name) {
+    return dir.empty() ? std::string(name) : dir + "/" + name;
+}
+
+} // namespace
+
+TreeWatcher::TreeWatcher(const std::string& projectDir)
+    : m_projectDir(projectDir), m_journal(projectDir), m_fd(-1), m_syncWatch(-1), m_rescan(false),
+      m_incomplete(false), m_rootGone(false), m_syncRequested(false) {
+}
+
+TreeWatcher::~TreeWatcher() {
+#if defined(__linux__)
+    if (m_fd >= 0) ::close(m_fd);
+#endif
+}
+
+bool TreeWatcher::run() {
+#if defined(__linux__)
+    if (m_journal.watcherRunning()) {
+        std::cerr << "Error: a watcher is already running for this project" << std::endl;
+        return false;
+    }
+    if (!start()) {
+        return false;
+    }
+    flush();
+    if (!m_incomplete) m_journal.writePid();
+    std::cout << "Watching " << m_projectDir << " (" << m_watches.size() << " directories)" << std::endl;
+    std::cout << "Backups now only look at changed paths. Press Ctrl+C to stop." << std::endl;
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+
+    alignas(struct inotify_event) char buf[64 * 1024];
+    auto lastFlush = std::chrono::steady_clock::now();
+    bool ok = true;
+    while (!g_stop && !m_rootGone) {
+        struct pollfd pfd = {m_fd, POLLIN, 0};
+        bool waiting = !m_pending.empty() || m_rescan;
+        int n = ::poll(&pfd, 1, waiting ? static_cast<int>(kFlushInterval.count()) : -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: poll failed: " << std::strerror(errno) << std::endl;
+            ok = false;
+            break;
+        }
+
+        bool restart = false;
+        if (n > 0) {
+            for (;;) {
+                long len = ::read(m_fd, buf, sizeof(buf));
+                if (len <= 0) break;
+                restart = handleEvents(buf, len) || restart;
+            }
+        }
+        if (restart) {
+            // Events were lost or the ignore rules changed: start over
+            if (!start()) {
+                ok = false;
+                break;
+            }
+            if (!m_incomplete) m_journal.writePid();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (n == 0 || m_syncRequested || now - lastFlush >= kFlushInterval || m_pending.size() >= kMaxPending) {
+            flush();
+            lastFlush = now;
+        }
+        // Every event queued before the request has been read by now
+        if (m_syncRequested && m_pending.empty() && !m_rescan && m_journal.acknowledgeSync()) {
+            m_syncRequested = false;
+        }
+    }
+
+    flush();
+    m_journal.removePid();
+    if (m_rootGone) {
+        std::cerr << "Error: the project directory was removed or moved" << std::endl;
+        return false;
+    }
+    std::cout << "Stopped watching" << std::endl;
+    return ok;
+#else
+    std::cerr << "Error: bik watch needs inotify, which is only available on Linux" << std::endl;
+    return false;
+#endif
+}
+
+bool TreeWatcher::start() {
+#if defined(__linux__)
+    // A fresh inotify instance drops every old watch and queued event at once
+    if (m_fd >= 0) ::close(m_fd);
+    m_dirs.clear();
+    m_watches.clear();
+    m_pending.clear();
+    m_ignore = IgnoreMatcher();
+    m_incomplete = false;
+    m_syncWatch = -1;
+
+    m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        std::cerr << "Error: inotify_init1 failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    m_ignore.enterDirectory(m_projectDir, "");
+    if (!addWatch("")) {
+        std::cerr << "Error: cannot watch " << m_projectDir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    watchTree("");
+
+    // Without sync requests no backup could tell when the journal is complete
+    std::string bikDir = m_projectDir + "/.bik";
+    m_syncWatch = ::inotify_add_watch(m_fd, bikDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+    if (m_syncWatch < 0) {
+        std::cerr << "Warning: cannot watch " << bikDir << ": " << std::strerror(errno)
+                  << "; backups will scan the whole tree" << std::endl;
+        m_journal.removePid();
+        m_incomplete = true;
+    }
+
+    // Only changes from now on are recorded; the next backup scans everything
+    m_rescan = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TreeWatcher::watchTree(const std::string& relDir) {
+    DirWalker walker(relDir.empty() ? m_projectDir : m_projectDir + "/" + relDir);
+    walker.walk([&](const std::string& sub, DirWalker::Type type) {
+        if (type != DirWalker::Type::Directory) {
+            return DirWalker::Visit::Continue;
+        }
+        std::string rel = relDir.empty() ? sub : relDir + "/" + sub;
+        if (rel == ".bik" || !m_ignore.admit(m_projectDir, rel, true) || !addWatch(rel)) {
+            return DirWalker::Visit::Skip;
+        }
+        return DirWalker::Visit::Continue;
+    });
+}
+
+bool TreeWatcher::addWatch(const std::string& relDir) {
+#if defined(__linux__)
+    std::string abs = relDir.empty() ? m_projectDir : m_projectDir + "/" + relDir;
+    int wd = ::inotify_add_watch(m_fd, abs.c_str(), kWatchMask);
+    if (wd < 0) {
+        if (errno == ENOSPC || errno == ENOMEM) {
+            // Changes below this directory would go unseen: stop vouching
+            // for the journal so backups fall back to full scans
+            if (!m_incomplete) {
+                std::cerr << "Warning: inotify watch limit reached (fs.inotify.max_user_watches); "
+                          << "backups will scan the whole tree" << std::endl;
+                m_journal.removePid();
+            }
+            m_incomplete = true;
+        }
+        return false;
+    }
+    m_dirs[wd] = relDir;
+    m_watches[relDir] = wd;
+    return true;
+#else
+    (void)relDir;
+    return false;
+#endif
+}
+
+void TreeWatcher::unwatchTree(const std::string& relDir) {
+#if defined(__linux__)
+    std::vector<std::string> gone;
+    for (const auto& pair : m_watches) {
+        const std::string& dir = pair.first;
+        if (dir == relDir || (dir.size() > relDir.size() && dir.compare(0, relDir.size(), relDir) == 0 &&
+                              dir[relDir.size()] == '/')) {
+            gone.push_back(dir);
+        }
+    }
+    for (const auto& dir : gone) {
+        int wd = m_watches[dir];
+        ::inotify_rm_watch(m_fd, wd);
+        m_dirs.erase(wd);
+        m_watches.erase(dir);
+    }
+#else
+    (void)relDir;
+#endif
+}
+
+bool TreeWatcher::handleEvents(const char* buf, long len) {
+#if defined(__linux__)
+    bool restart = false;
+    for (long off = 0; off < len;) {
+        const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(buf + off);
+        off += static_cast<long>(sizeof(struct inotify_event) + ev->len);
+
+        if (ev->mask & IN_Q_OVERFLOW) {
+            restart = true;
+            continue;
+        }
+        if (m_syncWatch >= 0 && ev->wd == m_syncWatch) {
+            if (ev->len > 0 && std::strcmp(ev->name, ChangeJournal::kSyncFileName) == 0) {
+                m_syncRequested = true;
+            }
+            continue;
+        }
+        auto found = m_dirs.find(ev->wd);
+        if (found == m_dirs.end()) {
+            continue;
+        }
+        std::string dir = found->second;
+        if (ev->mask & IN_IGNORED) {
+            // The directory is gone (its parent reported that already)
+            if (dir.empty()) m_rootGone = true;
+            m_watches.erase(dir);
+            m_dirs.erase(found);
+            continue;
+        }
+        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+            if (dir.empty()) m_rootGone = true;
+            continue;
+        }
+        if (ev->len == 0) {
+            continue;
+        }
+
+        std::string rel = join(dir, ev->name);
+        bool isDir = (ev->mask & IN_ISDIR) != 0;
+        if (rel == ".bik") {
+            continue;
+        }
+        if (!isDir && std::strcmp(ev->name, IgnoreMatcher::kFileName) == 0) {
+            // Different rules, different tree: rewatch and rescan
+            restart = true;
+            continue;
+        }
+        if (m_ignore.ignored(rel, isDir)) {
+            continue;
+        }
+
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            if (isDir) {
+                // Files created before the watch exists are covered by
+                // scanning the whole new directory at backup time
+                if (m_ignore.admit(m_projectDir, rel, true) && addWatch(rel)) {
+                    watchTree(rel);
+                }
+                record('T', rel);
+            } else {
+                record('F', rel);
+            }
+        } else if (ev->mask & (IN_MODIFY | IN_ATTRIB)) {
+            if (!isDir) record('F', rel);
+        } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            record('D', rel);
+            if (isDir) unwatchTree(rel);
+        }
+    }
+    return restart;
+#else
+    (void)buf;
+    (void)len;
+    return false;
+#endif
+}
+
+void TreeWatcher::record(char op, const std::string& relPath) {
+    if (relPath.find('\n') != std::string::npos) {
+        // Not expressible in the line format
+        m_rescan = true;
+        return;
+    }
+    m_pending.insert(std::string(1, op) + " " + relPath);
+}
+
+void TreeWatcher::flush() {
+    std::vector<std::string> lines;
+    if (m_rescan) lines.push_back("R");
+    lines.insert(lines.end(), m_pending.begin(), m_pending.end());
+    if (lines.empty()) {
+        return;
+    }
+    if (!m_journal.append(lines)) {
+        // Kept for the next attempt
+        std::cerr << "Warning: failed to write the change journal" << std::endl;
+        return;
+    }
+    m_pending.clear();
+    m_rescan = false;
+}
+
+} // namespace bik
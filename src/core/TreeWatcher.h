@@ -0,0 +1,52 @@
+#pragma once
+
+#include "core/ChangeJournal.h"
+#include "core/IgnoreMatcher.h"
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace bik {
+
+// `bik watch`: follows the project tree with inotify and records changed
+// paths in the ChangeJournal, so the next backup only looks at those.
+// Every directory (minus .bik and ignored ones) gets its own watch; new
+// directories are watched as they appear. When events are lost (queue
+// overflow, watch limit) or .bikignore changes, a full rescan is requested.
+// .bik itself is watched only for backups' sync requests (see ChangeJournal).
+class TreeWatcher {
+public:
+    explicit TreeWatcher(const std::string& projectDir);
+    ~TreeWatcher();
+
+    TreeWatcher(const TreeWatcher&) = delete;
+    TreeWatcher& operator=(const TreeWatcher&) = delete;
+
+    // Watch until SIGINT/SIGTERM; false if watching could not start
+    bool run();
+
+private:
+    bool start();
+    void watchTree(const std::string& relDir);
+    bool addWatch(const std::string& relDir);
+    void unwatchTree(const std::string& relDir);
+    // Returns true when the watches must be rebuilt from scratch
+    bool handleEvents(const char* buf, long len);
+    void record(char op, const std::string& relPath);
+    void flush();
+
+    std::string m_projectDir;
+    ChangeJournal m_journal;
+    IgnoreMatcher m_ignore;
+    int m_fd;
+    int m_syncWatch;        // watch on .bik for sync requests
+    std::unordered_map<int, std::string> m_dirs;    // watch -> relative directory
+    std::unordered_map<std::string, int> m_watches; // relative directory -> watch
+    std::set<std::string> m_pending;                // journal lines not yet written
+    bool m_rescan;          // events may have been lost: the next flush requests a rescan
+    bool m_incomplete;      // some directory has no watch, so the journal cannot be trusted
+    bool m_rootGone;
+    bool m_syncRequested;   // a backup waits for everything read so far to be flushed
+};
+
+} // namespace bik
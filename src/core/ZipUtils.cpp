@@ -1,9 +1,33 @@
 #include "core/ZipUtils.h"
+#include "core/ChangeJournal.h"
+#include "core/Common.h"
+#include "core/CompressionPolicy.h"
+#include "core/DirWalker.h"
+#include "core/FileIndex.h"
+#include "core/FileMeta.h"
+#include "core/FileWriter.h"
+#include "core/Hash.h"
+#include "core/IgnoreMatcher.h"
+#include "core/MappedFile.h"
+#include "core/ParallelCompressor.h"
+#include "core/Stats.h"
 
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <set>
 #include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <zlib.h>
 
 namespace fs = std::filesystem;
 
@@ -12,14 +36,15 @@ namespace bik {
 std::vector<std::string> ZipUtils::listFiles(const std::string& dir) {
     std::vector<std::string> files;
     
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(dir)) {
-            if (entry.is_regular_file()) {
-                files.push_back(entry.path().string());
-            }
+    DirWalker walker(dir);
+    std::vector<DirWalker::Item> items;
+    if (!walker.collect(items)) {
+        std::cerr << "Error listing files in " << dir << std::endl;
+    }
+    for (const auto& item : items) {
+        if (item.type == DirWalker::Type::File) {
+            files.push_back(walker.absolutePath(item.relPath));
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error listing files: " << e.what() << std::endl;
     }
     
     return files;
@@ -52,24 +77,398 @@ bool ZipUtils::copyDirectory(const std::string& source, const std::string& dest)
     }
 }
 
+bool ZipUtils::fileCrc32(const std::string& path, uint32_t& crc) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) return false;
+    Stats::Span span("hash", path);
+    std::vector<char> buf(1 << 20);
+    uLong c = crc32(0L, Z_NULL, 0);
+    while (ifs) {
+        ifs.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        c = crc32(c, reinterpret_cast<const Bytef*>(buf.data()), static_cast<uInt>(ifs.gcount()));
+        Stats::add(Stats::Counter::BytesRead, static_cast<uint64_t>(ifs.gcount()));
+    }
+    if (ifs.bad()) return false;
+    crc = static_cast<uint32_t>(c);
+    return true;
+}
+
+static unsigned worker_jobs(unsigned jobs, size_t entries) {
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(entries, 1)));
+}
+
+static bool wanted_entry(const ExtractOptions& options, const std::string& name) {
+    return !options.only || options.only->count(name) > 0;
+}
+
+// Where an entry is written before it is moved to out_path
+static fs::path staging_path(const fs::path& out_path, const ExtractOptions& options) {
+    return options.replaceAtomically ? fs::path(out_path.string() + ".bik-tmp") : out_path;
+}
+
+// Move a staged file into place, or drop it if writing failed
+static bool commit_output(const fs::path& staged, const fs::path& out_path, bool ok) {
+    if (staged == out_path) return ok;
+    std::error_code ec;
+    if (ok) {
+        fs::rename(staged, out_path, ec);
+        if (!ec) return true;
+    }
+    fs::remove(staged, ec);
+    return false;
+}
+
+// Create a stored symlink at out_path (staged like regular files)
+static bool write_symlink(const fs::path& out_path, const std::string& target,
+                          const FileMeta& meta, const ExtractOptions& options) {
+    fs::path staged = staging_path(out_path, options);
+    std::error_code ec;
+    fs::remove(staged, ec);
+    fs::create_symlink(target, staged, ec);
+    if (!ec) meta.apply(staged.string());
+    return commit_output(staged, out_path, !ec);
+}
+
+// Store/level for a file: options.policy decides what to store, an explicit
+// options.level overrides its size-class levels, which are deflate levels
+static CompressionChoice choose_compression(const ZipOptions& options, const fs::path& path, uint64_t size) {
+    CompressionChoice choice;
+    if (options.policy) {
+        choice = options.policy->choose(path.string(), size);
+    } else {
+        choice.level = Z_DEFAULT_COMPRESSION;
+    }
+    if (options.level != 0) {
+        choice.level = options.level;
+    } else if (options.codec == Codec::Zstd) {
+        choice.level = kZstdDefaultLevel;
+    }
+    return choice;
+}
+
+// Tell the kernel how extraction will walk the mapped archive: straight
+// through when most entries are wanted, scattered for a few selected ones
+static void advise_extraction(const MappedFile& map, size_t wanted, size_t total) {
+    map.advise(wanted * 4 < total ? MappedFile::Access::Random : MappedFile::Access::Sequential);
+}
+
+// Walk step shared by the zip writers: false for .bik and for paths the
+// ignore rules exclude (directories are then not descended into)
+static bool admit_entry(const ZipOptions& options, const fs::path& source, const std::string& rel,
+                        DirWalker::Type type) {
+    if (rel == ".bik") {
+        return false;
+    }
+    return !options.ignore || options.ignore->admit(source.string(), rel, type == DirWalker::Type::Directory);
+}
+
+// Metadata of a symlink entry, with the hash of its data: the target path
+static FileMeta with_link_hash(FileMeta meta) {
+    murmur3_128(meta.linkTarget.data(), meta.linkTarget.size(), meta.hash);
+    meta.hasHash = true;
+    return meta;
+}
+
+// Fold per-entry verify results, in archive order, into report
+static bool report_verified(const std::vector<std::string>& names, const std::vector<uint64_t>& sizes,
+                            const std::vector<char>& bad, VerifyReport& report) {
+    for (size_t i = 0; i < names.size(); i++) {
+        report.entries++;
+        if (bad[i]) report.corrupt.push_back(names[i]);
+        else report.bytes += sizes[i];
+    }
+    return report.corrupt.empty();
+}
+
+// Create every directory the entries need before any worker starts
+static bool create_dirs(const std::set<fs::path>& dirs) {
+    for (const auto& d : dirs) {
+        std::error_code ec;
+        fs::create_directories(d, ec);
+        if (ec) return false;
+    }
+    return true;
+}
+
 #if defined(BIK_HAVE_LIBZIP)
 
 #include <zip.h>
 
-static bool ensure_parent_dir(const fs::path& p) {
-    std::error_code ec;
-    fs::create_directories(p.parent_path(), ec);
-    return !ec;
+// Open an archive read-only, decoding straight from its mapping when there
+// is one (zip_source_buffer over the mapped bytes, no copies or read calls)
+static zip_t* open_archive(const std::string& path, const MappedFile& map, int& errorp) {
+    if (map.isOpen() && map.size() > 0) {
+        zip_error_t error;
+        zip_error_init(&error);
+        zip_source_t* src = zip_source_buffer_create(map.data(), map.size(), 0, &error);
+        zip_t* za = src ? zip_open_from_source(src, ZIP_RDONLY, &error) : nullptr;
+        if (!za && src) zip_source_free(src);
+        errorp = zip_error_code_zip(&error);
+        zip_error_fini(&error);
+        if (za) return za;
+    }
+    return zip_open(path.c_str(), ZIP_RDONLY, &errorp);
+}
+
+// Set the bik extra field (nanosecond mtime, hash) of an added entry
+static bool set_entry_extra(zip_t* za, zip_uint64_t idx, const FileMeta& meta) {
+    std::string extra = meta.encodeExtra();
+    return zip_file_extra_field_set(za, idx, FileMeta::kExtraFieldId, ZIP_EXTRA_FIELD_NEW,
+                                    reinterpret_cast<const zip_uint8_t*>(extra.data()),
+                                    static_cast<zip_uint16_t>(extra.size()), ZIP_FL_CENTRAL) == 0;
+}
+
+// Record mode bits (external attributes), DOS mtime and the bik extra field
+// of an added entry
+static bool set_entry_meta(zip_t* za, zip_uint64_t idx, const FileMeta& meta) {
+    bool ok = zip_file_set_external_attributes(za, idx, 0, ZIP_OPSYS_UNIX,
+                                               static_cast<zip_uint32_t>(meta.mode) << 16) == 0;
+    ok = zip_file_set_mtime(za, idx, static_cast<time_t>(meta.mtimeNs / 1000000000LL), 0) == 0 && ok;
+    return set_entry_extra(za, idx, meta) && ok;
+}
+
+// Metadata of an entry whose data is only read in zip_close, so its hash is
+// not known when the entry is added. The source fills the hash in once the
+// data has gone by: zip_close writes the central directory, where the extra
+// field lives, after all entry data and from the same entry records.
+struct PendingMeta {
+    zip_t* za = nullptr;
+    zip_int64_t idx = -1;
+    FileMeta meta;
+
+    void setHash(const uint64_t hash[2]) {
+        if (idx < 0) return;
+        meta.hash[0] = hash[0];
+        meta.hash[1] = hash[1];
+        meta.hasHash = true;
+        set_entry_extra(za, static_cast<zip_uint64_t>(idx), meta);
+    }
+};
+
+// Read the metadata of entry idx, falling back to Unix external attributes
+// and the DOS mtime for archives written without the bik extra field
+static FileMeta read_entry_meta(zip_t* za, zip_uint64_t idx, const struct zip_stat& st) {
+    FileMeta meta;
+    zip_uint16_t len = 0;
+    const zip_uint8_t* extra = zip_file_extra_field_get_by_id(za, idx, FileMeta::kExtraFieldId, 0, &len, ZIP_FL_CENTRAL);
+    if (FileMeta::decodeExtra(extra, len, meta)) return meta;
+
+    zip_uint8_t opsys = 0;
+    zip_uint32_t attr = 0;
+    if (zip_file_get_external_attributes(za, idx, 0, &opsys, &attr) == 0 && opsys == ZIP_OPSYS_UNIX) {
+        meta.setMode(attr >> 16);
+    }
+    if (st.valid & ZIP_STAT_MTIME) {
+        meta.mtimeNs = static_cast<int64_t>(st.mtime) * 1000000000LL;
+    }
+    return meta;
+}
+
+// Store a symlink as its target path with S_IFLNK in the mode
+static bool add_symlink(zip_t* za, const std::string& name, const FileMeta& meta) {
+    void* target = std::malloc(meta.linkTarget.size() + 1);
+    if (!target) return false;
+    std::memcpy(target, meta.linkTarget.data(), meta.linkTarget.size());
+    zip_source_t* zs = zip_source_buffer(za, target, meta.linkTarget.size(), 1);
+    if (!zs) { std::free(target); return false; }
+    zip_int64_t idx = zip_file_add(za, name.c_str(), zs, ZIP_FL_OVERWRITE);
+    if (idx < 0) { zip_source_free(zs); return false; }
+    zip_set_file_compression(za, idx, ZIP_CM_STORE, 0);
+    return set_entry_meta(za, idx, with_link_hash(meta));
+}
+
+// Serves an entry deflated by ParallelCompressor as already-compressed data,
+// so libzip copies it into the archive instead of compressing it again.
+// zip_close reads the sources in archive order, which is the order the
+// compressor hands finished entries out in.
+struct PrecompressedSource {
+    ParallelCompressor* compressor;
+    size_t ticket;
+    PendingMeta* pending;
+    std::unique_ptr<CompressedReader> reader;
+    zip_error_t error;
+};
+
+static zip_int64_t precompressed_source_cb(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    auto* src = static_cast<PrecompressedSource*>(userdata);
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN: {
+        CompressedEntry& entry = src->compressor->wait(src->ticket);
+        src->reader.reset(new CompressedReader(entry));
+        if (!entry.ok || !src->reader->good()) {
+            zip_error_set(&src->error, ZIP_ER_READ, 0);
+            return -1;
+        }
+        return 0;
+    }
+    case ZIP_SOURCE_READ:
+        return static_cast<zip_int64_t>(src->reader->read(static_cast<char*>(data), static_cast<size_t>(len)));
+    case ZIP_SOURCE_CLOSE:
+        src->reader.reset();
+        src->pending->setHash(src->compressor->wait(src->ticket).hash);
+        src->compressor->release(src->ticket);
+        return 0;
+    case ZIP_SOURCE_STAT: {
+        if (len < sizeof(zip_stat_t)) {
+            zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        const CompressedEntry& entry = src->compressor->wait(src->ticket);
+        if (!entry.ok) {
+            zip_error_set(&src->error, ZIP_ER_READ, 0);
+            return -1;
+        }
+        zip_stat_t* st = static_cast<zip_stat_t*>(data);
+        zip_stat_init(st);
+        st->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_CRC | ZIP_STAT_COMP_METHOD | ZIP_STAT_MTIME;
+        st->size = entry.size;
+        st->comp_size = entry.compSize;
+        st->crc = entry.crc;
+        st->comp_method = ZIP_CM_DEFLATE;
+#ifdef ZIP_CM_ZSTD
+        if (entry.codec == Codec::Zstd) st->comp_method = ZIP_CM_ZSTD;
+#endif
+        st->mtime = entry.mtime;
+        return sizeof(zip_stat_t);
+    }
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&src->error, data, len);
+    case ZIP_SOURCE_FREE:
+        zip_error_fini(&src->error);
+        delete src;
+        return 0;
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmask(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE,
+                                               ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+    default:
+        zip_error_set(&src->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
+
+static zip_source_t* precompressed_source(zip_t* za, ParallelCompressor& compressor, const fs::path& path,
+                                          int level, PendingMeta* pending) {
+    auto* src = new PrecompressedSource();
+    src->compressor = &compressor;
+    src->ticket = compressor.submit(path.string(), level);
+    src->pending = pending;
+    zip_error_init(&src->error);
+    zip_source_t* zs = zip_source_function(za, precompressed_source_cb, src);
+    if (!zs) {
+        // Let the compressor finish and free the ticket so nothing waits on it
+        compressor.wait(src->ticket);
+        compressor.release(src->ticket);
+        zip_error_fini(&src->error);
+        delete src;
+    }
+    return zs;
+}
+
+// Serves a file for libzip to compress or store itself, like
+// zip_source_file, hashing the bytes as libzip reads them
+struct HashingFileSource {
+    std::string path;
+    PendingMeta* pending;
+    std::ifstream in;
+    Murmur3 hash;
+    zip_error_t error;
+};
+
+static zip_int64_t hashing_file_source_cb(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    auto* src = static_cast<HashingFileSource*>(userdata);
+    switch (cmd) {
+    case ZIP_SOURCE_OPEN:
+        src->in.open(src->path, std::ios::binary);
+        if (!src->in) {
+            zip_error_set(&src->error, ZIP_ER_OPEN, errno);
+            return -1;
+        }
+        src->hash = Murmur3();
+        return 0;
+    case ZIP_SOURCE_READ: {
+        src->in.read(static_cast<char*>(data), static_cast<std::streamsize>(len));
+        if (src->in.bad()) {
+            zip_error_set(&src->error, ZIP_ER_READ, errno);
+            return -1;
+        }
+        zip_int64_t got = static_cast<zip_int64_t>(src->in.gcount());
+        src->hash.update(data, static_cast<size_t>(got));
+        return got;
+    }
+    case ZIP_SOURCE_CLOSE: {
+        src->in.close();
+        uint64_t hash[2];
+        src->hash.final(hash);
+        src->pending->setHash(hash);
+        return 0;
+    }
+    case ZIP_SOURCE_STAT: {
+        if (len < sizeof(zip_stat_t)) {
+            zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+            return -1;
+        }
+        zip_stat_t* st = static_cast<zip_stat_t*>(data);
+        zip_stat_init(st);
+        std::error_code ec;
+        uint64_t size = fs::file_size(src->path, ec);
+        if (!ec) {
+            st->valid |= ZIP_STAT_SIZE;
+            st->size = size;
+        }
+        return sizeof(zip_stat_t);
+    }
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&src->error, data, len);
+    case ZIP_SOURCE_FREE:
+        zip_error_fini(&src->error);
+        delete src;
+        return 0;
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmask(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE,
+                                               ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+    default:
+        zip_error_set(&src->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
+
+static zip_source_t* hashing_file_source(zip_t* za, const fs::path& path, PendingMeta* pending) {
+    auto* src = new HashingFileSource();
+    src->path = path.string();
+    src->pending = pending;
+    zip_error_init(&src->error);
+    zip_source_t* zs = zip_source_function(za, hashing_file_source_cb, src);
+    if (!zs) {
+        zip_error_fini(&src->error);
+        delete src;
+    }
+    return zs;
 }
 
-static std::string to_unix_path(const fs::path& p) {
-    std::string s = p.generic_string();
-    // Ensure no leading ./
-    if (s.rfind("./", 0) == 0) s = s.substr(2);
-    return s;
+// Fill the CRC of every indexed entry from the central directory of the
+// freshly written archive
+static void refresh_index_crcs(const fs::path& zipPath, FileIndex& index) {
+    int errorp = 0;
+    zip_t* za = zip_open(zipPath.string().c_str(), ZIP_RDONLY, &errorp);
+    if (!za) return;
+    zip_int64_t n = zip_get_num_entries(za, 0);
+    for (zip_int64_t i = 0; i < n; ++i) {
+        struct zip_stat st;
+        zip_stat_init(&st);
+        if (zip_stat_index(za, i, 0, &st) != 0 || !st.name) continue;
+        const FileIndexEntry* e = index.find(st.name);
+        if (e) {
+            FileIndexEntry updated = *e;
+            updated.crc = st.crc;
+            index.set(updated);
+        }
+    }
+    zip_close(za);
 }
 
-bool ZipUtils::createZip(const std::string& sourceDir, const std::string& zipPath) {
+bool ZipUtils::createZip(const std::string& sourceDir, const std::string& zipPath,
+                         const ZipOptions& options) {
     fs::path source = fs::absolute(sourceDir);
     fs::path dest = fs::absolute(zipPath);
     if (!fs::exists(source)) {
@@ -79,67 +478,298 @@ bool ZipUtils::createZip(const std::string& sourceDir, const std::string& zipPat
 
     fs::create_directories(dest.parent_path());
 
+    // Previous archive used as the source of unchanged entries; its mapping
+    // must outlive zip_close, which is when the raw copies are read
+    MappedFile baseMap;
+    zip_t* base = nullptr;
+    if (options.index && !options.baseZipPath.empty() && fs::exists(options.baseZipPath)) {
+        int baseErr = 0;
+        if (baseMap.open(options.baseZipPath)) baseMap.advise(MappedFile::Access::Sequential);
+        base = open_archive(options.baseZipPath, baseMap, baseErr);
+    }
+
+    bool zstd = options.codec == Codec::Zstd;
+#ifndef ZIP_CM_ZSTD
+    if (zstd) {
+        std::cerr << "libzip: this libzip was built without zstd support\n";
+        if (base) zip_close(base);
+        return false;
+    }
+#endif
+    if (zstd && options.longDistance && !ParallelCompressor::supportsZstd()) {
+        std::cerr << "Error: zstd long-distance matching needs bik built with libzstd\n";
+        if (base) zip_close(base);
+        return false;
+    }
+
+    // Worker pool compressing files ahead of zip_close; must outlive it.
+    // zstd entries always go through it when bik has libzstd (that is where
+    // long-distance matching is set), otherwise libzip compresses them inline.
+    unsigned jobs = options.jobs == 0 ? ParallelCompressor::defaultJobs() : options.jobs;
+    std::unique_ptr<ParallelCompressor> compressor;
+    if (zstd ? ParallelCompressor::supportsZstd() : jobs > 1) {
+        compressor.reset(new ParallelCompressor(jobs, Z_DEFAULT_COMPRESSION, dest.parent_path().string(),
+                                                options.codec, options.longDistance));
+    }
+
+    // libzip writes to a temp file that zip_close renames over dest, so with
+    // a reused backup name the base archive stays intact until then
     int errorp = 0;
     zip_t* za = zip_open(dest.string().c_str(), ZIP_TRUNCATE | ZIP_CREATE, &errorp);
     if (!za) {
         std::cerr << "libzip: failed to open archive for writing (error " << errorp << ")\n";
+        if (base) zip_close(base);
         return false;
     }
 
+    FileIndex newIndex;
+    size_t reused = 0;
+    uint64_t sourceBytes = 0;   // uncompressed bytes going into the archive
+    // Metadata of fresh entries, completed by their sources in zip_close
+    std::deque<PendingMeta> pendingMeta;
+
     bool ok = true;
     try {
-        for (auto it = fs::recursive_directory_iterator(source); it != fs::recursive_directory_iterator(); ++it) {
-            const auto& entry = *it;
-            fs::path path = entry.path();
-
-            // Exclude .bik directory
-            fs::path rel = fs::relative(path, source);
-            if (!rel.empty() && rel.begin()->string() == ".bik") {
-                if (entry.is_directory()) it.disable_recursion_pending();
-                continue;
+        // Walking, stat-ing and queueing; inline compression happens in zip_close
+        Stats::Phase phase("scan");
+        DirWalker walker(source.string());
+        auto addPath = [&](const std::string& rel_unix, DirWalker::Type type) {
+            // Exclude .bik and ignored paths
+            if (!admit_entry(options, source, rel_unix, type)) {
+                return DirWalker::Visit::Skip;
+            }
+            fs::path path = walker.absolutePath(rel_unix);
+
+            if (type == DirWalker::Type::Symlink) {
+                FileMeta meta;
+                if (!FileMeta::read(path.string(), meta) || !add_symlink(za, rel_unix, meta)) {
+                    std::cerr << "libzip: failed to add symlink " << path << "\n";
+                    ok = false;
+                    return DirWalker::Visit::Stop;
+                }
+                return DirWalker::Visit::Continue;
             }
 
-            if (entry.is_directory()) {
-                // Optionally add explicit directory entry
-                continue;
+            if (type != DirWalker::Type::File) {
+                // Directories need no explicit entry
+                return DirWalker::Visit::Continue;
             }
 
-            if (entry.is_regular_file()) {
-                std::string rel_unix = to_unix_path(rel);
-                zip_source_t* zs = zip_source_file(za, path.string().c_str(), 0, 0);
-                if (!zs) {
-                    std::cerr << "libzip: zip_source_file failed for " << path << "\n";
-                    ok = false;
-                    break;
+            FileIndexEntry current;
+            current.path = rel_unix;
+            bool haveStat = FileIndex::statFile(path.string(), current);
+            uint64_t size = haveStat ? current.size : fs::file_size(path);
+            sourceBytes += size;
+            Stats::add(Stats::Counter::FilesScanned);
+            Stats::file(rel_unix, size);
+
+            zip_source_t* zs = nullptr;
+            bool fresh = false;
+            CompressionChoice choice;
+            FileMeta baseMeta;
+            if (base && haveStat && options.index && options.index->isUnchanged(current)) {
+                // Copy the already-compressed bytes straight from the previous archive
+                const FileIndexEntry* old = options.index->find(rel_unix);
+                zip_int64_t baseIdx = zip_name_locate(base, rel_unix.c_str(), 0);
+                struct zip_stat bst;
+                zip_stat_init(&bst);
+                if (baseIdx >= 0 && zip_stat_index(base, baseIdx, 0, &bst) == 0
+                    && bst.size == old->size && bst.crc == old->crc) {
+                    zs = zip_source_zip(za, base, baseIdx, ZIP_FL_COMPRESSED, 0, -1);
+                    if (zs) {
+                        current.crc = old->crc;
+                        baseMeta = read_entry_meta(base, static_cast<zip_uint64_t>(baseIdx), bst);
+                        reused++;
+                    }
+                }
+            }
+            if (!zs) {
+                // Stored files skip the pool: copying them on the writer is cheap
+                fresh = true;
+                choice = choose_compression(options, path, size);
+                Stats::add(Stats::Counter::FilesCompressed);
+                Stats::add(Stats::Counter::BytesRead, size);
+                pendingMeta.emplace_back();
+                PendingMeta* pending = &pendingMeta.back();
+                zs = compressor && !choice.store ? precompressed_source(za, *compressor, path, choice.level, pending)
+                                                 : hashing_file_source(za, path, pending);
+            }
+            if (!zs) {
+                std::cerr << "libzip: zip_source_file failed for " << path << "\n";
+                ok = false;
+                return DirWalker::Visit::Stop;
+            }
+            zip_int64_t idx = zip_file_add(za, rel_unix.c_str(), zs, ZIP_FL_OVERWRITE);
+            if (idx < 0) {
+                std::cerr << "libzip: zip_file_add failed for " << rel_unix << ": " << zip_strerror(za) << "\n";
+                zip_source_free(zs);
+                ok = false;
+                return DirWalker::Visit::Stop;
+            }
+            if (fresh && (choice.store || !compressor)) {
+                zip_int32_t method = ZIP_CM_DEFLATE;
+                if (choice.store) {
+                    method = ZIP_CM_STORE;
+                } else if (zstd) {
+#ifdef ZIP_CM_ZSTD
+                    method = ZIP_CM_ZSTD;
+#endif
+                }
+                // libzip takes 0 as the method's default level
+                zip_uint32_t level = choice.store || choice.level < 0 ? 0 : static_cast<zip_uint32_t>(choice.level);
+                zip_set_file_compression(za, idx, method, level);
+            }
+            FileMeta meta;
+            if (FileMeta::read(path.string(), meta)) {
+                // A reused entry keeps the hash of the data it was copied with
+                meta.hasHash = baseMeta.hasHash;
+                meta.hash[0] = baseMeta.hash[0];
+                meta.hash[1] = baseMeta.hash[1];
+                set_entry_meta(za, idx, meta);
+                if (fresh) {
+                    PendingMeta& pending = pendingMeta.back();
+                    pending.za = za;
+                    pending.idx = idx;
+                    pending.meta = meta;
                 }
-                zip_int64_t idx = zip_file_add(za, rel_unix.c_str(), zs, ZIP_FL_OVERWRITE);
+            }
+            if (haveStat) newIndex.set(current);
+            return DirWalker::Visit::Continue;
+        };
+
+        if (base && options.changes) {
+            // Journal from `bik watch`: entries of paths nothing touched are
+            // copied from the previous archive without looking at the disk
+            zip_int64_t count = zip_get_num_entries(base, 0);
+            for (zip_int64_t i = 0; i < count; i++) {
+                struct zip_stat bst;
+                zip_stat_init(&bst);
+                if (zip_stat_index(base, i, 0, &bst) != 0 || !bst.name) continue;
+                std::string name = bst.name;
+                if (name.empty() || name.back() == '/' || options.changes->touches(name)) continue;
+                zip_source_t* zs = zip_source_zip(za, base, i, ZIP_FL_COMPRESSED, 0, -1);
+                zip_int64_t idx = zs ? zip_file_add(za, name.c_str(), zs, ZIP_FL_OVERWRITE) : -1;
                 if (idx < 0) {
-                    std::cerr << "libzip: zip_file_add failed for " << rel_unix << ": " << zip_strerror(za) << "\n";
-                    zip_source_free(zs);
+                    std::cerr << "libzip: failed to copy " << name << " from the previous archive\n";
+                    if (zs) zip_source_free(zs);
                     ok = false;
                     break;
                 }
+                set_entry_meta(za, idx, read_entry_meta(base, i, bst));
+                const FileIndexEntry* old = options.index->find(name);
+                if (old) newIndex.set(*old);
+                sourceBytes += bst.size;
+                reused++;
             }
+            if (ok && !options.changes->visit(source.string(), options.ignore, addPath)) ok = false;
+        } else if (!walker.walk(addPath)) {
+            ok = false;
         }
     } catch (const std::exception& e) {
         std::cerr << "Error while zipping: " << e.what() << std::endl;
         ok = false;
     }
 
-    if (zip_close(za) != 0) {
-        std::cerr << "libzip: zip_close failed: archive not written\n";
-        ok = false;
+    {
+        Stats::Phase phase("finalize");
+        if (!ok) {
+            // Nothing is written, so a backup of the same name stays as it was
+            zip_discard(za);
+        } else if (zip_close(za) != 0) {
+            std::cerr << "libzip: zip_close failed: archive not written\n";
+            zip_discard(za);
+            ok = false;
+        }
     }
+    // The base archive feeds zip_source_zip and must outlive zip_close
+    if (base) zip_close(base);
 
-    if (!ok) {
-        // Remove incomplete archive
-        std::error_code ec;
-        fs::remove(dest, ec);
+    if (!ok) return false;
+
+    if (Stats::enabled()) {
+        uint64_t archiveBytes = fs::file_size(dest);
+        Stats::add(Stats::Counter::FilesReused, reused);
+        Stats::add(Stats::Counter::BytesWritten, archiveBytes);
+        Stats::add(Stats::Counter::BytesIn, sourceBytes);
+        Stats::add(Stats::Counter::BytesOut, archiveBytes);
     }
-    return ok;
+
+    if (options.index) {
+        Stats::Phase phase("index.crc");
+        refresh_index_crcs(dest, newIndex);
+        newIndex.setArchive(dest.string());
+        *options.index = newIndex;
+        if (base) {
+            std::cout << "Reused " << reused << " unchanged file(s) from previous backup" << std::endl;
+        }
+    }
+    return true;
+}
+
+static bool extract_entry(zip_t* za, zip_uint64_t index, const fs::path& out_path, uint64_t size,
+                          const FileMeta& meta, const ExtractOptions& options, std::vector<char>& buf) {
+    Stats::Span span("extract", out_path);
+    Stats::add(Stats::Counter::FilesRestored);
+    zip_file_t* zf = zip_fopen_index(za, index, 0);
+    if (!zf) return false;
+
+    if (meta.symlink) {
+        std::string target;
+        zip_int64_t read = 0;
+        while ((read = zip_fread(zf, buf.data(), buf.size())) > 0) {
+            target.append(buf.data(), static_cast<size_t>(read));
+        }
+        zip_fclose(zf);
+        return read == 0 && write_symlink(out_path, target, meta, options);
+    }
+
+    fs::path staged = staging_path(out_path, options);
+    FileWriter out;
+    if (!out.open(staged.string(), size)) { zip_fclose(zf); return false; }
+
+    zip_int64_t read = 0;
+    bool wrote = true;
+    while (wrote && (read = zip_fread(zf, buf.data(), buf.size())) > 0) {
+        wrote = out.write(buf.data(), static_cast<size_t>(read));
+    }
+    zip_fclose(zf);
+    bool ok = out.close() && wrote && read == 0;
+    if (ok) meta.apply(staged.string());
+    return commit_output(staged, out_path, ok);
+}
+
+bool ZipUtils::listEntries(const std::string& zipPath, std::vector<ZipEntryInfo>& entries) {
+    MappedFile map;
+    map.open(zipPath);
+    int errorp = 0;
+    zip_t* za = open_archive(zipPath, map, errorp);
+    if (!za) {
+        std::cerr << "libzip: failed to open archive (error " << errorp << ")\n";
+        return false;
+    }
+    entries.clear();
+    zip_int64_t n = zip_get_num_entries(za, 0);
+    entries.reserve(static_cast<size_t>(n));
+    for (zip_int64_t i = 0; i < n; ++i) {
+        struct zip_stat st;
+        zip_stat_init(&st);
+        if (zip_stat_index(za, i, 0, &st) != 0 || !st.name) continue;
+        FileMeta meta = read_entry_meta(za, i, st);
+        ZipEntryInfo info;
+        info.name = st.name;
+        info.size = st.size;
+        info.crc = st.crc;
+        info.mtimeNs = meta.mtimeNs;
+        info.mode = meta.mode;
+        entries.push_back(info);
+    }
+    zip_close(za);
+    return true;
 }
 
-bool ZipUtils::extractZip(const std::string& zipPath, const std::string& destDir) {
+bool ZipUtils::extractZip(const std::string& zipPath, const std::string& destDir,
+                          const ExtractOptions& options) {
+    Stats::Phase phase("extract");
     fs::path zip_file = fs::absolute(zipPath);
     fs::path dest = fs::absolute(destDir);
     if (!fs::exists(zip_file)) {
@@ -148,52 +778,177 @@ bool ZipUtils::extractZip(const std::string& zipPath, const std::string& destDir
     }
     fs::create_directories(dest);
 
+    // Every worker decodes from the same mapping
+    MappedFile map;
+    map.open(zip_file.string());
     int errorp = 0;
-    zip_t* za = zip_open(zip_file.string().c_str(), ZIP_RDONLY, &errorp);
+    zip_t* za = open_archive(zip_file.string(), map, errorp);
     if (!za) {
         std::cerr << "libzip: failed to open archive (error " << errorp << ")\n";
         return false;
     }
 
-    bool ok = true;
+    // Read the central directory once
+    struct FileItem {
+        zip_uint64_t index;
+        fs::path out_path;
+        uint64_t size;
+        FileMeta meta;
+    };
+    std::vector<FileItem> files;
+    std::set<fs::path> dirs;
     zip_int64_t n = zip_get_num_entries(za, 0);
     for (zip_int64_t i = 0; i < n; ++i) {
         struct zip_stat st;
         zip_stat_init(&st);
         if (zip_stat_index(za, i, 0, &st) != 0) {
-            ok = false; break;
+            zip_close(za);
+            return false;
         }
         std::string name = st.name ? st.name : "";
         if (name.empty()) continue;
 
+        if (!wanted_entry(options, name)) continue;
+
         fs::path out_path = dest / fs::path(name);
         if (name.back() == '/') {
             // Directory entry
-            std::error_code ec; fs::create_directories(out_path, ec);
+            dirs.insert(out_path);
             continue;
         }
+        if ((st.valid & ZIP_STAT_COMP_METHOD) && !zip_compression_method_supported(st.comp_method, 0)) {
+            std::cerr << "libzip: " << name << " uses compression method " << st.comp_method
+                      << " (93 is zstd), which this libzip cannot decompress\n";
+            zip_close(za);
+            return false;
+        }
+        dirs.insert(out_path.parent_path());
+        uint64_t size = (st.valid & ZIP_STAT_SIZE) ? st.size : 0;
+        Stats::file(name, size);
+        files.push_back({static_cast<zip_uint64_t>(i), out_path, size, read_entry_meta(za, i, st)});
+    }
 
-        if (!ensure_parent_dir(out_path)) { ok = false; break; }
-
-        zip_file_t* zf = zip_fopen_index(za, i, 0);
-        if (!zf) { ok = false; break; }
+    if (!create_dirs(dirs)) {
+        zip_close(za);
+        return false;
+    }
+    advise_extraction(map, files.size(), static_cast<size_t>(n));
 
-        std::ofstream ofs(out_path, std::ios::binary);
-        if (!ofs) { zip_fclose(zf); ok = false; break; }
+    // libzip handles are not thread-safe: every extra worker opens its own
+    unsigned jobs = worker_jobs(options.jobs, files.size());
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::atomic<unsigned> workerId(0);
 
-        char buf[1 << 15];
-        zip_int64_t read = 0;
-        while ((read = zip_fread(zf, buf, sizeof(buf))) > 0) {
-            ofs.write(buf, static_cast<std::streamsize>(read));
+    bool ok = run_workers(jobs, [&] {
+        zip_t* handle = za;
+        if (workerId++ > 0) {
+            int err = 0;
+            handle = open_archive(zip_file.string(), map, err);
+            if (!handle) { failed = true; return false; }
         }
-        zip_fclose(zf);
-        ofs.close();
+        std::vector<char> buf(1 << 20);
+        bool good = true;
+        for (size_t i = next++; i < files.size() && !failed; i = next++) {
+            if (!extract_entry(handle, files[i].index, files[i].out_path, files[i].size, files[i].meta, options, buf)) {
+                good = false;
+                failed = true;
+            }
+        }
+        if (handle != za) zip_close(handle);
+        return good;
+    });
 
-        if (read < 0) { ok = false; break; }
+    zip_close(za);
+    return ok;
+}
+
+// Inflate one entry, checking its size and CRC32 against the central
+// directory, and its data against the hash in the bik extra field if any
+static bool verify_entry(zip_t* za, zip_uint64_t index, uint64_t size, uint32_t crc, const FileMeta& meta,
+                         std::vector<char>& buf) {
+    zip_file_t* zf = zip_fopen_index(za, index, 0);
+    if (!zf) return false;
+    uLong c = crc32(0L, Z_NULL, 0);
+    Murmur3 hash;
+    uint64_t total = 0;
+    zip_int64_t read = 0;
+    while ((read = zip_fread(zf, buf.data(), buf.size())) > 0) {
+        c = crc32(c, reinterpret_cast<const Bytef*>(buf.data()), static_cast<uInt>(read));
+        if (meta.hasHash) hash.update(buf.data(), static_cast<size_t>(read));
+        total += static_cast<uint64_t>(read);
     }
+    zip_fclose(zf);
+    if (read != 0 || total != size || static_cast<uint32_t>(c) != crc) return false;
+    if (!meta.hasHash) return true;
+    uint64_t h[2];
+    hash.final(h);
+    return h[0] == meta.hash[0] && h[1] == meta.hash[1];
+}
+
+bool ZipUtils::verifyZip(const std::string& zipPath, unsigned jobs, VerifyReport& report) {
+    Stats::Phase phase("verify");
+    MappedFile map;
+    map.open(zipPath);
+    int errorp = 0;
+    zip_t* za = open_archive(zipPath, map, errorp);
+    if (!za) {
+        std::cerr << "libzip: failed to open archive (error " << errorp << ")\n";
+        return false;
+    }
+
+    std::vector<zip_uint64_t> indexes;
+    std::vector<std::string> names;
+    std::vector<uint64_t> sizes;
+    std::vector<uint32_t> crcs;
+    std::vector<FileMeta> metas;
+    zip_int64_t n = zip_get_num_entries(za, 0);
+    for (zip_int64_t i = 0; i < n; ++i) {
+        struct zip_stat st;
+        zip_stat_init(&st);
+        if (zip_stat_index(za, i, 0, &st) != 0) {
+            zip_close(za);
+            return false;
+        }
+        std::string name = st.name ? st.name : "";
+        if (name.empty() || name.back() == '/') continue;
+        if ((st.valid & ZIP_STAT_COMP_METHOD) && !zip_compression_method_supported(st.comp_method, 0)) {
+            std::cerr << "libzip: " << name << " uses compression method " << st.comp_method
+                      << " (93 is zstd), which this libzip cannot decompress\n";
+            zip_close(za);
+            return false;
+        }
+        indexes.push_back(static_cast<zip_uint64_t>(i));
+        names.push_back(name);
+        sizes.push_back(st.size);
+        crcs.push_back(st.crc);
+        metas.push_back(read_entry_meta(za, static_cast<zip_uint64_t>(i), st));
+    }
+    advise_extraction(map, names.size(), static_cast<size_t>(n));
+
+    // Same handle-per-worker scheme as extractZip; a worker that cannot
+    // open one leaves its share to the others
+    std::vector<char> bad(names.size(), 0);
+    std::atomic<size_t> next(0);
+    std::atomic<unsigned> workerId(0);
+    run_workers(worker_jobs(jobs, names.size()), [&] {
+        zip_t* handle = za;
+        if (workerId++ > 0) {
+            int err = 0;
+            handle = open_archive(zipPath, map, err);
+            if (!handle) return true;
+        }
+        std::vector<char> buf(1 << 20);
+        for (size_t i = next++; i < names.size(); i = next++) {
+            Stats::Span span("verify", names[i]);
+            if (!verify_entry(handle, indexes[i], sizes[i], crcs[i], metas[i], buf)) bad[i] = 1;
+        }
+        if (handle != za) zip_close(handle);
+        return true;
+    });
 
     zip_close(za);
-    return ok;
+    return report_verified(names, sizes, bad, report);
 }
 
 #elif defined(BIK_HAVE_MINIZIP)
@@ -206,30 +961,202 @@ extern "C" {
 #include <unzip.h>
 }
 
-static bool write_stream_to_file(unzFile uf, const fs::path& out_path) {
-    std::error_code ec; fs::create_directories(out_path.parent_path(), ec);
-    std::ofstream ofs(out_path, std::ios::binary);
-    if (!ofs) return false;
-    const size_t BUFSIZE = 1 << 15;
-    std::vector<char> buf(BUFSIZE);
+// "Version made by": Unix host, so tools interpret the mode in external_fa
+static const int kVersionMadeByUnix = (3 << 8) | 20;
+
+// Open a new entry carrying mode bits, DOS mtime and the nanosecond mtime
+// extra field in the central directory
+static bool open_entry(zipFile zf, const std::string& name, const FileMeta& meta,
+                       int method, int level, int raw) {
+    zip_fileinfo zi{};
+    std::time_t secs = static_cast<std::time_t>(meta.mtimeNs / 1000000000LL);
+    std::tm* tm = std::localtime(&secs);
+    if (tm) {
+        zi.tmz_date.tm_sec = tm->tm_sec;
+        zi.tmz_date.tm_min = tm->tm_min;
+        zi.tmz_date.tm_hour = tm->tm_hour;
+        zi.tmz_date.tm_mday = tm->tm_mday;
+        zi.tmz_date.tm_mon = tm->tm_mon;
+        zi.tmz_date.tm_year = tm->tm_year + 1900;
+    }
+    zi.external_fa = static_cast<uLong>(meta.mode) << 16;
+
+    // Extra field block: id, size, payload (little-endian)
+    std::string payload = meta.encodeExtra();
+    std::string extra;
+    extra.push_back(static_cast<char>(FileMeta::kExtraFieldId & 0xff));
+    extra.push_back(static_cast<char>(FileMeta::kExtraFieldId >> 8));
+    extra.push_back(static_cast<char>(payload.size() & 0xff));
+    extra.push_back(static_cast<char>(payload.size() >> 8));
+    extra += payload;
+
+    return zipOpenNewFileInZip4(zf, name.c_str(), &zi, nullptr, 0, extra.data(), static_cast<uInt>(extra.size()),
+                                nullptr, method, level, raw, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY,
+                                nullptr, 0, kVersionMadeByUnix, 0) == ZIP_OK;
+}
+
+// Find the payload of extra field id inside a raw extra field buffer
+static const uint8_t* find_extra_field(const uint8_t* data, size_t len, uint16_t id, size_t& fieldLen) {
+    size_t pos = 0;
+    while (pos + 4 <= len) {
+        uint16_t fid = static_cast<uint16_t>(data[pos] | (data[pos + 1] << 8));
+        uint16_t flen = static_cast<uint16_t>(data[pos + 2] | (data[pos + 3] << 8));
+        if (pos + 4 + flen > len) break;
+        if (fid == id) {
+            fieldLen = flen;
+            return data + pos + 4;
+        }
+        pos += 4 + flen;
+    }
+    return nullptr;
+}
+
+// Metadata of the current entry: the bik extra field, else Unix external
+// attributes and the DOS timestamp
+static FileMeta read_entry_meta(const unz_file_info64& fi, const uint8_t* extra, size_t extraLen) {
+    FileMeta meta;
+    size_t fieldLen = 0;
+    const uint8_t* field = find_extra_field(extra, extraLen, FileMeta::kExtraFieldId, fieldLen);
+    if (FileMeta::decodeExtra(field, fieldLen, meta)) return meta;
+
+    if ((fi.version >> 8) == 3) {
+        meta.setMode(static_cast<uint32_t>(fi.external_fa >> 16));
+    }
+    std::tm tm{};
+    tm.tm_sec = static_cast<int>(fi.tmu_date.tm_sec);
+    tm.tm_min = static_cast<int>(fi.tmu_date.tm_min);
+    tm.tm_hour = static_cast<int>(fi.tmu_date.tm_hour);
+    tm.tm_mday = static_cast<int>(fi.tmu_date.tm_mday);
+    tm.tm_mon = static_cast<int>(fi.tmu_date.tm_mon);
+    tm.tm_year = static_cast<int>(fi.tmu_date.tm_year) - 1900;
+    tm.tm_isdst = -1;
+    std::time_t secs = std::mktime(&tm);
+    if (secs != static_cast<std::time_t>(-1)) {
+        meta.mtimeNs = static_cast<int64_t>(secs) * 1000000000LL;
+    }
+    return meta;
+}
+
+// minizip I/O callbacks reading from a MappedFile: no read or seek syscalls
+struct MappedStream {
+    const MappedFile* map;
+    uint64_t pos;
+};
+
+static voidpf mapped_open(voidpf opaque, const void*, int) {
+    return new MappedStream{static_cast<const MappedFile*>(opaque), 0};
+}
+
+static uLong mapped_read(voidpf, voidpf stream, void* buf, uLong size) {
+    auto* ms = static_cast<MappedStream*>(stream);
+    uint64_t n = std::min<uint64_t>(size, ms->map->size() - std::min(ms->pos, ms->map->size()));
+    std::memcpy(buf, ms->map->data() + ms->pos, static_cast<size_t>(n));
+    ms->pos += n;
+    return static_cast<uLong>(n);
+}
+
+static uLong mapped_write(voidpf, voidpf, const void*, uLong) {
+    return 0;
+}
+
+static ZPOS64_T mapped_tell(voidpf, voidpf stream) {
+    return static_cast<MappedStream*>(stream)->pos;
+}
+
+static long mapped_seek(voidpf, voidpf stream, ZPOS64_T offset, int origin) {
+    auto* ms = static_cast<MappedStream*>(stream);
+    uint64_t base = 0;
+    if (origin == ZLIB_FILEFUNC_SEEK_CUR) base = ms->pos;
+    else if (origin == ZLIB_FILEFUNC_SEEK_END) base = ms->map->size();
+    if (base + offset > ms->map->size()) return -1;
+    ms->pos = base + offset;
+    return 0;
+}
+
+static int mapped_close(voidpf, voidpf stream) {
+    delete static_cast<MappedStream*>(stream);
+    return 0;
+}
+
+static int mapped_error(voidpf, voidpf) {
+    return 0;
+}
+
+// Open an archive for reading, through its mapping when there is one
+static unzFile open_archive(const std::string& path, const MappedFile& map) {
+    if (map.isOpen() && map.size() > 0) {
+        zlib_filefunc64_def funcs{mapped_open, mapped_read, mapped_write, mapped_tell,
+                                  mapped_seek, mapped_close, mapped_error,
+                                  const_cast<MappedFile*>(&map)};
+        unzFile uf = unzOpen2_64(path.c_str(), &funcs);
+        if (uf) return uf;
+    }
+    return unzOpen64(path.c_str());
+}
+
+static bool write_stream_to_file(unzFile uf, const fs::path& out_path, uint64_t size, const FileMeta& meta,
+                                 const ExtractOptions& options, std::vector<char>& buf) {
+    Stats::Span span("extract", out_path);
+    Stats::add(Stats::Counter::FilesRestored);
+    if (meta.symlink) {
+        std::string target;
+        int read = 0;
+        while ((read = unzReadCurrentFile(uf, buf.data(), static_cast<unsigned int>(buf.size()))) > 0) {
+            target.append(buf.data(), static_cast<size_t>(read));
+        }
+        return read == 0 && write_symlink(out_path, target, meta, options);
+    }
+
+    fs::path staged = staging_path(out_path, options);
+    FileWriter out;
+    if (!out.open(staged.string(), size)) return false;
     int read = 0;
-    while ((read = unzReadCurrentFile(uf, buf.data(), static_cast<unsigned int>(buf.size()))) > 0) {
-        ofs.write(buf.data(), read);
+    bool wrote = true;
+    while (wrote && (read = unzReadCurrentFile(uf, buf.data(), static_cast<unsigned int>(buf.size()))) > 0) {
+        wrote = out.write(buf.data(), static_cast<size_t>(read));
     }
-    ofs.close();
-    return read >= 0;
+    bool ok = out.close() && wrote && read >= 0;
+    if (ok) meta.apply(staged.string());
+    return commit_output(staged, out_path, ok);
 }
 
-static bool add_file_to_zip(zipFile zf, const fs::path& abs_path, const fs::path& rel_path) {
+// Store a symlink as its target path with S_IFLNK in the mode
+static bool add_symlink_to_zip(zipFile zf, const std::string& name, const FileMeta& meta) {
+    if (!open_entry(zf, name, with_link_hash(meta), 0, 0, 0)) return false;
+    bool ok = zipWriteInFileInZip(zf, meta.linkTarget.data(), static_cast<unsigned int>(meta.linkTarget.size())) == ZIP_OK;
+    return zipCloseFileInZip(zf) == ZIP_OK && ok;
+}
+
+// murmur3_128 of a file's contents
+static bool hash_file(const fs::path& path, uint64_t hash[2], std::vector<char>& buf) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) return false;
+    Murmur3 h;
+    while (ifs) {
+        ifs.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        h.update(buf.data(), static_cast<size_t>(ifs.gcount()));
+    }
+    if (ifs.bad()) return false;
+    h.final(hash);
+    return true;
+}
+
+static bool add_file_to_zip(zipFile zf, const fs::path& abs_path, const fs::path& rel_path, const FileMeta& meta,
+                            const CompressionChoice& choice) {
     std::string rel_unix = rel_path.generic_string();
-    zip_fileinfo zi{};
-    if (zipOpenNewFileInZip(zf, rel_unix.c_str(), &zi, nullptr, 0, nullptr, 0, nullptr, Z_DEFLATED, Z_DEFAULT_COMPRESSION) != ZIP_OK) {
+    Stats::Span span("compress", rel_unix);
+    const size_t BUFSIZE = 1 << 15;
+    std::vector<char> buf(BUFSIZE);
+    // minizip takes the extra field when the entry is opened, before any
+    // data, so the hash costs a read of its own here (stored files, and
+    // every file without a compressor pool)
+    FileMeta hashed = meta;
+    hashed.hasHash = hash_file(abs_path, hashed.hash, buf);
+    if (!open_entry(zf, rel_unix, hashed, choice.store ? 0 : Z_DEFLATED, choice.store ? 0 : choice.level, 0)) {
         return false;
     }
     std::ifstream ifs(abs_path, std::ios::binary);
     if (!ifs) { zipCloseFileInZip(zf); return false; }
-    const size_t BUFSIZE = 1 << 15;
-    std::vector<char> buf(BUFSIZE);
     while (ifs) {
         ifs.read(buf.data(), buf.size());
         std::streamsize g = ifs.gcount();
@@ -243,41 +1170,336 @@ static bool add_file_to_zip(zipFile zf, const fs::path& abs_path, const fs::path
     return zipCloseFileInZip(zf) == ZIP_OK;
 }
 
-bool ZipUtils::createZip(const std::string& sourceDir, const std::string& zipPath) {
+struct BaseEntry {
+    unz64_file_pos pos;
+    ZPOS64_T size;
+    uLong crc;
+    bool hasHash;
+    uint64_t hash[2];
+};
+
+// Map entry name -> position in a previous archive, read from its central directory once
+static std::unordered_map<std::string, BaseEntry> index_base_archive(unzFile uf) {
+    std::unordered_map<std::string, BaseEntry> entries;
+    if (unzGoToFirstFile(uf) != UNZ_OK) return entries;
+    do {
+        unz_file_info64 fi{}; char filename[1024]; uint8_t extra[1024];
+        if (unzGetCurrentFileInfo64(uf, &fi, filename, sizeof(filename), extra, sizeof(extra), nullptr, 0) != UNZ_OK) break;
+        BaseEntry be{};
+        if (unzGetFilePos64(uf, &be.pos) != UNZ_OK) break;
+        be.size = fi.uncompressed_size;
+        be.crc = fi.crc;
+        FileMeta meta = read_entry_meta(fi, extra, std::min<size_t>(fi.size_file_extra, sizeof(extra)));
+        be.hasHash = meta.hasHash;
+        be.hash[0] = meta.hash[0];
+        be.hash[1] = meta.hash[1];
+        entries[filename] = be;
+    } while (unzGoToNextFile(uf) == UNZ_OK);
+    return entries;
+}
+
+// Copy one entry's compressed bytes from base into zf without recompressing;
+// the entry keeps the hash recorded for that data
+static bool copy_raw_entry(unzFile base, const BaseEntry& be, zipFile zf, const std::string& name,
+                           FileMeta meta) {
+    meta.hasHash = be.hasHash;
+    meta.hash[0] = be.hash[0];
+    meta.hash[1] = be.hash[1];
+    unz64_file_pos pos = be.pos;
+    if (unzGoToFilePos64(base, &pos) != UNZ_OK) return false;
+    unz_file_info64 fi{};
+    if (unzGetCurrentFileInfo64(base, &fi, nullptr, 0, nullptr, 0, nullptr, 0) != UNZ_OK) return false;
+
+    int method = 0, level = 0;
+    if (unzOpenCurrentFile2(base, &method, &level, 1) != UNZ_OK) return false;
+
+    if (!open_entry(zf, name, meta, method, level, 1)) {
+        unzCloseCurrentFile(base);
+        return false;
+    }
+
+    const size_t BUFSIZE = 1 << 15;
+    std::vector<char> buf(BUFSIZE);
+    int read = 0;
+    bool ok = true;
+    while ((read = unzReadCurrentFile(base, buf.data(), static_cast<unsigned int>(buf.size()))) > 0) {
+        if (zipWriteInFileInZip(zf, buf.data(), static_cast<unsigned int>(read)) != ZIP_OK) { ok = false; break; }
+    }
+    if (read < 0) ok = false;
+    unzCloseCurrentFile(base);
+    if (zipCloseFileInZipRaw64(zf, fi.uncompressed_size, fi.crc) != ZIP_OK) ok = false;
+    return ok;
+}
+
+// Append an entry deflated by ParallelCompressor without recompressing it
+static bool write_precompressed_entry(zipFile zf, const CompressedEntry& entry, const std::string& name,
+                                      FileMeta meta) {
+    if (!entry.ok) return false;
+    meta.hasHash = true;
+    meta.hash[0] = entry.hash[0];
+    meta.hash[1] = entry.hash[1];
+    CompressedReader reader(entry);
+    if (!reader.good()) return false;
+
+    if (!open_entry(zf, name, meta, Z_DEFLATED, entry.level, 1)) {
+        return false;
+    }
+    const size_t BUFSIZE = 1 << 15;
+    std::vector<char> buf(BUFSIZE);
+    size_t n = 0;
+    bool ok = true;
+    while ((n = reader.read(buf.data(), buf.size())) > 0) {
+        if (zipWriteInFileInZip(zf, buf.data(), static_cast<unsigned int>(n)) != ZIP_OK) { ok = false; break; }
+    }
+    if (zipCloseFileInZipRaw64(zf, entry.size, entry.crc) != ZIP_OK) ok = false;
+    return ok;
+}
+
+bool ZipUtils::listEntries(const std::string& zipPath, std::vector<ZipEntryInfo>& entries) {
+    MappedFile map;
+    map.open(zipPath);
+    unzFile uf = open_archive(zipPath, map);
+    if (!uf) { std::cerr << "minizip: cannot open archive\n"; return false; }
+    entries.clear();
+    if (unzGoToFirstFile(uf) == UNZ_OK) {
+        do {
+            unz_file_info64 fi{}; char filename[1024]; uint8_t extra[1024];
+            if (unzGetCurrentFileInfo64(uf, &fi, filename, sizeof(filename), extra, sizeof(extra), nullptr, 0) != UNZ_OK) break;
+            FileMeta meta = read_entry_meta(fi, extra, std::min<size_t>(fi.size_file_extra, sizeof(extra)));
+            ZipEntryInfo info;
+            info.name = filename;
+            info.size = fi.uncompressed_size;
+            info.crc = static_cast<uint32_t>(fi.crc);
+            info.mtimeNs = meta.mtimeNs;
+            info.mode = meta.mode;
+            entries.push_back(info);
+        } while (unzGoToNextFile(uf) == UNZ_OK);
+    }
+    unzClose(uf);
+    return true;
+}
+
+static void refresh_index_crcs(const fs::path& zipPath, FileIndex& index) {
+    unzFile uf = unzOpen(zipPath.string().c_str());
+    if (!uf) return;
+    for (const auto& pair : index_base_archive(uf)) {
+        const FileIndexEntry* e = index.find(pair.first);
+        if (e) {
+            FileIndexEntry updated = *e;
+            updated.crc = static_cast<uint32_t>(pair.second.crc);
+            index.set(updated);
+        }
+    }
+    unzClose(uf);
+}
+
+bool ZipUtils::createZip(const std::string& sourceDir, const std::string& zipPath,
+                         const ZipOptions& options) {
     fs::path source = fs::absolute(sourceDir);
     fs::path dest = fs::absolute(zipPath);
     if (!fs::exists(source)) {
         std::cerr << "Source directory does not exist: " << source << std::endl;
         return false;
     }
+    if (options.codec == Codec::Zstd) {
+        std::cerr << "minizip: zstd entries are not supported by this backend; use deflate or build bik with libzip\n";
+        return false;
+    }
     fs::create_directories(dest.parent_path());
 
-    zipFile zf = zipOpen(dest.string().c_str(), APPEND_STATUS_CREATE);
-    if (!zf) { std::cerr << "minizip: cannot open archive for writing\n"; return false; }
+    MappedFile baseMap;
+    unzFile base = nullptr;
+    std::unordered_map<std::string, BaseEntry> baseEntries;
+    if (options.index && !options.baseZipPath.empty() && fs::exists(options.baseZipPath)) {
+        if (baseMap.open(options.baseZipPath)) baseMap.advise(MappedFile::Access::Sequential);
+        base = open_archive(options.baseZipPath, baseMap);
+        if (base) baseEntries = index_base_archive(base);
+    }
+
+    // Written beside dest and renamed over it once complete: with a reused
+    // backup name, dest is the base archive that entries are copied from
+    fs::path staging = dest.string() + ".bik-tmp";
+    zipFile zf = zipOpen(staging.string().c_str(), APPEND_STATUS_CREATE);
+    if (!zf) {
+        std::cerr << "minizip: cannot open archive for writing\n";
+        if (base) unzClose(base);
+        return false;
+    }
+
+    unsigned jobs = options.jobs == 0 ? ParallelCompressor::defaultJobs() : options.jobs;
+    std::unique_ptr<ParallelCompressor> compressor;
+    if (jobs > 1) {
+        compressor.reset(new ParallelCompressor(jobs, Z_DEFAULT_COMPRESSION, dest.parent_path().string()));
+    }
+
+    // Entries in archive order. With a compressor the walk only queues work
+    // and the entries are written afterwards, in the same order.
+    struct PlannedEntry {
+        fs::path path;
+        fs::path rel;
+        FileMeta meta;
+        const BaseEntry* reuse;
+        CompressionChoice choice;
+        size_t ticket;
+    };
+    std::vector<PlannedEntry> plan;
+
+    FileIndex newIndex;
+    size_t reused = 0;
+    uint64_t sourceBytes = 0;   // uncompressed bytes going into the archive
 
     bool ok = true;
     try {
-        for (auto it = fs::recursive_directory_iterator(source); it != fs::recursive_directory_iterator(); ++it) {
-            const auto& entry = *it;
-            fs::path path = entry.path();
-            fs::path rel = fs::relative(path, source);
-            if (!rel.empty() && rel.begin()->string() == ".bik") {
-                if (entry.is_directory()) it.disable_recursion_pending();
-                continue;
+        // Walking and queueing; without a compressor entries are written here too
+        Stats::Phase phase("scan");
+        DirWalker walker(source.string());
+        auto addPath = [&](const std::string& relUnix, DirWalker::Type type) {
+            if (!admit_entry(options, source, relUnix, type)) return DirWalker::Visit::Skip;
+            fs::path path = walker.absolutePath(relUnix);
+            fs::path rel = relUnix;
+            if (type == DirWalker::Type::Symlink) {
+                PlannedEntry planned{path, rel, FileMeta(), nullptr, CompressionChoice(), 0};
+                if (!FileMeta::read(path.string(), planned.meta)) { ok = false; return DirWalker::Visit::Stop; }
+                if (compressor) {
+                    plan.push_back(planned);
+                } else if (!add_symlink_to_zip(zf, relUnix, planned.meta)) {
+                    ok = false; return DirWalker::Visit::Stop;
+                }
+                return DirWalker::Visit::Continue;
+            }
+            if (type != DirWalker::Type::File) return DirWalker::Visit::Continue;
+
+            FileIndexEntry current;
+            current.path = relUnix;
+            bool haveStat = FileIndex::statFile(path.string(), current);
+            uint64_t size = haveStat ? current.size : fs::file_size(path);
+            sourceBytes += size;
+            Stats::add(Stats::Counter::FilesScanned);
+            Stats::file(relUnix, size);
+
+            PlannedEntry planned{path, rel, FileMeta(), nullptr, CompressionChoice(), 0};
+            FileMeta::read(path.string(), planned.meta);
+            if (base && haveStat && options.index && options.index->isUnchanged(current)) {
+                const FileIndexEntry* old = options.index->find(current.path);
+                auto be = baseEntries.find(current.path);
+                if (be != baseEntries.end() && be->second.size == old->size && be->second.crc == old->crc) {
+                    planned.reuse = &be->second;
+                    current.crc = old->crc;
+                    reused++;
+                }
             }
-            if (entry.is_directory()) continue;
-            if (entry.is_regular_file()) {
-                if (!add_file_to_zip(zf, path, rel)) { ok = false; break; }
+            if (!planned.reuse) {
+                planned.choice = choose_compression(options, path, size);
+                Stats::add(Stats::Counter::FilesCompressed);
+                Stats::add(Stats::Counter::BytesRead, size);
+                if (compressor && !planned.choice.store) {
+                    planned.ticket = compressor->submit(path.string(), planned.choice.level);
+                }
+            }
+            if (haveStat) newIndex.set(current);
+
+            if (compressor) {
+                plan.push_back(planned);
+            } else if (planned.reuse) {
+                if (!copy_raw_entry(base, *planned.reuse, zf, current.path, planned.meta)) {
+                    ok = false; return DirWalker::Visit::Stop;
+                }
+            } else if (!add_file_to_zip(zf, path, rel, planned.meta, planned.choice)) {
+                ok = false; return DirWalker::Visit::Stop;
             }
+            return DirWalker::Visit::Continue;
+        };
+
+        if (base && options.changes) {
+            // Journal from `bik watch`: entries of paths nothing touched are
+            // copied from the previous archive without looking at the disk
+            for (int rc = unzGoToFirstFile(base); ok && rc == UNZ_OK; rc = unzGoToNextFile(base)) {
+                unz_file_info64 fi{}; char filename[1024]; uint8_t extra[1024];
+                if (unzGetCurrentFileInfo64(base, &fi, filename, sizeof(filename), extra, sizeof(extra), nullptr, 0) != UNZ_OK) {
+                    ok = false; break;
+                }
+                std::string name = filename;
+                auto be = baseEntries.find(name);
+                if (name.empty() || name.back() == '/' || be == baseEntries.end() || options.changes->touches(name)) {
+                    continue;
+                }
+                FileMeta meta = read_entry_meta(fi, extra, std::min<size_t>(fi.size_file_extra, sizeof(extra)));
+                fs::path rel = name;
+                PlannedEntry planned{source / rel, rel, meta, &be->second, CompressionChoice(), 0};
+                const FileIndexEntry* old = options.index->find(name);
+                if (old) newIndex.set(*old);
+                sourceBytes += fi.uncompressed_size;
+                reused++;
+                if (compressor) {
+                    plan.push_back(planned);
+                } else if (!copy_raw_entry(base, be->second, zf, name, meta)) {
+                    ok = false;
+                }
+            }
+            if (ok && !options.changes->visit(source.string(), options.ignore, addPath)) ok = false;
+        } else if (!walker.walk(addPath)) {
+            ok = false;
         }
     } catch (...) { ok = false; }
 
-    if (zipClose(zf, nullptr) != ZIP_OK) ok = false;
-    if (!ok) { std::error_code ec; fs::remove(dest, ec); }
-    return ok;
+    {
+        // Entries in archive order, waiting on the compressor where needed
+        Stats::Phase phase("write");
+        for (size_t i = 0; ok && i < plan.size(); i++) {
+            const PlannedEntry& planned = plan[i];
+            std::string name = planned.rel.generic_string();
+            if (planned.reuse) {
+                // Before the link test: a journal-reused link has no target in its meta
+                ok = copy_raw_entry(base, *planned.reuse, zf, name, planned.meta);
+            } else if (planned.meta.symlink) {
+                ok = add_symlink_to_zip(zf, name, planned.meta);
+            } else if (planned.choice.store) {
+                ok = add_file_to_zip(zf, planned.path, planned.rel, planned.meta, planned.choice);
+            } else {
+                ok = write_precompressed_entry(zf, compressor->wait(planned.ticket), name, planned.meta);
+                compressor->release(planned.ticket);
+            }
+        }
+    }
+
+    {
+        Stats::Phase phase("finalize");
+        if (zipClose(zf, nullptr) != ZIP_OK) ok = false;
+    }
+    if (base) unzClose(base);
+    std::error_code ec;
+    if (ok) {
+        fs::rename(staging, dest, ec);
+        if (ec) {
+            std::cerr << "Error: cannot rename " << staging << " to " << dest << ": " << ec.message() << std::endl;
+            ok = false;
+        }
+    }
+    if (!ok) { fs::remove(staging, ec); return false; }
+
+    if (Stats::enabled()) {
+        uint64_t archiveBytes = fs::file_size(dest);
+        Stats::add(Stats::Counter::FilesReused, reused);
+        Stats::add(Stats::Counter::BytesWritten, archiveBytes);
+        Stats::add(Stats::Counter::BytesIn, sourceBytes);
+        Stats::add(Stats::Counter::BytesOut, archiveBytes);
+    }
+
+    if (options.index) {
+        Stats::Phase phase("index.crc");
+        refresh_index_crcs(dest, newIndex);
+        newIndex.setArchive(dest.string());
+        *options.index = newIndex;
+        if (base) {
+            std::cout << "Reused " << reused << " unchanged file(s) from previous backup" << std::endl;
+        }
+    }
+    return true;
 }
 
-bool ZipUtils::extractZip(const std::string& zipPath, const std::string& destDir) {
+bool ZipUtils::extractZip(const std::string& zipPath, const std::string& destDir,
+                          const ExtractOptions& options) {
+    Stats::Phase phase("extract");
     fs::path zip_file = fs::absolute(zipPath);
     fs::path dest = fs::absolute(destDir);
     if (!fs::exists(zip_file)) {
@@ -286,30 +1508,173 @@ bool ZipUtils::extractZip(const std::string& zipPath, const std::string& destDir
     }
     fs::create_directories(dest);
 
-    unzFile uf = unzOpen(zip_file.string().c_str());
+    // Every worker reads through the same mapping
+    MappedFile map;
+    map.open(zip_file.string());
+    unzFile uf = open_archive(zip_file.string(), map);
     if (!uf) { std::cerr << "minizip: cannot open archive\n"; return false; }
 
-    bool ok = true;
+    // Read the central directory once, remembering where each file entry lives
+    struct FileItem {
+        unz64_file_pos pos;
+        fs::path out_path;
+        uint64_t size;
+        FileMeta meta;
+    };
+    std::vector<FileItem> files;
+    std::set<fs::path> dirs;
+    size_t entryCount = 0;
     if (unzGoToFirstFile(uf) != UNZ_OK) { unzClose(uf); return false; }
     do {
-        if (unzOpenCurrentFile(uf) != UNZ_OK) { ok = false; break; }
-        unz_file_info fi{}; char filename[1024];
-        if (unzGetCurrentFileInfo(uf, &fi, filename, sizeof(filename), nullptr, 0, nullptr, 0) != UNZ_OK) { ok = false; break; }
+        unz_file_info64 fi{}; char filename[1024]; uint8_t extra[1024];
+        if (unzGetCurrentFileInfo64(uf, &fi, filename, sizeof(filename), extra, sizeof(extra), nullptr, 0) != UNZ_OK) {
+            unzClose(uf);
+            return false;
+        }
+        entryCount++;
         std::string name(filename);
+        if (name.empty() || !wanted_entry(options, name)) continue;
         fs::path out_path = dest / fs::path(name);
         if (name.back() == '/') {
-            std::error_code ec; fs::create_directories(out_path, ec);
-            unzCloseCurrentFile(uf);
-        } else {
-            if (!write_stream_to_file(uf, out_path)) { ok = false; break; }
-            unzCloseCurrentFile(uf);
+            dirs.insert(out_path);
+            continue;
+        }
+        if (fi.compression_method != 0 && fi.compression_method != Z_DEFLATED) {
+            std::cerr << "minizip: " << name << " uses compression method " << fi.compression_method
+                      << " (93 is zstd); extract it with a libzip build of bik\n";
+            unzClose(uf);
+            return false;
         }
-    } while (ok && unzGoToNextFile(uf) == UNZ_OK);
+        FileItem item{};
+        if (unzGetFilePos64(uf, &item.pos) != UNZ_OK) { unzClose(uf); return false; }
+        item.out_path = out_path;
+        item.size = fi.uncompressed_size;
+        Stats::file(name, item.size);
+        item.meta = read_entry_meta(fi, extra, std::min<size_t>(fi.size_file_extra, sizeof(extra)));
+        dirs.insert(out_path.parent_path());
+        files.push_back(item);
+    } while (unzGoToNextFile(uf) == UNZ_OK);
+
+    if (!create_dirs(dirs)) { unzClose(uf); return false; }
+    advise_extraction(map, files.size(), entryCount);
+
+    unsigned jobs = worker_jobs(options.jobs, files.size());
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::atomic<unsigned> workerId(0);
+
+    bool ok = run_workers(jobs, [&] {
+        unzFile handle = uf;
+        if (workerId++ > 0) {
+            handle = open_archive(zip_file.string(), map);
+            if (!handle) { failed = true; return false; }
+        }
+        std::vector<char> buf(1 << 20);
+        bool good = true;
+        for (size_t i = next++; i < files.size() && !failed; i = next++) {
+            unz64_file_pos pos = files[i].pos;
+            if (unzGoToFilePos64(handle, &pos) != UNZ_OK || unzOpenCurrentFile(handle) != UNZ_OK) {
+                good = false;
+            } else {
+                good = write_stream_to_file(handle, files[i].out_path, files[i].size, files[i].meta, options, buf);
+                unzCloseCurrentFile(handle);
+            }
+            if (!good) { failed = true; break; }
+        }
+        if (handle != uf) unzClose(handle);
+        return good;
+    });
 
     unzClose(uf);
     return ok;
 }
 
+// Inflate the entry at pos, checking its CRC32 (unzCloseCurrentFile does as
+// well) and its data against the hash in the bik extra field if any
+static bool verify_entry(unzFile uf, unz64_file_pos pos, uint64_t size, uint32_t crc, const FileMeta& meta,
+                         std::vector<char>& buf) {
+    if (unzGoToFilePos64(uf, &pos) != UNZ_OK || unzOpenCurrentFile(uf) != UNZ_OK) return false;
+    uLong c = crc32(0L, Z_NULL, 0);
+    Murmur3 hash;
+    uint64_t total = 0;
+    int read = 0;
+    while ((read = unzReadCurrentFile(uf, buf.data(), static_cast<unsigned int>(buf.size()))) > 0) {
+        c = crc32(c, reinterpret_cast<const Bytef*>(buf.data()), static_cast<uInt>(read));
+        if (meta.hasHash) hash.update(buf.data(), static_cast<size_t>(read));
+        total += static_cast<uint64_t>(read);
+    }
+    bool closed = unzCloseCurrentFile(uf) == UNZ_OK;
+    if (read != 0 || !closed || total != size || static_cast<uint32_t>(c) != crc) return false;
+    if (!meta.hasHash) return true;
+    uint64_t h[2];
+    hash.final(h);
+    return h[0] == meta.hash[0] && h[1] == meta.hash[1];
+}
+
+bool ZipUtils::verifyZip(const std::string& zipPath, unsigned jobs, VerifyReport& report) {
+    Stats::Phase phase("verify");
+    MappedFile map;
+    map.open(zipPath);
+    unzFile uf = open_archive(zipPath, map);
+    if (!uf) { std::cerr << "minizip: cannot open archive\n"; return false; }
+
+    std::vector<unz64_file_pos> positions;
+    std::vector<std::string> names;
+    std::vector<uint64_t> sizes;
+    std::vector<uint32_t> crcs;
+    std::vector<FileMeta> metas;
+    size_t entryCount = 0;
+    if (unzGoToFirstFile(uf) == UNZ_OK) {
+        do {
+            unz_file_info64 fi{}; char filename[1024]; uint8_t extra[1024];
+            if (unzGetCurrentFileInfo64(uf, &fi, filename, sizeof(filename), extra, sizeof(extra), nullptr, 0) != UNZ_OK) {
+                unzClose(uf);
+                return false;
+            }
+            entryCount++;
+            std::string name(filename);
+            if (name.empty() || name.back() == '/') continue;
+            if (fi.compression_method != 0 && fi.compression_method != Z_DEFLATED) {
+                std::cerr << "minizip: " << name << " uses compression method " << fi.compression_method
+                          << " (93 is zstd); verify it with a libzip build of bik\n";
+                unzClose(uf);
+                return false;
+            }
+            unz64_file_pos pos{};
+            if (unzGetFilePos64(uf, &pos) != UNZ_OK) { unzClose(uf); return false; }
+            positions.push_back(pos);
+            names.push_back(name);
+            sizes.push_back(fi.uncompressed_size);
+            crcs.push_back(static_cast<uint32_t>(fi.crc));
+            metas.push_back(read_entry_meta(fi, extra, std::min<size_t>(fi.size_file_extra, sizeof(extra))));
+        } while (unzGoToNextFile(uf) == UNZ_OK);
+    }
+    advise_extraction(map, names.size(), entryCount);
+
+    // Same handle-per-worker scheme as extractZip; a worker that cannot
+    // open one leaves its share to the others
+    std::vector<char> bad(names.size(), 0);
+    std::atomic<size_t> next(0);
+    std::atomic<unsigned> workerId(0);
+    run_workers(worker_jobs(jobs, names.size()), [&] {
+        unzFile handle = uf;
+        if (workerId++ > 0) {
+            handle = open_archive(zipPath, map);
+            if (!handle) return true;
+        }
+        std::vector<char> buf(1 << 20);
+        for (size_t i = next++; i < names.size(); i = next++) {
+            Stats::Span span("verify", names[i]);
+            if (!verify_entry(handle, positions[i], sizes[i], crcs[i], metas[i], buf)) bad[i] = 1;
+        }
+        if (handle != uf) unzClose(handle);
+        return true;
+    });
+
+    unzClose(uf);
+    return report_verified(names, sizes, bad, report);
+}
+
 #else
 #error "No zip backend selected. Configure with libzip or minizip."
 #endif
@@ -1,17 +1,92 @@
 #pragma once
 
+#include "core/CompressionPolicy.h"
+#include <cstdint>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace bik {
 
+class FileIndex;
+class IgnoreMatcher;
+struct ChangeSet;
+
+struct ZipOptions {
+    // Previous archive whose entries may be copied without recompression
+    std::string baseZipPath;
+    // Stat index describing baseZipPath; rewritten to describe the new archive
+    FileIndex* index = nullptr;
+    // Compression threads; 1 compresses inline, 0 uses every core
+    unsigned jobs = 1;
+    // Per-file store/level decision; null deflates everything at the default level
+    const CompressionPolicy* policy = nullptr;
+    // Codec for new entries; zstd needs the libzip backend
+    Codec codec = Codec::Deflate;
+    // Level for every compressed entry; 0 keeps the policy's (deflate) or codec default (zstd)
+    int level = 0;
+    // zstd long-distance matching for large, repetitive files
+    bool longDistance = false;
+    // .bikignore rules; nested .bikignore files are added as the walk finds them
+    IgnoreMatcher* ignore = nullptr;
+    // Paths changed since the base archive was written (from `bik watch`):
+    // only those are looked at, everything else is copied from the base
+    const ChangeSet* changes = nullptr;
+    // Native archives only: changed files of at least this many bytes are
+    // stored as a delta against their version in the base archive (0 = never)
+    uint64_t deltaMinSize = 0;
+    // Longest run of deltas on deltas before a file is stored in full again
+    unsigned deltaMaxChain = 8;
+    // Native archives only: trained zstd dictionary (see ZstdDictionary.h)
+    // that small files are compressed with; null or empty for none
+    const std::string* dictionary = nullptr;
+};
+
+struct ExtractOptions {
+    // Extraction threads, each with its own archive handle; 0 uses every core
+    unsigned jobs = 1;
+    // Extract only these entry names (all entries when null)
+    const std::unordered_set<std::string>* only = nullptr;
+    // Write each file to a temp file beside its destination and rename it into place
+    bool replaceAtomically = false;
+};
+
+// Entry metadata read from an archive's central directory
+struct ZipEntryInfo {
+    std::string name;
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    int64_t mtimeNs = 0;    // from the bik extra field, else the DOS timestamp
+    uint32_t mode = 0;      // Unix st_mode, 0 if not recorded
+};
+
+// Result of reading a backup back and checking it against its checksums
+struct VerifyReport {
+    size_t entries = 0;     // entries checked
+    uint64_t bytes = 0;     // bytes of file data read back
+    std::vector<std::string> corrupt;   // entries whose data does not match
+};
+
 class ZipUtils {
 public:
     // Create a zip archive from a directory
-    static bool createZip(const std::string& sourceDir, const std::string& zipPath);
+    static bool createZip(const std::string& sourceDir, const std::string& zipPath,
+                          const ZipOptions& options = ZipOptions());
     
     // Extract a zip archive to a directory
-    static bool extractZip(const std::string& zipPath, const std::string& destDir);
+    static bool extractZip(const std::string& zipPath, const std::string& destDir,
+                           const ExtractOptions& options = ExtractOptions());
+    
+    // Read the central directory of an archive without inflating anything
+    static bool listEntries(const std::string& zipPath, std::vector<ZipEntryInfo>& entries);
+    
+    // Inflate every entry on jobs threads (0 = all cores) and compare its
+    // size and CRC32 with the central directory, and its data with the hash
+    // in the bik extra field where the entry has one; false if any differ
+    static bool verifyZip(const std::string& zipPath, unsigned jobs, VerifyReport& report);
+    
+    // CRC32 of a file on disk
+    static bool fileCrc32(const std::string& path, uint32_t& crc);
     
     // List files in a directory recursively
     static std::vector<std::string> listFiles(const std::string& dir);
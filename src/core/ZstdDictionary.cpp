@@ -0,0 +1,149 @@
+#include "core/ZstdDictionary.h"
+#include "core/DirWalker.h"
+#include "core/IgnoreMatcher.h"
+#include "core/Stats.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef BIK_HAVE_ZSTD
+#include <zdict.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bik {
+
+namespace {
+
+// Sample bytes to train on: zstd recommends about 100 times the dictionary
+const uint64_t kSampleBytes = 100ULL * ZstdDictionary::kCapacity;
+
+// Fewer samples than this do not make a useful dictionary
+const size_t kMinSamples = 16;
+
+} // namespace
+
+std::string ZstdDictionary::pathFor(const std::string& backupDir, uint32_t id) {
+    return (fs::path(backupDir) / ".bikdict" / (std::to_string(id) + ".zdict")).string();
+}
+
+bool ZstdDictionary::load(const std::string& backupDir, uint32_t id, std::string& data) {
+    std::ifstream file(pathFor(backupDir, id), std::ios::binary);
+    if (!file.is_open()) return false;
+    std::ostringstream buf;
+    buf << file.rdbuf();
+    data = buf.str();
+    return !data.empty();
+}
+
+bool ZstdDictionary::train(const std::string& sourceDir, const std::string& backupDir,
+                           IgnoreMatcher* ignore, uint32_t& id) {
+#ifdef BIK_HAVE_ZSTD
+    Stats::Phase phase("dictionary");
+    fs::path source = fs::absolute(sourceDir);
+
+    // Every small file is a candidate; an even spread of them is read
+    std::vector<std::pair<std::string, uint64_t>> candidates;
+    uint64_t candidateBytes = 0;
+    DirWalker walker(source.string());
+    bool walked = walker.walk([&](const std::string& rel, DirWalker::Type type) {
+        if (rel == ".bik" || (ignore && !ignore->admit(source.string(), rel, type == DirWalker::Type::Directory))) {
+            return DirWalker::Visit::Skip;
+        }
+        if (type != DirWalker::Type::File) return DirWalker::Visit::Continue;
+        std::string abs = walker.absolutePath(rel);
+        std::error_code ec;
+        uint64_t size = fs::file_size(abs, ec);
+        if (!ec && size >= 16 && size <= kMaxEntrySize) {
+            candidates.emplace_back(abs, size);
+            candidateBytes += size;
+        }
+        return DirWalker::Visit::Continue;
+    });
+    if (!walked) return false;
+
+    size_t stride = static_cast<size_t>(candidateBytes / kSampleBytes) + 1;
+    std::string samples;
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < candidates.size(); i += stride) {
+        std::ifstream in(candidates[i].first, std::ios::binary);
+        std::ostringstream buf;
+        buf << in.rdbuf();
+        std::string data = buf.str();
+        if (data.empty()) continue;
+        samples += data;
+        sizes.push_back(data.size());
+        Stats::add(Stats::Counter::BytesRead, data.size());
+    }
+    if (sizes.size() < kMinSamples) {
+        std::cerr << "Error: the project has too few small files (" << sizes.size()
+                  << ") to train a dictionary on" << std::endl;
+        return false;
+    }
+
+    std::string dict(kCapacity, '\0');
+    size_t n = ZDICT_trainFromBuffer(&dict[0], dict.size(), samples.data(), sizes.data(),
+                                     static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(n)) {
+        std::cerr << "Error: dictionary training failed: " << ZDICT_getErrorName(n) << std::endl;
+        return false;
+    }
+    dict.resize(n);
+    id = ZDICT_getDictID(dict.data(), dict.size());
+    if (id == 0) {
+        std::cerr << "Error: dictionary training produced no dictionary ID" << std::endl;
+        return false;
+    }
+
+    // Older backups decode with the dictionary under this ID, so an existing
+    // one is kept when identical and never replaced otherwise (31-bit IDs can
+    // collide)
+    fs::path path = pathFor(backupDir, id);
+    std::error_code ec;
+    std::string existing;
+    if (fs::exists(path, ec)) {
+        if (load(backupDir, id, existing) && existing == dict) {
+            std::cout << "Dictionary " << id << " is unchanged" << std::endl;
+            return true;
+        }
+        std::cerr << "Error: a different dictionary with ID " << id << " already exists at " << path
+                  << "; refusing to replace it" << std::endl;
+        return false;
+    }
+    fs::create_directories(path.parent_path(), ec);
+    std::string tmpPath = path.string() + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        out.write(dict.data(), static_cast<std::streamsize>(dict.size()));
+        if (!out) {
+            std::cerr << "Error: cannot write " << tmpPath << std::endl;
+            return false;
+        }
+    }
+    // A link, unlike a rename, fails if the name appeared in the meantime
+    fs::create_hard_link(tmpPath, path, ec);
+    std::error_code removeEc;
+    fs::remove(tmpPath, removeEc);
+    if (ec) {
+        std::cerr << "Error: cannot write " << path << ": " << ec.message() << std::endl;
+        return false;
+    }
+    std::cout << "Trained zstd dictionary " << id << " (" << dict.size() << " bytes) from "
+              << sizes.size() << " file(s)" << std::endl;
+    return true;
+#else
+    (void)sourceDir;
+    (void)backupDir;
+    (void)ignore;
+    (void)id;
+    std::cerr << "Error: zstd dictionaries need bik built with libzstd" << std::endl;
+    return false;
+#endif
+}
+
+} // namespace bik
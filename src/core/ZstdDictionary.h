@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace bik {
+
+class IgnoreMatcher;
+
+// zstd dictionaries trained on a project's small files. A dictionary is kept
+// beside the backups as <backupDir>/.bikdict/<id>.zdict, named by the ID zstd
+// writes into every frame compressed with it, so a reader finds the right one
+// from the frame alone. Dictionaries are never rewritten: retraining adds a
+// new ID and older backups keep using theirs.
+class ZstdDictionary {
+public:
+    // Train a dictionary on a sample of the small files under sourceDir and
+    // store it in backupDir; id receives its ID
+    static bool train(const std::string& sourceDir, const std::string& backupDir,
+                      IgnoreMatcher* ignore, uint32_t& id);
+
+    static bool load(const std::string& backupDir, uint32_t id, std::string& data);
+    static std::string pathFor(const std::string& backupDir, uint32_t id);
+
+    // Files up to this size are compressed with the dictionary
+    static const uint64_t kMaxEntrySize = 64 * 1024;
+    // Dictionary size (zstd's own default)
+    static const size_t kCapacity = 110 * 1024;
+};
+
+} // namespace bik